@@ -19,49 +19,55 @@ function escaped (s) {
 }
 
 return function (screen) {
-  const estyle = {
-    r: screen.style.r||0,
-    f: screen.style.f||0,
-    b: screen.style.b||0
-  }
-
   let emptyLine = '                                                               '
   while (emptyLine.length < screen.columns) {
     emptyLine += emptyLine
   }
 
-  const htmlLineArray = screen.data.map(function (lines, y){
-    return lines.reduce(function (htmlline, line){
-        let lineLen = 0
-        const isCursorY = (y === screen.y)
-        htmlline = line.reduce(function (htmlline, e){
-          if (e.r !== undefined) estyle.r = e.r
-          if (e.f !== undefined) estyle.f = e.f
-          if (e.b !== undefined) estyle.b = e.b
+  // the styles of the first line of each array are relative to screen.style
+  const renderLines = (data, cursorY) => {
+    const estyle = {
+      r: screen.style.r||0,
+      f: screen.style.f||0,
+      b: screen.style.b||0
+    }
+
+    return data.map(function (lines, y){
+      return lines.reduce(function (htmlline, line){
+          let lineLen = 0
+          const isCursorY = (y === cursorY)
+          htmlline = line.reduce(function (htmlline, e){
+            if (e.r !== undefined) estyle.r = e.r
+            if (e.f !== undefined) estyle.f = e.f
+            if (e.b !== undefined) estyle.b = e.b
 
-          const spanStyle = '<span style="' + elem2style(estyle) + '">'
-          const s = e.s || ''
-          if (isCursorY && lineLen <= screen.x && screen.x < s.length + lineLen) {
-            const curstyle = { r: estyle.r, f: estyle.b, b: estyle.f }
             const spanStyle = '<span style="' + elem2style(estyle) + '">'
-            const spanCurStyle = '<span style="' + elem2style(curstyle) + '">'
-            const pcur = screen.x - lineLen
-            htmlline += spanStyle + escaped(s.substr(0, pcur)) + '</span>'
-              + spanCurStyle + escaped(s.substr(pcur, 1)) + '</span>'
-              + spanStyle + escaped(s.substr(pcur + 1)) + '</span>'
-          } else {
-            htmlline += spanStyle + escaped(s) + '</span>'
+            const s = e.s || ''
+            if (isCursorY && lineLen <= screen.x && screen.x < s.length + lineLen) {
+              const curstyle = { r: estyle.r, f: estyle.b, b: estyle.f }
+              const spanStyle = '<span style="' + elem2style(estyle) + '">'
+              const spanCurStyle = '<span style="' + elem2style(curstyle) + '">'
+              const pcur = screen.x - lineLen
+              htmlline += spanStyle + escaped(s.substr(0, pcur)) + '</span>'
+                + spanCurStyle + escaped(s.substr(pcur, 1)) + '</span>'
+                + spanStyle + escaped(s.substr(pcur + 1)) + '</span>'
+            } else {
+              htmlline += spanStyle + escaped(s) + '</span>'
+            }
+            lineLen += s.length
+            return htmlline
+          }, htmlline)
+          if (isCursorY && lineLen <= screen.x) {
+            htmlline += emptyLine.substr(0, screen.x - lineLen) + '<span style="'
+              + elem2style({ r: estyle.r, f: estyle.b, b: estyle.f }) + '"> </span>'
           }
-          lineLen += s.length
           return htmlline
-        }, htmlline)
-        if (isCursorY && lineLen <= screen.x) {
-          htmlline += emptyLine.substr(0, screen.x - lineLen) + '<span style="'
-            + elem2style({ r: estyle.r, f: estyle.b, b: estyle.f }) + '"> </span>'
-        }
-        return htmlline
-    }, '')
-  })
+      }, '')
+    })
+  }
+
+  const htmlLineArray = renderLines(screen.history || [], -1)
+    .concat(renderLines(screen.data, screen.y))
 
   return '<p id="tty-player-title">' + (screen.title||'') + '</p>'+
     '<div id="tty-player-terminal" style="color:#' +
@@ -23,6 +23,8 @@ PathLikeObject = Union[str, bytes, PathLike]
 
 # OutputFormat.json = 0
 # OutputFormat.ansi = 1
+# OutputFormat.json_patch = 2
+# OutputFormat.ansi_diff = 3
 
 # TranscriptPrefix.noprefix = 0
 # TranscriptPrefix.datetime = 1
@@ -91,6 +93,18 @@ class TerminalEmulator:
     def resize(self, lines: int, columns: int) -> None:
         _check_errnum(lib.terminal_emulator_resize(self._ctx, lines, columns))
 
+    def set_scrollback_size(self, max_lines: int) -> None:
+        _check_errnum(lib.terminal_emulator_set_scrollback_size(self._ctx, max_lines))
+
+    def set_scrollback_file(self, filename: PathLikeObject, mode: int = 0o600) -> None:
+        _check_errnum(lib.terminal_emulator_set_scrollback_file(
+            self._ctx, fsencode(filename), mode))
+
+    def get_scrollback_lines(self) -> int:
+        lines = c_size_t()
+        _check_errnum(lib.terminal_emulator_get_scrollback_lines(self._ctx, byref(lines)))
+        return lines.value
+
 
 class TerminalEmulatorBuffer:
     __slot__ = ('_ctx', '_allocator')
@@ -122,6 +136,17 @@ class TerminalEmulatorBuffer:
         else:
             _check_errnum(lib.terminal_emulator_buffer_prepare(self._ctx, emu._ctx, int(format)))
 
+    def prepare_history(self, emu: TerminalEmulator, first: int, count: int,
+                        extra_data: Optional[bytes] = None) -> None:
+        _check_errnum(lib.terminal_emulator_buffer_prepare_history(
+            self._ctx, emu._ctx, first, count, extra_data, len(extra_data) if extra_data else 0))
+
+    def set_keyframe_interval(self, interval: int) -> None:
+        _check_errnum(lib.terminal_emulator_buffer_set_keyframe_interval(self._ctx, interval))
+
+    def request_keyframe(self) -> None:
+        _check_errnum(lib.terminal_emulator_buffer_request_keyframe(self._ctx))
+
     def prepare_transcript_from_ttyrec(self,
                                        infile: PathLikeObject,
                                        prefix_type: TranscriptPrefix = TranscriptPrefix.datetime) -> None:
@@ -1,17 +1,25 @@
 # ./tools/cpp2ctypes/cpp2ctypes.lua 'src/rvt_lib/terminal_emulator.hpp' '-l' 'libwallix_term.so'
 
-from ctypes import CDLL, CFUNCTYPE, POINTER, c_char, c_char_p, c_int, c_size_t, c_void_p
-from enum import IntEnum
+from ctypes import CDLL, CFUNCTYPE, POINTER, Structure, c_bool, c_char, c_char_p, c_int, c_size_t, c_uint, c_uint8, c_void_p
+from enum import IntEnum, IntFlag
 
 lib = CDLL("libwallix_term.so")
 
 # enum class TerminalEmulatorOutputFormat : int {
 #    json,
-#    ansi
+#    ansi,
+#    /// json with only the changes since the previous prepare of the same buffer
+#    /// and periodic keyframes (see terminal_emulator_buffer_set_keyframe_interval())
+#    json_patch,
+#    /// escape sequences which update the terminal which displays the previous
+#    /// prepare of the same buffer (the first one redraws the whole screen)
+#    ansi_diff,
 # }
 class TerminalEmulatorOutputFormat(IntEnum):
     json = 0
     ansi = 1
+    json_patch = 2
+    ansi_diff = 3
 
     def from_param(self) -> int:
         return int(self)
@@ -41,6 +49,57 @@ class TerminalEmulatorCreateFileMode(IntEnum):
         return int(self)
 
 
+# Combination of flags.
+# enum class TerminalEmulatorDamage : int {
+#    none = 0,
+#    lines = 1 << 0,
+#    cursor = 1 << 1,
+#    modes = 1 << 2,
+#    size = 1 << 3,
+#    title = 1 << 4,
+#    current_screen = 1 << 5,
+# }
+class TerminalEmulatorDamage(IntFlag):
+    none = 0
+    lines = 1 << 0
+    cursor = 1 << 1
+    modes = 1 << 2
+    size = 1 << 3
+    title = 1 << 4
+    current_screen = 1 << 5
+
+    def from_param(self) -> int:
+        return int(self)
+
+
+# Bytes allocated by an emulator.
+# The screen categories are the sum of the primary and the alternate screen.
+# struct TerminalEmulatorMemoryUsage
+# {
+#     std::size_t total;
+#     std::size_t emulator;
+#     std::size_t cells;
+#     std::size_t line_properties;
+#     std::size_t tab_stops;
+#     std::size_t styles;
+#     std::size_t extended_chars;
+#     std::size_t alternate_screen; // part of total used by the alternate screen
+#     std::size_t scrollback;
+# }
+class TerminalEmulatorMemoryUsage(Structure):
+    _fields_ = [
+        ("total", c_size_t),
+        ("emulator", c_size_t),
+        ("cells", c_size_t),
+        ("line_properties", c_size_t),
+        ("tab_stops", c_size_t),
+        ("styles", c_size_t),
+        ("extended_chars", c_size_t),
+        ("alternate_screen", c_size_t),
+        ("scrollback", c_size_t),
+    ]
+
+
 # \return  0 if success ; -3 for bad_alloc ; -2 if bad argument (emu is null, bad format, bad size, etc) ; -1 if internal error with `errno` code to 0 (bad alloc, etc) ; > 0 is an `errno` code,
 # @{
 # char const * terminal_emulator_version() noexcept;
@@ -60,6 +119,18 @@ terminal_emulator_delete.argtypes = [c_void_p]
 terminal_emulator_delete.restype = c_int
 
 # END ctor/dtor
+# BEGIN snapshot
+# TerminalEmulatorSnapshot * terminal_emulator_snapshot_new(TerminalEmulator const * emu) noexcept;
+terminal_emulator_snapshot_new = lib.terminal_emulator_snapshot_new
+terminal_emulator_snapshot_new.argtypes = [c_void_p]
+terminal_emulator_snapshot_new.restype = c_void_p
+
+# int terminal_emulator_snapshot_delete(TerminalEmulatorSnapshot * snapshot) noexcept;
+terminal_emulator_snapshot_delete = lib.terminal_emulator_snapshot_delete
+terminal_emulator_snapshot_delete.argtypes = [c_void_p]
+terminal_emulator_snapshot_delete.restype = c_int
+
+# END snapshot
 # BEGIN log
 # str is zero-terminated
 TerminalEmulatorLogFunction = CFUNCTYPE(None, c_char_p, c_size_t)
@@ -96,7 +167,86 @@ terminal_emulator_resize = lib.terminal_emulator_resize
 terminal_emulator_resize.argtypes = [c_void_p, c_int, c_int]
 terminal_emulator_resize.restype = c_int
 
+# When \c enable is true, terminal_emulator_resize() wraps again the wrapped lines
+# of the primary screen at the new width instead of truncating them.
+# int terminal_emulator_set_resize_reflow(TerminalEmulator * emu, bool enable) noexcept;
+terminal_emulator_set_resize_reflow = lib.terminal_emulator_set_resize_reflow
+terminal_emulator_set_resize_reflow.argtypes = [c_void_p, c_bool]
+terminal_emulator_set_resize_reflow.restype = c_int
+
+# Keeps up to \c max_lines lines scrolled out of the primary screen in a compressed
+# history (see terminal_emulator_buffer_prepare_history()). 0 (default) disables
+# it and releases the history.
+# int terminal_emulator_set_scrollback_size(TerminalEmulator * emu, std::size_t max_lines) noexcept;
+terminal_emulator_set_scrollback_size = lib.terminal_emulator_set_scrollback_size
+terminal_emulator_set_scrollback_size.argtypes = [c_void_p, c_size_t]
+terminal_emulator_set_scrollback_size.restype = c_int
+
+# Appends the compressed history to \c filename (created or truncated with \c mode)
+# instead of keeping it in memory, the history is read back through a memory mapping.
+# For very long sessions: the file keeps growing even when the oldest lines leave
+# the history. The history must be enabled with terminal_emulator_set_scrollback_size().
+# int terminal_emulator_set_scrollback_file(
+#     TerminalEmulator * emu, char const * filename, int mode) noexcept;
+terminal_emulator_set_scrollback_file = lib.terminal_emulator_set_scrollback_file
+terminal_emulator_set_scrollback_file.argtypes = [c_void_p, c_char_p, c_int]
+terminal_emulator_set_scrollback_file.restype = c_int
+
+# \c *lines receives the number of lines in the history.
+# int terminal_emulator_get_scrollback_lines(
+#     TerminalEmulator const * emu, std::size_t * lines) noexcept;
+terminal_emulator_get_scrollback_lines = lib.terminal_emulator_get_scrollback_lines
+terminal_emulator_get_scrollback_lines.argtypes = [c_void_p, POINTER(c_size_t)]
+terminal_emulator_get_scrollback_lines.restype = c_int
+
+# int terminal_emulator_set_alternate_screen_release_delay(TerminalEmulator * emu, int milliseconds) noexcept;
+terminal_emulator_set_alternate_screen_release_delay = lib.terminal_emulator_set_alternate_screen_release_delay
+terminal_emulator_set_alternate_screen_release_delay.argtypes = [c_void_p, c_int]
+terminal_emulator_set_alternate_screen_release_delay.restype = c_int
+
 # END emulator
+# BEGIN memory
+# int terminal_emulator_memory_usage(
+#     TerminalEmulator const * emu, TerminalEmulatorMemoryUsage * usage) noexcept;
+terminal_emulator_memory_usage = lib.terminal_emulator_memory_usage
+terminal_emulator_memory_usage.argtypes = [c_void_p, POINTER(TerminalEmulatorMemoryUsage)]
+terminal_emulator_memory_usage.restype = c_int
+
+# Soft limit checked after each feed: over \c bytes, the memory which is
+# not needed by the displayed content is released (unused alternate screen,
+# unreferenced combining sequences, preallocated space). 0 disables the budget.
+# int terminal_emulator_set_memory_budget(TerminalEmulator * emu, std::size_t bytes) noexcept;
+terminal_emulator_set_memory_budget = lib.terminal_emulator_set_memory_budget
+terminal_emulator_set_memory_budget.argtypes = [c_void_p, c_size_t]
+terminal_emulator_set_memory_budget.restype = c_int
+
+# Shrinks \c emu to its displayed content: for idle sessions.
+# The alternate screen is released when it is not displayed.
+# int terminal_emulator_trim(TerminalEmulator * emu) noexcept;
+terminal_emulator_trim = lib.terminal_emulator_trim
+terminal_emulator_trim.argtypes = [c_void_p]
+terminal_emulator_trim.restype = c_int
+
+# END memory
+# BEGIN damage
+# Changes since the last terminal_emulator_reset_damage() (or the creation of \c emu).
+# \param damage       receives a combination of TerminalEmulatorDamage
+# \param dirty_lines  when not null, dirty_lines[y] is set to 1 when the line y
+#                     of the displayed screen changed, 0 otherwise
+# \param dirty_lines_len  number of lines written in \c dirty_lines (up to the number of lines)
+# int terminal_emulator_get_damage(
+#     TerminalEmulator const * emu, int * damage,
+#     uint8_t * dirty_lines, std::size_t dirty_lines_len) noexcept;
+terminal_emulator_get_damage = lib.terminal_emulator_get_damage
+terminal_emulator_get_damage.argtypes = [c_void_p, POINTER(c_int), POINTER(c_uint8), c_size_t]
+terminal_emulator_get_damage.restype = c_int
+
+# int terminal_emulator_reset_damage(TerminalEmulator * emu) noexcept;
+terminal_emulator_reset_damage = lib.terminal_emulator_reset_damage
+terminal_emulator_reset_damage.argtypes = [c_void_p]
+terminal_emulator_reset_damage.restype = c_int
+
+# END damage
 # BEGIN buffer
 TerminalEmulatorBufferGetBufferFn = CFUNCTYPE(c_void_p, c_void_p, POINTER(c_size_t))
 
@@ -154,6 +304,41 @@ terminal_emulator_buffer_prepare2 = lib.terminal_emulator_buffer_prepare2
 terminal_emulator_buffer_prepare2.argtypes = [c_void_p, c_void_p, c_int, POINTER(c_char), c_size_t]
 terminal_emulator_buffer_prepare2.restype = c_int
 
+# int terminal_emulator_buffer_prepare_snapshot(
+#     TerminalEmulatorBuffer * buffer, TerminalEmulatorSnapshot const * snapshot,
+#     TerminalEmulatorOutputFormat format, uint8_t const * extra_data,
+#     std::size_t extra_data_len) noexcept;
+terminal_emulator_buffer_prepare_snapshot = lib.terminal_emulator_buffer_prepare_snapshot
+terminal_emulator_buffer_prepare_snapshot.argtypes = [c_void_p, c_void_p, c_int, POINTER(c_char), c_size_t]
+terminal_emulator_buffer_prepare_snapshot.restype = c_int
+
+# Same as terminal_emulator_buffer_prepare2() with TerminalEmulatorOutputFormat::json,
+# the lines [\c first, \c first + \c count) of the history (0 is the oldest line)
+# are in a "history" array before "data".
+# int terminal_emulator_buffer_prepare_history(
+#     TerminalEmulatorBuffer * buffer, TerminalEmulator * emu,
+#     std::size_t first, std::size_t count,
+#     uint8_t const * extra_data, std::size_t extra_data_len) noexcept;
+terminal_emulator_buffer_prepare_history = lib.terminal_emulator_buffer_prepare_history
+terminal_emulator_buffer_prepare_history.argtypes = [c_void_p, c_void_p, c_size_t, c_size_t, POINTER(c_char), c_size_t]
+terminal_emulator_buffer_prepare_history.restype = c_int
+
+# With TerminalEmulatorOutputFormat::json_patch, a full json is emitted
+# every \c interval prepares (64 by default), 0 for only when the size changes.
+# int terminal_emulator_buffer_set_keyframe_interval(
+#     TerminalEmulatorBuffer * buffer, unsigned interval) noexcept;
+terminal_emulator_buffer_set_keyframe_interval = lib.terminal_emulator_buffer_set_keyframe_interval
+terminal_emulator_buffer_set_keyframe_interval.argtypes = [c_void_p, c_uint]
+terminal_emulator_buffer_set_keyframe_interval.restype = c_int
+
+# The next prepare with TerminalEmulatorOutputFormat::json_patch emits a full json,
+# with TerminalEmulatorOutputFormat::ansi_diff redraws the whole screen.
+# For a new client or when \c buffer is used with another emulator.
+# int terminal_emulator_buffer_request_keyframe(TerminalEmulatorBuffer * buffer) noexcept;
+terminal_emulator_buffer_request_keyframe = lib.terminal_emulator_buffer_request_keyframe
+terminal_emulator_buffer_request_keyframe.argtypes = [c_void_p]
+terminal_emulator_buffer_request_keyframe.restype = c_int
+
 # uint8_t const * terminal_emulator_buffer_get_data(
 #     TerminalEmulatorBuffer const * buffer, std::size_t * output_len) noexcept;
 terminal_emulator_buffer_get_data = lib.terminal_emulator_buffer_get_data
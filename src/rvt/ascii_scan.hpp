@@ -0,0 +1,198 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+
+namespace rvt
+{
+
+constexpr bool is_printable_ascii(uint8_t c) noexcept
+{
+    return c >= 0x20 && c < 0x7f;
+}
+
+/// \return a pointer on the first byte which isn't a printable ASCII character
+/// (control character, ESC, DEL or byte >= 0x80) or \c last.
+inline uint8_t const * find_non_printable_ascii(uint8_t const * first, uint8_t const * last) noexcept
+{
+    // with a signed comparison, bytes >= 0x80 are lower than ' '
+
+#ifdef __AVX2__
+    {
+        __m256i const space = _mm256_set1_epi8(0x20);
+        __m256i const del = _mm256_set1_epi8(0x7f);
+        while (last - first >= 32) {
+            __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(first));
+            auto const mask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(
+                _mm256_cmpgt_epi8(space, v),
+                _mm256_cmpeq_epi8(v, del)
+            )));
+            if (mask) {
+                return first + __builtin_ctz(mask);
+            }
+            first += 32;
+        }
+    }
+#endif
+
+#ifdef __SSE2__
+    {
+        __m128i const space = _mm_set1_epi8(0x20);
+        __m128i const del = _mm_set1_epi8(0x7f);
+        while (last - first >= 16) {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first));
+            auto const mask = unsigned(_mm_movemask_epi8(_mm_or_si128(
+                _mm_cmplt_epi8(v, space),
+                _mm_cmpeq_epi8(v, del)
+            )));
+            if (mask) {
+                return first + __builtin_ctz(mask);
+            }
+            first += 16;
+        }
+    }
+#endif
+
+    while (first != last && is_printable_ascii(*first)) {
+        ++first;
+    }
+
+    return first;
+}
+
+/// \return a pointer on the first byte different from \c value or \c last.
+inline uint8_t const * find_not_equal(uint8_t const * first, uint8_t const * last, uint8_t value) noexcept
+{
+#ifdef __SSE2__
+    {
+        __m128i const values = _mm_set1_epi8(char(value));
+        while (last - first >= 16) {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first));
+            auto const mask = ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, values))) & 0xffffu;
+            if (mask) {
+                return first + __builtin_ctz(mask);
+            }
+            first += 16;
+        }
+    }
+#endif
+
+    while (first != last && *first == value) {
+        ++first;
+    }
+
+    return first;
+}
+
+/// Printable ASCII character which is not escaped in a JSON string.
+constexpr bool is_json_plain_ascii(uint32_t c) noexcept
+{
+    return c >= 0x20 && c < 0x7f && c != '"' && c != '\\';
+}
+
+/// \return a pointer on the first code point which isn't a printable ASCII character
+/// or which is escaped in a JSON string ('"' and '\\'), or \c last.
+inline uint32_t const * find_json_non_plain_ascii(uint32_t const * first, uint32_t const * last) noexcept
+{
+    // c is printable when c - 0x20 <= 0x5e with an unsigned comparison,
+    // the comparisons are signed: c + 0x7fffffe0 (c - 0x20 with the sign bit
+    // flipped) <= INT32_MIN + 0x5e
+
+#ifdef __AVX2__
+    {
+        __m256i const bias = _mm256_set1_epi32(0x7fffffe0);
+        __m256i const limit = _mm256_set1_epi32(INT32_MIN + 0x5e);
+        __m256i const quote = _mm256_set1_epi32('"');
+        __m256i const backslash = _mm256_set1_epi32('\\');
+        while (last - first >= 8) {
+            __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(first));
+            auto const mask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(
+                _mm256_cmpgt_epi32(_mm256_add_epi32(v, bias), limit),
+                _mm256_or_si256(_mm256_cmpeq_epi32(v, quote), _mm256_cmpeq_epi32(v, backslash))
+            )));
+            if (mask) {
+                return first + __builtin_ctz(mask) / 4;
+            }
+            first += 8;
+        }
+    }
+#endif
+
+#ifdef __SSE2__
+    {
+        __m128i const bias = _mm_set1_epi32(0x7fffffe0);
+        __m128i const limit = _mm_set1_epi32(INT32_MIN + 0x5e);
+        __m128i const quote = _mm_set1_epi32('"');
+        __m128i const backslash = _mm_set1_epi32('\\');
+        while (last - first >= 4) {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first));
+            auto const mask = unsigned(_mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpgt_epi32(_mm_add_epi32(v, bias), limit),
+                _mm_or_si128(_mm_cmpeq_epi32(v, quote), _mm_cmpeq_epi32(v, backslash))
+            )));
+            if (mask) {
+                return first + __builtin_ctz(mask) / 4;
+            }
+            first += 4;
+        }
+    }
+#endif
+
+    while (first != last && is_json_plain_ascii(*first)) {
+        ++first;
+    }
+
+    return first;
+}
+
+/// Copies the code points of [first, last) as bytes.
+/// \pre every code point is lower than 0x80
+/// \return the end of \c out
+inline char * narrow_ascii(uint32_t const * first, uint32_t const * last, char * out) noexcept
+{
+#ifdef __SSE2__
+    while (last - first >= 16) {
+        auto load = [](uint32_t const * p) {
+            return _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+        };
+        __m128i const lo = _mm_packs_epi32(load(first), load(first + 4));
+        __m128i const hi = _mm_packs_epi32(load(first + 8), load(first + 12));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(lo, hi));
+        first += 16;
+        out += 16;
+    }
+#endif
+
+    while (first != last) {
+        *out++ = char(*first++);
+    }
+
+    return out;
+}
+
+}
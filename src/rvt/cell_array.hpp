@@ -0,0 +1,337 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+
+#pragma once
+
+#include "rvt/character.hpp"
+
+#include "utils/sugar/enum_flags_operators.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+#include <cstring> // memmove
+
+#if defined(__SSE2__) || defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+
+namespace rvt
+{
+    enum class CellFlags : uint8_t
+    {
+        None     = 0,
+        Real     = (1 << 0),
+        Extended = (1 << 1),
+    };
+}
+template<> struct is_enum_flags<rvt::CellFlags> : std::true_type {};
+
+
+namespace rvt
+{
+
+/**
+ * Consecutive cells of a CellArray (a line of a screen): a pointer by field.
+ * Indexes are relative to the first cell.
+ */
+struct CellSpan
+{
+    ucs4_char * codePoints;
+    StyleId * styles;
+    CellFlags * flags;
+
+    static CellFlags to_flags(Cell const & cell) noexcept
+    {
+        return (cell.isRealCharacter ? CellFlags::Real : CellFlags::None)
+             | (cell.isExtended ? CellFlags::Extended : CellFlags::None);
+    }
+
+    Cell get(std::size_t i) const noexcept
+    {
+        return Cell{
+            this->codePoints[i],
+            this->styles[i],
+            bool(this->flags[i] & CellFlags::Real),
+            bool(this->flags[i] & CellFlags::Extended),
+        };
+    }
+
+    void set(std::size_t i, Cell const & cell) const noexcept
+    {
+        this->codePoints[i] = cell.character;
+        this->styles[i] = cell.style;
+        this->flags[i] = to_flags(cell);
+    }
+
+    void fill(std::size_t first, std::size_t last, Cell const & cell) const noexcept
+    {
+        std::fill(this->codePoints + first, this->codePoints + last, cell.character);
+        std::fill(this->styles + first, this->styles + last, cell.style);
+        std::fill(this->flags + first, this->flags + last, to_flags(cell));
+    }
+
+    /// Moves the cells [first, last) to \c dest, the ranges may overlap.
+    void move(std::size_t first, std::size_t last, std::size_t dest) const noexcept
+    {
+        if (first != last) {
+            std::size_t const n = last - first;
+            memmove(this->codePoints + dest, this->codePoints + first, n * sizeof(*this->codePoints));
+            memmove(this->styles + dest, this->styles + first, n * sizeof(*this->styles));
+            memmove(this->flags + dest, this->flags + first, n * sizeof(*this->flags));
+        }
+    }
+
+    /// Copies the \c n first cells of \c other.
+    void copy(CellSpan const & other, std::size_t n) const noexcept
+    {
+        std::copy_n(other.codePoints, n, this->codePoints);
+        std::copy_n(other.styles, n, this->styles);
+        std::copy_n(other.flags, n, this->flags);
+    }
+};
+
+/**
+ * Cells stored as a structure of arrays: code points, style ids and flags
+ * are in separate arrays so that a line can be scanned with vector instructions.
+ */
+class CellArray
+{
+public:
+    CellArray() = default;
+
+    explicit CellArray(std::size_t size)
+    {
+        this->resize(size);
+    }
+
+    /// New cells are default cells.
+    void resize(std::size_t size)
+    {
+        Cell const cell{};
+        this->_codePoints.resize(size, cell.character);
+        this->_styles.resize(size, cell.style);
+        this->_flags.resize(size, to_flags(cell));
+    }
+
+    std::size_t size() const noexcept { return this->_codePoints.size(); }
+
+    /// Bytes allocated by the cells.
+    std::size_t memoryUsage() const noexcept
+    {
+        return this->_codePoints.capacity() * sizeof(ucs4_char)
+             + this->_styles.capacity() * sizeof(StyleId)
+             + this->_flags.capacity() * sizeof(CellFlags);
+    }
+
+    Cell get(std::size_t i) const noexcept
+    {
+        return Cell{
+            this->_codePoints[i],
+            this->_styles[i],
+            bool(this->_flags[i] & CellFlags::Real),
+            bool(this->_flags[i] & CellFlags::Extended),
+        };
+    }
+
+    void set(std::size_t i, Cell const & cell) noexcept
+    {
+        this->_codePoints[i] = cell.character;
+        this->_styles[i] = cell.style;
+        this->_flags[i] = to_flags(cell);
+    }
+
+    void fill(std::size_t first, std::size_t last, Cell const & cell) noexcept
+    {
+        std::fill(this->_codePoints.data() + first, this->_codePoints.data() + last, cell.character);
+        std::fill(this->_styles.data() + first, this->_styles.data() + last, cell.style);
+        std::fill(this->_flags.data() + first, this->_flags.data() + last, to_flags(cell));
+    }
+
+    /// Moves the cells [first, last) to \c dest, the ranges may overlap.
+    void move(std::size_t first, std::size_t last, std::size_t dest) noexcept
+    {
+        move_range(this->_codePoints, first, last, dest);
+        move_range(this->_styles, first, last, dest);
+        move_range(this->_flags, first, last, dest);
+    }
+
+    /// Copies \c n cells of \c other from \c first to \c dest.
+    void copy(CellArray const & other, std::size_t first, std::size_t n, std::size_t dest) noexcept
+    {
+        std::copy_n(other._codePoints.data() + first, n, this->_codePoints.data() + dest);
+        std::copy_n(other._styles.data() + first, n, this->_styles.data() + dest);
+        std::copy_n(other._flags.data() + first, n, this->_flags.data() + dest);
+    }
+
+    ucs4_char * codePoints() noexcept { return this->_codePoints.data(); }
+    StyleId * styles() noexcept { return this->_styles.data(); }
+    CellFlags * flags() noexcept { return this->_flags.data(); }
+
+    ucs4_char const * codePoints() const noexcept { return this->_codePoints.data(); }
+    StyleId const * styles() const noexcept { return this->_styles.data(); }
+    CellFlags const * flags() const noexcept { return this->_flags.data(); }
+
+    CellSpan span(std::size_t offset) noexcept
+    {
+        return {this->codePoints() + offset, this->styles() + offset, this->flags() + offset};
+    }
+
+    static CellFlags to_flags(Cell const & cell) noexcept
+    {
+        return CellSpan::to_flags(cell);
+    }
+
+private:
+    template<class T>
+    static void move_range(std::vector<T> & v, std::size_t first, std::size_t last, std::size_t dest) noexcept
+    {
+        if (first != last) {
+            memmove(v.data() + dest, v.data() + first, (last - first) * sizeof(T));
+        }
+    }
+
+    std::vector<ucs4_char> _codePoints;
+    std::vector<StyleId> _styles;
+    std::vector<CellFlags> _flags;
+};
+
+
+/**
+ * Rows of cells shared by a Screen and its snapshots.
+ *
+ * Rows are allocated by chunks which never move: a snapshot keeps pointers
+ * on its rows while new rows are added. Each row counts the snapshots which
+ * refer to it, the screen does not modify a row with a non zero counter.
+ */
+class RowPool
+{
+public:
+    RowPool(std::size_t rowsPerChunk, std::size_t columns)
+    : _rowsPerChunk(rowsPerChunk)
+    , _columns(columns)
+    {
+        this->grow();
+    }
+
+    /// Number of rows.
+    std::size_t size() const noexcept { return this->_chunks.size() * this->_rowsPerChunk; }
+    std::size_t columns() const noexcept { return this->_columns; }
+
+    /// Adds a chunk of rows.
+    void grow()
+    {
+        Chunk chunk{
+            CellArray(this->_rowsPerChunk * this->_columns),
+            std::make_unique<std::atomic<uint32_t>[]>(this->_rowsPerChunk),
+        };
+        this->_chunks.emplace_back(std::move(chunk));
+    }
+
+    CellSpan row(std::size_t i) noexcept
+    {
+        Chunk & chunk = this->_chunks[i / this->_rowsPerChunk];
+        return chunk.cells.span(i % this->_rowsPerChunk * this->_columns);
+    }
+
+    /// Number of snapshots using the row \c i.
+    std::atomic<uint32_t> & references(std::size_t i) noexcept
+    {
+        return this->_chunks[i / this->_rowsPerChunk].references[i % this->_rowsPerChunk];
+    }
+
+    bool isShared(std::size_t i) noexcept
+    {
+        return this->references(i).load(std::memory_order_acquire) != 0;
+    }
+
+    /// Bytes allocated by the pool.
+    std::size_t memoryUsage() const noexcept
+    {
+        std::size_t n = this->_chunks.capacity() * sizeof(Chunk);
+        for (Chunk const & chunk : this->_chunks) {
+            n += chunk.cells.memoryUsage() + this->_rowsPerChunk * sizeof(std::atomic<uint32_t>);
+        }
+        return n;
+    }
+
+private:
+    struct Chunk
+    {
+        CellArray cells;
+        std::unique_ptr<std::atomic<uint32_t>[]> references;
+    };
+
+    std::size_t _rowsPerChunk;
+    std::size_t _columns;
+    std::vector<Chunk> _chunks;
+};
+
+
+/// \return a pointer on the first style different from \c *first or \c last.
+inline StyleId const * find_style_run_end(StyleId const * first, StyleId const * last) noexcept
+{
+    if (first == last) {
+        return last;
+    }
+
+    StyleId const style = *first;
+
+#ifdef __AVX2__
+    {
+        __m256i const s = _mm256_set1_epi16(static_cast<short>(style));
+        while (last - first >= 16) {
+            __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(first));
+            auto const mask = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, s)));
+            if (mask) {
+                return first + __builtin_ctz(mask) / 2;
+            }
+            first += 16;
+        }
+    }
+#endif
+
+#ifdef __SSE2__
+    {
+        __m128i const s = _mm_set1_epi16(static_cast<short>(style));
+        while (last - first >= 8) {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(first));
+            auto const mask = ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(v, s))) & 0xffffu;
+            if (mask) {
+                return first + __builtin_ctz(mask) / 2;
+            }
+            first += 8;
+        }
+    }
+#endif
+
+    while (first != last && *first == style) {
+        ++first;
+    }
+
+    return first;
+}
+
+}
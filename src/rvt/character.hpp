@@ -29,12 +29,12 @@
 #include "utils/sugar/enum_flags_operators.hpp"
 #include "utils/sugar/numerics/safe_conversions.hpp"
 
+#include <algorithm>
 #include <array>
 #include <vector>
-#include <memory>
 
+#include <cassert>
 #include <cstdint>
-#include <cstring> // memcpy
 
 
 namespace rvt
@@ -157,75 +157,384 @@ inline bool Character::equalsFormat(const Character& other) const
 }
 
 
-struct ExtendedCharacter
+/**
+ * Colors and rendition flags of a character.
+ * Rendition::ExtendedChar is never part of a style.
+ */
+struct CharacterStyle
+{
+    Rendition rendition = Rendition::Default;
+    CharacterColor foregroundColor {ColorSpace::Default, DEFAULT_FORE_COLOR};
+    CharacterColor backgroundColor {ColorSpace::Default, DEFAULT_BACK_COLOR};
+};
+
+inline bool operator == (const CharacterStyle& a, const CharacterStyle& b)
+{
+    return a.rendition == b.rendition
+        && a.foregroundColor == b.foregroundColor
+        && a.backgroundColor == b.backgroundColor;
+}
+
+inline bool operator != (const CharacterStyle& a, const CharacterStyle& b)
 {
-    ucs4_carray_view as_array() const noexcept
-    { return {this->chars.get(), this->len}; }
+    return !operator==(a, b);
+}
+
+/// Index of a CharacterStyle in a StyleTable
+using StyleId = uint16_t;
+
+/**
+ * Packed representation of a Character stored in the screen image.
+ * Colors and rendition are shared through a StyleTable.
+ */
+struct Cell
+{
+    /** The unicode character value or an index in the ExtendedCharTable when isExtended is set. */
+    ucs4_char character = ' ';
+    StyleId style = 0;
+    bool isRealCharacter = true;
+    bool isExtended = false;
 
-    void append(ucs4_char uc);
+    inline bool is_extended() const noexcept
+    { return this->isExtended; }
 
-    uint16_t len;
-    uint16_t capacity;
-    std::unique_ptr<ucs4_char[]> chars;
+    /** returns true if the format (color, rendition flag) of the compared cells is equal */
+    inline bool equalsFormat(Cell const & other) const noexcept
+    { return this->style == other.style; }
 };
 
+static_assert(sizeof(Cell) == 8);
+
+inline bool operator == (const Cell& a, const Cell& b)
+{
+    return a.character == b.character
+        && a.style == b.style
+        && a.isRealCharacter == b.isRealCharacter
+        && a.isExtended == b.isExtended;
+}
+
+inline bool operator != (const Cell& a, const Cell& b)
+{
+    return !operator==(a, b);
+}
+
+
+/**
+ * Interned CharacterStyle of a screen. The style 0 is the default style.
+ */
+class StyleTable
+{
+public:
+    static constexpr StyleId DefaultStyle = 0;
+    static constexpr std::size_t max_size = 0xffff;
+
+    StyleTable()
+    {
+        this->clear();
+    }
 
+    /// Returns the id of \c style, adds it when missing. Returns false when the table is full.
+    bool intern(CharacterStyle const & style, StyleId & id);
+
+    /// Returns false when \c style is not in the table.
+    bool find(CharacterStyle const & style, StyleId & id) const noexcept;
+
+    inline CharacterStyle const & operator[](StyleId id) const noexcept
+    { return this->styles[id]; }
+
+    inline std::size_t size() const noexcept
+    { return this->styles.size(); }
+
+    inline Character toCharacter(Cell const & cell) const noexcept
+    {
+        CharacterStyle const & style = this->styles[cell.style];
+        return Character(
+            cell.character, style.foregroundColor, style.backgroundColor,
+            cell.isExtended ? style.rendition | Rendition::ExtendedChar : style.rendition,
+            cell.isRealCharacter);
+    }
+
+    /**
+     * Removes the styles for which \c used is false.
+     * \c remap receives the new id of each remaining style.
+     */
+    void compact(array_view<const bool> used, array_view<StyleId> remap);
+
+    void clear();
+
+    /// Releases the memory which is not used by the styles, the index is resized accordingly.
+    void shrinkToFit();
+
+    /// Bytes allocated by the table.
+    std::size_t memoryUsage() const noexcept
+    {
+        return this->styles.capacity() * sizeof(CharacterStyle)
+             + this->buckets.capacity() * sizeof(uint16_t);
+    }
+
+private:
+    static std::size_t hash(CharacterStyle const & style) noexcept
+    {
+        uint64_t const h
+          = (uint64_t(style.foregroundColor.packed()) << 32 | style.backgroundColor.packed())
+          ^ uint64_t(style.rendition);
+        return (h * 0x9E3779B97F4A7C15u) >> 32;
+    }
+
+    void insertIndex(StyleId id);
+
+    std::vector<CharacterStyle> styles;
+    // open addressing table of id + 1, 0 is an empty bucket
+    std::vector<uint16_t> buckets;
+};
+
+
+/**
+ * Sequences of code points (a character followed by combining characters)
+ * referenced by the cells with the ExtendedChar flag.
+ *
+ * All the sequences share one arena. A sequence which outgrows its capacity
+ * is moved at the end of the arena; the space left behind, like the sequences
+ * of overwritten cells, is only reclaimed by compactInto().
+ */
 class ExtendedCharTable
 {
 public:
+    static constexpr std::size_t max_sequence_size = 1u << 15;
+
     ExtendedCharTable() = default;
 
     void growChar(Character & character, ucs4_char uc);
+    void growChar(Cell & cell, ucs4_char uc);
 
+    /// Removes all the sequences, the allocated memory is kept for reuse.
     void clear();
 
+    /// Preallocates \c arena_size code points and the matching number of sequences.
+    void reserve(std::size_t arena_size)
+    {
+        this->arena.reserve(arena_size);
+        // a sequence holds at least 2 code points
+        this->sequences.reserve(arena_size / 2);
+    }
+
+    void swap(ExtendedCharTable & other) noexcept
+    {
+        this->arena.swap(other.arena);
+        this->sequences.swap(other.sequences);
+    }
+
     inline ucs4_carray_view operator[](std::size_t i) const noexcept
-    { return this->extendedCharTable[i].as_array(); }
+    {
+        Sequence const & seq = this->sequences[i];
+        return {this->arena.data() + seq.offset, seq.len};
+    }
 
+    /// Number of sequences.
     inline std::size_t size() const noexcept
-    { return this->extendedCharTable.size(); }
+    { return this->sequences.size(); }
+
+    /// Number of code points allocated in the arena, including unreclaimed space.
+    inline std::size_t arenaSize() const noexcept
+    { return this->arena.size(); }
+
+    inline std::size_t arenaCapacity() const noexcept
+    { return this->arena.capacity(); }
 
-    std::vector<ExtendedCharacter> extendedCharTable;
+    /// Bytes allocated by the table.
+    std::size_t memoryUsage() const noexcept
+    {
+        return this->arena.capacity() * sizeof(ucs4_char)
+             + this->sequences.capacity() * sizeof(Sequence);
+    }
+
+    /// Releases the memory which is not used by the sequences.
+    void shrinkToFit()
+    {
+        this->arena.shrink_to_fit();
+        this->sequences.shrink_to_fit();
+    }
+
+    /// Copies the sequence \c i at the end of \c other and returns its index in \c other.
+    ucs4_char compactInto(ExtendedCharTable & other, ucs4_char i) const;
+
+private:
+    // returns the index of the extended character
+    ucs4_char growChar(ucs4_char character, bool is_extended, ucs4_char uc);
+
+    ucs4_char newSequence(ucs4_carray_view chars, uint16_t capacity);
+
+    struct Sequence
+    {
+        uint32_t offset;
+        uint16_t len;
+        uint16_t capacity;
+    };
+
+    std::vector<ucs4_char> arena;
+    std::vector<Sequence> sequences;
 };
 
 
-inline void ExtendedCharacter::append(ucs4_char uc)
+inline bool StyleTable::find(CharacterStyle const & style, StyleId & id) const noexcept
 {
-    if (this->len == this->capacity) {
-        if (this->len != (1u << (8 * sizeof(this->len) - 1))) {
-            std::unique_ptr<ucs4_char[]> u(new ucs4_char[this->capacity * 2u]);
-            memcpy(u.get(), this->chars.get(), this->len);
-            this->chars = std::move(u);
-            this->capacity *= 2u;
-            this->chars[this->len] = uc;
-            this->len++;
+    assert(!bool(style.rendition & Rendition::ExtendedChar));
+
+    std::size_t const mask = this->buckets.size() - 1;
+    for (std::size_t i = hash(style) & mask; this->buckets[i]; i = (i + 1) & mask) {
+        StyleId const current = StyleId(this->buckets[i] - 1);
+        if (this->styles[current] == style) {
+            id = current;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool StyleTable::intern(CharacterStyle const & style, StyleId & id)
+{
+    if (this->find(style, id)) {
+        return true;
+    }
+
+    if (this->styles.size() == max_size) {
+        return false;
+    }
+
+    id = StyleId(this->styles.size());
+    this->styles.emplace_back(style);
+
+    if (this->styles.size() * 2 > this->buckets.size()) {
+        this->buckets.assign(this->buckets.size() * 2, 0);
+        for (std::size_t i = 0; i < this->styles.size(); ++i) {
+            this->insertIndex(StyleId(i));
         }
     }
     else {
-        this->chars[this->len] = uc;
-        this->len++;
+        this->insertIndex(id);
     }
+
+    return true;
 }
 
+inline void StyleTable::insertIndex(StyleId id)
+{
+    std::size_t const mask = this->buckets.size() - 1;
+    std::size_t i = hash(this->styles[id]) & mask;
+    while (this->buckets[i]) {
+        i = (i + 1) & mask;
+    }
+    this->buckets[i] = uint16_t(id + 1);
+}
 
-inline void ExtendedCharTable::growChar(Character & character, ucs4_char uc)
+inline void StyleTable::compact(array_view<const bool> used, array_view<StyleId> remap)
 {
-    if (character.is_extended()) {
-        this->extendedCharTable[character.character].append(uc);
+    assert(used.size() == this->styles.size());
+    assert(remap.size() == this->styles.size());
+
+    // the default style keeps its id
+    std::size_t n = 1;
+    remap[0] = DefaultStyle;
+    for (std::size_t i = 1; i < this->styles.size(); ++i) {
+        if (used[i]) {
+            remap[i] = StyleId(n);
+            this->styles[n] = this->styles[i];
+            ++n;
+        }
     }
-    else {
-        uint16_t capacity = 4;
-        this->extendedCharTable.emplace_back(ExtendedCharacter{
-            2, capacity, std::unique_ptr<ucs4_char[]>{new ucs4_char[capacity]{character.character, uc}}
-        });
-        character.character = checked_int(this->extendedCharTable.size() - 1);
-        character.rendition |= Rendition::ExtendedChar;
+    this->styles.resize(n);
+
+    std::fill(this->buckets.begin(), this->buckets.end(), uint16_t(0));
+    for (std::size_t i = 0; i < n; ++i) {
+        this->insertIndex(StyleId(i));
+    }
+}
+
+inline void StyleTable::shrinkToFit()
+{
+    this->styles.shrink_to_fit();
+
+    std::size_t nbuckets = 16;
+    while (this->styles.size() * 2 > nbuckets) {
+        nbuckets *= 2;
+    }
+    std::vector<uint16_t>(nbuckets, 0).swap(this->buckets);
+    for (std::size_t i = 0; i < this->styles.size(); ++i) {
+        this->insertIndex(StyleId(i));
+    }
+}
+
+inline void StyleTable::clear()
+{
+    this->styles.assign(1, CharacterStyle());
+    this->buckets.assign(16, 0);
+    this->insertIndex(DefaultStyle);
+}
+
+
+inline ucs4_char ExtendedCharTable::newSequence(ucs4_carray_view chars, uint16_t capacity)
+{
+    assert(chars.size() <= capacity);
+    auto const offset = checked_int(this->arena.size());
+    this->arena.insert(this->arena.end(), chars.begin(), chars.end());
+    this->arena.resize(this->arena.size() + (capacity - chars.size()));
+    this->sequences.push_back(Sequence{offset, uint16_t(chars.size()), capacity});
+    return checked_int(this->sequences.size() - 1);
+}
+
+inline ucs4_char ExtendedCharTable::growChar(ucs4_char character, bool is_extended, ucs4_char uc)
+{
+    if (!is_extended) {
+        ucs4_char const chars[] {character, uc};
+        return this->newSequence(make_array_view(chars), 4);
+    }
+
+    Sequence & seq = this->sequences[character];
+    if (seq.len == max_sequence_size) {
+        return character;
     }
+
+    if (seq.len == seq.capacity) {
+        // the last sequence of the arena grows in place
+        if (seq.offset + seq.capacity == this->arena.size()) {
+            this->arena.resize(this->arena.size() + seq.capacity);
+        }
+        else {
+            auto const offset = checked_int(this->arena.size());
+            this->arena.resize(this->arena.size() + seq.capacity * 2u);
+            std::copy_n(this->arena.begin() + seq.offset, seq.len, this->arena.begin() + offset);
+            seq.offset = offset;
+        }
+        seq.capacity = uint16_t(std::min(seq.capacity * 2u, unsigned(max_sequence_size)));
+    }
+
+    this->arena[seq.offset + seq.len] = uc;
+    ++seq.len;
+    return character;
+}
+
+inline ucs4_char ExtendedCharTable::compactInto(ExtendedCharTable & other, ucs4_char i) const
+{
+    auto const chars = (*this)[i];
+    return other.newSequence(chars, uint16_t(chars.size()));
+}
+
+inline void ExtendedCharTable::growChar(Character & character, ucs4_char uc)
+{
+    character.character = this->growChar(character.character, character.is_extended(), uc);
+    character.rendition |= Rendition::ExtendedChar;
+}
+
+inline void ExtendedCharTable::growChar(Cell & cell, ucs4_char uc)
+{
+    cell.character = this->growChar(cell.character, cell.isExtended, uc);
+    cell.isExtended = true;
 }
 
 inline void ExtendedCharTable::clear()
 {
-    this->extendedCharTable.clear();
+    this->arena.clear();
+    this->sequences.clear();
 }
 
 }
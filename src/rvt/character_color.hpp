@@ -223,6 +223,56 @@ public:
      */
     Color color(ColorTableView palette) const;
 
+    /** Returns the color space, without the dim flag. */
+    ColorSpace colorSpace() const noexcept
+    {
+        return _colorSpaceWithDim.colorSpace();
+    }
+
+    /**
+     * Returns the color value such as CharacterColor(colorSpace(), value()) is this
+     * color without the dim flag (and the intensive flag of the default colors):
+     * 0..1 for Default, 0..15 for System (8..15 when intensive), 0..255 for Index256
+     * and 0xRRGGBB for RGB.
+     */
+    int32_t value() const noexcept
+    {
+        switch (_colorSpaceWithDim.colorSpace()) {
+        case ColorSpace::System:
+            return _u | (_v << 3);
+        case ColorSpace::RGB:
+            return (_u << 16) | (_v << 8) | _w;
+        case ColorSpace::Default:
+        case ColorSpace::Index256:
+        case ColorSpace::Undefined:
+            break;
+        }
+        return _u;
+    }
+
+    /**
+     * Returns the color space and the color value packed in an integer.
+     * Two colors are equal when their packed values are equal.
+     */
+    uint32_t packed() const noexcept
+    {
+        return uint32_t(_colorSpaceWithDim.value()) << 24
+             | uint32_t(_u) << 16
+             | uint32_t(_v) << 8
+             | uint32_t(_w);
+    }
+
+    /** Returns the color packed by packed(). */
+    static CharacterColor fromPacked(uint32_t packed) noexcept
+    {
+        CharacterColor color;
+        color._colorSpaceWithDim = ColorSpaceWithDim(static_cast<ColorSpace>(packed >> 24));
+        color._u = uint8_t(packed >> 16);
+        color._v = uint8_t(packed >> 8);
+        color._w = uint8_t(packed);
+        return color;
+    }
+
     /**
      * Compares two colors and returns true if they represent the same color value and
      * use the same color space.
@@ -265,6 +315,11 @@ private:
         {
             return bool(_intColorSpace & _colorSpaceDimFlag);
         }
+
+        IntColorSpace value() const noexcept
+        {
+            return _intColorSpace;
+        }
     };
     ColorSpaceWithDim _colorSpaceWithDim;
 
@@ -0,0 +1,229 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // memcpy
+
+
+namespace rvt
+{
+
+/**
+ * Fast LZ77 codec in the block format of LZ4: a sequence is a token (4 bits
+ * of literal length, 4 bits of match length minus 4), the literals, a 16 bits
+ * offset and the length extensions (bytes of 255 followed by the remainder).
+ * The last sequence only has literals.
+ *
+ * The compressor looks for matches with a single hash table of 4 bytes
+ * sequences, it favors speed over ratio.
+ */
+namespace lz
+{
+    namespace detail
+    {
+        constexpr std::size_t min_match = 4;
+        // the last 5 bytes are always literals and a match starts 12 bytes before the end
+        constexpr std::size_t last_literals = 5;
+        constexpr std::size_t match_start_limit = 12;
+        constexpr std::size_t max_offset = 0xffff;
+        constexpr unsigned hash_bits = 12;
+
+        inline uint32_t read32(uint8_t const * p) noexcept
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t hash(uint32_t sequence) noexcept
+        {
+            return (sequence * 2654435761u) >> (32 - hash_bits);
+        }
+
+        inline void push_length(std::vector<uint8_t> & out, std::size_t len)
+        {
+            for (; len >= 255; len -= 255) {
+                out.push_back(255);
+            }
+            out.push_back(uint8_t(len));
+        }
+
+        inline void push_sequence(
+            std::vector<uint8_t> & out,
+            uint8_t const * literals, std::size_t literal_len,
+            std::size_t offset, std::size_t match_len)
+        {
+            uint8_t const token_literal = uint8_t(literal_len < 15 ? literal_len : 15);
+            out.push_back(uint8_t(token_literal << 4 | (match_len < 15 ? match_len : 15)));
+            if (literal_len >= 15) {
+                push_length(out, literal_len - 15);
+            }
+            out.insert(out.end(), literals, literals + literal_len);
+            if (offset) {
+                out.push_back(uint8_t(offset));
+                out.push_back(uint8_t(offset >> 8));
+                if (match_len >= 15) {
+                    push_length(out, match_len - 15);
+                }
+            }
+        }
+    }
+
+    /// Upper bound of the compressed size of \c len bytes.
+    constexpr std::size_t compress_bound(std::size_t len) noexcept
+    {
+        return len + len / 255 + 16;
+    }
+
+    /// Appends the compressed bytes of [\c src, \c src + \c len) to \c out.
+    inline void compress(uint8_t const * src, std::size_t len, std::vector<uint8_t> & out)
+    {
+        using namespace detail;
+
+        out.reserve(out.size() + compress_bound(len));
+
+        std::size_t anchor = 0;
+
+        if (len >= match_start_limit + 1) {
+            uint32_t table[1u << hash_bits] {};
+            std::size_t const start_limit = len - match_start_limit;
+            std::size_t const match_limit = len - last_literals;
+
+            std::size_t ip = 1;
+            while (ip < start_limit) {
+                uint32_t const sequence = read32(src + ip);
+                uint32_t & bucket = table[hash(sequence)];
+                std::size_t const ref = bucket;
+                bucket = uint32_t(ip);
+
+                if (ip - ref > max_offset || read32(src + ref) != sequence) {
+                    ++ip;
+                    continue;
+                }
+
+                std::size_t n = min_match;
+                while (ip + n < match_limit && src[ref + n] == src[ip + n]) {
+                    ++n;
+                }
+
+                push_sequence(out, src + anchor, ip - anchor, ip - ref, n - min_match);
+                ip += n;
+                anchor = ip;
+            }
+        }
+
+        push_sequence(out, src + anchor, len - anchor, 0, 0);
+    }
+
+    /**
+     * Appends the \c decompressed_size bytes encoded in [\c src, \c src + \c len) to \c out.
+     * \return false when the data are malformed, \c out is then left unchanged.
+     */
+    inline bool decompress(
+        uint8_t const * src, std::size_t len, std::size_t decompressed_size,
+        std::vector<uint8_t> & out)
+    {
+        using namespace detail;
+
+        std::size_t const out_start = out.size();
+        out.resize(out_start + decompressed_size);
+        uint8_t * const dst = out.data() + out_start;
+
+        uint8_t const * const end = src + len;
+        std::size_t op = 0;
+
+        auto read_length = [&](std::size_t & n) {
+            uint8_t b;
+            do {
+                if (src == end) {
+                    return false;
+                }
+                b = *src++;
+                n += b;
+            } while (b == 255);
+            return true;
+        };
+
+        auto fail = [&]{
+            out.resize(out_start);
+            return false;
+        };
+
+        for (;;) {
+            if (src == end) {
+                return fail();
+            }
+
+            unsigned const token = *src++;
+
+            std::size_t literal_len = token >> 4;
+            if (literal_len == 15 && !read_length(literal_len)) {
+                return fail();
+            }
+            if (std::size_t(end - src) < literal_len || decompressed_size - op < literal_len) {
+                return fail();
+            }
+            memcpy(dst + op, src, literal_len);
+            src += literal_len;
+            op += literal_len;
+
+            if (src == end) {
+                break;
+            }
+
+            if (end - src < 2) {
+                return fail();
+            }
+            std::size_t const offset = std::size_t(src[0]) | std::size_t(src[1]) << 8;
+            src += 2;
+
+            std::size_t match_len = token & 15u;
+            if (match_len == 15 && !read_length(match_len)) {
+                return fail();
+            }
+            match_len += min_match;
+
+            if (offset == 0 || offset > op || decompressed_size - op < match_len) {
+                return fail();
+            }
+
+            // the source and the destination may overlap
+            uint8_t const * ref = dst + op - offset;
+            for (uint8_t * p = dst + op, * e = p + match_len; p != e; ++p, ++ref) {
+                *p = *ref;
+            }
+            op += match_len;
+        }
+
+        if (op != decompressed_size) {
+            return fail();
+        }
+
+        return true;
+    }
+}
+
+}
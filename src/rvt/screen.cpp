@@ -21,9 +21,17 @@
 */
 
 #include "rvt/screen.hpp"
+#include "rvt/scrollback.hpp"
+#include "rvt/char_width.hpp"
+
+#include "cxx/cxx.hpp"
 
 #include <algorithm>
+#include <numeric>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <memory>
 
 
 namespace rvt
@@ -40,7 +48,7 @@ const bool BS_CLEARS = false;
 //offset from the beginning of the block.  For efficiency reasons this
 //is no longer the case.
 //Many internal parts of this class still use this representation for parameters and so on,
-//notably moveImage() and clearImage().
+//notably clearImage().
 //This macro converts from an X,Y position into an image offset.
 
 const Character Screen::DefaultChar = Character(
@@ -56,7 +64,11 @@ const Character Screen::DefaultChar = Character(
 Screen::Screen(strictly_positif lines, strictly_positif columns):
     _lines(lines),
     _columns(columns),
-    _screenLines(_lines + 1),
+    _rows(std::make_shared<RowPool>(std::size_t(_lines), std::size_t(_columns))),
+    _lineLength(_lines, 0),
+    _lineProperties(_lines, LineProperty::Default),
+    _rowIndex(_lines),
+    _firstRow(0),
     _cuX(0),
     _cuY(0),
     _currentRendition(Rendition::Default),
@@ -65,9 +77,15 @@ Screen::Screen(strictly_positif lines, strictly_positif columns):
     _effectiveForeground{},
     _effectiveBackground{},
     _effectiveRendition(Rendition::Default),
-    _lineSaver{}
+    _effectiveStyle(StyleTable::DefaultStyle),
+    _styleTable(std::make_shared<StyleTable>()),
+    _extendedCharTable(std::make_shared<ExtendedCharTable>()),
+    _extendedCharTableLimit(std::size_t(_lines) * std::size_t(_columns)),
+    _lineSaver{},
+    _unsavedRows(std::size_t(_lines), true),
+    _dirtyLines(std::size_t(_lines), true)
 {
-    _lineProperties.resize(_lines + 1, LineProperty::Default);
+    std::iota(_rowIndex.begin(), _rowIndex.end(), 0);
 
     initTabStops();
     reset();
@@ -75,37 +93,247 @@ Screen::Screen(strictly_positif lines, strictly_positif columns):
 
 Screen::~Screen() = default;
 
-array_view<const LineProperty> Screen::getLineProperties() const
+Screen::ScreenLineProperties Screen::getLineProperties() const
+{
+    return ScreenLineProperties(*this);
+}
+
+LineProperty Screen::getLineProperty(int y) const
+{
+    return _lineProperties[physicalRow(y)];
+}
+
+Screen::ScreenLines Screen::getScreenLines() const
+{
+    return ScreenLines(*this);
+}
+
+Screen::ImageLine Screen::getScreenLine(int y) const
+{
+    return ImageLine(line(y), std::size_t(lineLength(y)), *_styleTable);
+}
+
+void Screen::resizeLine(int y, int length)
+{
+    assert(0 <= length && length <= _columns);
+    int const len = lineLength(y);
+    if (len < length) {
+        writableLine(y).fill(std::size_t(len), std::size_t(length), Cell());
+    }
+    else {
+        markLineDirty(y);
+    }
+    _lineLength[physicalRow(y)] = length;
+}
+
+CellSpan Screen::writableLine(int y)
 {
-    return _lineProperties;
+    markLineDirty(y);
+    return writableRow(y);
 }
 
-array_view<const Screen::ImageLine> Screen::getScreenLines() const
+CellSpan Screen::writableRow(int y)
 {
-    return {_screenLines.data(), std::size_t(_lines)};
+    assert(0 <= y && y < _lines);
+    int const i = _firstRow + y;
+    int & row = _rowIndex[i < _lines ? i : i - _lines];
+    if (REDEMPTION_UNLIKELY(_rows->isShared(std::size_t(row)))) {
+        copyRow(row);
+    }
+    return _rows->row(std::size_t(row));
+}
+
+void Screen::copyRow(int & row)
+{
+    if (_freeRows.empty()) {
+        // the rows of released snapshots become free
+        auto const retired_end = std::partition(
+            _retiredRows.begin(), _retiredRows.end(),
+            [this](int r) { return _rows->isShared(std::size_t(r)); });
+        _freeRows.assign(retired_end, _retiredRows.end());
+        _retiredRows.erase(retired_end, _retiredRows.end());
+    }
+
+    if (_freeRows.empty()) {
+        std::size_t const size = _rows->size();
+        _rows->grow();
+        _lineLength.resize(_rows->size(), 0);
+        _lineProperties.resize(_rows->size(), LineProperty::Default);
+        _unsavedRows.resize(_rows->size(), true);
+        for (std::size_t r = _rows->size(); r > size; --r) {
+            _freeRows.push_back(int(r - 1));
+        }
+    }
+
+    int const newRow = _freeRows.back();
+    _freeRows.pop_back();
+
+    _rows->row(std::size_t(newRow)).copy(_rows->row(std::size_t(row)), std::size_t(_lineLength[row]));
+    _lineLength[newRow] = _lineLength[row];
+    _lineProperties[newRow] = _lineProperties[row];
+    _unsavedRows[std::size_t(newRow)] = _unsavedRows[std::size_t(row)];
+
+    _retiredRows.push_back(row);
+    row = newRow;
 }
 
 ExtendedCharTable const & Screen::extendedCharTable() const
 {
-    return _extendedCharTable;
+    return *_extendedCharTable;
+}
+
+StyleTable const & Screen::styleTable() const
+{
+    return *_styleTable;
+}
+
+StyleTable & Screen::writableStyleTable()
+{
+    if (REDEMPTION_UNLIKELY(_styleTable.use_count() > 1)) {
+        _styleTable = std::make_shared<StyleTable>(*_styleTable);
+    }
+    return *_styleTable;
+}
+
+ExtendedCharTable & Screen::writableExtendedCharTable()
+{
+    if (REDEMPTION_UNLIKELY(_extendedCharTable.use_count() > 1)) {
+        _extendedCharTable = std::make_shared<ExtendedCharTable>(*_extendedCharTable);
+    }
+    return *_extendedCharTable;
+}
+
+ScreenSnapshot Screen::snapshot() const
+{
+    ScreenSnapshot snapshot;
+    snapshot._rows.reserve(std::size_t(_lines));
+    for (int y = 0; y < _lines; ++y) {
+        std::size_t const row = std::size_t(physicalRow(y));
+        std::atomic<uint32_t> & references = _rows->references(row);
+        references.fetch_add(1, std::memory_order_relaxed);
+        snapshot._rows.push_back(ScreenSnapshot::Row{
+            _rows->row(row), &references, std::size_t(_lineLength[row]), _lineProperties[row]
+        });
+    }
+    snapshot._pool = _rows;
+    snapshot._styleTable = _styleTable;
+    snapshot._extendedCharTable = _extendedCharTable;
+    snapshot._columns = _columns;
+    snapshot._cuX = getCursorX();
+    snapshot._cuY = getCursorY();
+    snapshot._cursorVisible = hasCursorVisible();
+    return snapshot;
+}
+
+ScreenSnapshot & ScreenSnapshot::operator=(ScreenSnapshot && other) noexcept
+{
+    if (this != &other) {
+        release();
+        _rows = std::move(other._rows);
+        other._rows.clear();
+        _pool = std::move(other._pool);
+        _styleTable = std::move(other._styleTable);
+        _extendedCharTable = std::move(other._extendedCharTable);
+        _columns = other._columns;
+        _cuX = other._cuX;
+        _cuY = other._cuY;
+        _cursorVisible = other._cursorVisible;
+    }
+    return *this;
+}
+
+ScreenSnapshot::~ScreenSnapshot()
+{
+    release();
+}
+
+void ScreenSnapshot::release() noexcept
+{
+    // the screen reuses a row once its counter is 0, the cells must no longer be read
+    for (Row const & row : _rows) {
+        row.references->fetch_sub(1, std::memory_order_release);
+    }
+    _rows.clear();
 }
 
 void Screen::setLineSaver(LineSaver lineSaver)
 {
-    this->_lineSaver = std::move(lineSaver);
+    saveDeferredLines();
+    this->_lineSaver = lineSaver;
 }
 
-void Screen::saveLine() const
+void Screen::saveDeferredLines()
 {
-    if (this->_lineSaver) {
-        this->_lineSaver(*this, size_t(_cuY), size_t(_cuY+1u));
+    if (_deferredLines) {
+        int const n = _deferredLines;
+        _deferredLines = 0;
+        commitLines(_bottomMargin - n, _bottomMargin - 1);
     }
 }
 
-void Screen::saveLines(int topLine, int bottomLine) const
+void Screen::saveLine()
 {
-    if (this->_lineSaver) {
-        this->_lineSaver(*this, size_t(topLine), size_t(bottomLine+1));
+    saveLines(_cuY, _cuY);
+}
+
+void Screen::saveLines(int topLine, int bottomLine)
+{
+    saveDeferredLines();
+    commitLines(topLine, bottomLine);
+}
+
+void Screen::commitLines(int topLine, int bottomLine)
+{
+    if (!this->_lineSaver) {
+        return;
+    }
+
+    bottomLine = std::min(bottomLine, _lines - 1);
+    int y = topLine;
+    while (y <= bottomLine) {
+        if (!_unsavedRows[std::size_t(physicalRow(y))]) {
+            ++y;
+            continue;
+        }
+        // coalesces the modified lines which follow
+        int const first = y;
+        do {
+            _unsavedRows[std::size_t(physicalRow(y))] = false;
+        } while (++y <= bottomLine && _unsavedRows[std::size_t(physicalRow(y))]);
+        this->_lineSaver(*this, size_t(first), size_t(y));
+    }
+}
+
+void Screen::setScrollbackSize(std::size_t maxLines)
+{
+    if (!maxLines) {
+        _scrollback.reset();
+    }
+    else if (_scrollback) {
+        _scrollback->setMaxLines(maxLines);
+    }
+    else {
+        _scrollback = std::make_unique<Scrollback>(maxLines);
+    }
+}
+
+std::size_t Screen::getScrollbackSize() const noexcept
+{
+    return _scrollback ? _scrollback->maxLines() : 0;
+}
+
+void Screen::setScrollbackFile(char const * filename, int mode)
+{
+    assert(_scrollback);
+    _scrollback->setFile(filename, mode);
+}
+
+void Screen::pushToScrollback(int topLine, int bottomLine)
+{
+    if (_scrollback) {
+        for (int y = topLine; y <= bottomLine; ++y) {
+            _scrollback->push(getScreenLine(y), getLineProperty(y), *_extendedCharTable);
+        }
     }
 }
 
@@ -155,6 +383,7 @@ void Screen::setMargins(int top, int bot)
         //Debug()<<" setRegion("<<top<<","<<bot<<") : bad range.";
         return;                   // Default error action: ignore
     }
+    saveDeferredLines();
     _topMargin = top;
     _bottomMargin = bot;
     _cuX = 0;
@@ -174,8 +403,19 @@ int Screen::bottomMargin() const
 void Screen::index()
 //=IND
 {
-    if (_cuY == _bottomMargin)
-        scrollUp(1);
+    if (_cuY == _bottomMargin) {
+        if (_lineSaver && _topMargin < _bottomMargin) {
+            // the cursor line is committed with the next ones
+            if (_deferredLines == _bottomMargin - _topMargin) {
+                saveDeferredLines();
+            }
+            ++_deferredLines;
+            scrollRegionUp(_topMargin, 1);
+        }
+        else {
+            scrollUp(1);
+        }
+    }
     else if (_cuY < _lines - 1) {
         saveLine();
         _cuY += 1;
@@ -215,39 +455,46 @@ void Screen::deleteChars(int n)
     if (n == 0)
         n = 1;
 
+    const int len = lineLength(_cuY);
+
     // if cursor is beyond the end of the line there is nothing to do
-    if (_cuX >= int(_screenLines[_cuY].size()))
+    if (_cuX >= len)
         return;
 
-    if (_cuX + n > int(_screenLines[_cuY].size()))
-        n = int(_screenLines[_cuY].size() - _cuX);
+    if (_cuX + n > len)
+        n = len - _cuX;
 
     assert(n >= 0);
-    assert(_cuX + n <= int(_screenLines[_cuY].size()));
+    assert(_cuX + n <= len);
 
-    auto pos = _screenLines[_cuY].begin() + _cuX;
-    _screenLines[_cuY].erase(pos, pos + n);
+    CellSpan const cells = writableLine(_cuY);
+    cells.move(std::size_t(_cuX + n), std::size_t(len), std::size_t(_cuX));
 
     // Append space(s) with current attributes
-    Character spaceWithCurrentAttrs(' ', _effectiveForeground,
-                                    _effectiveBackground,
-                                    _effectiveRendition, false);
+    Cell const spaceWithCurrentAttrs{' ', _effectiveStyle, false, false};
 
-    for (int i = 0; i < n; i++)
-        _screenLines[_cuY].emplace_back(spaceWithCurrentAttrs);
+    cells.fill(std::size_t(len - n), std::size_t(len), spaceWithCurrentAttrs);
 }
 
 void Screen::insertChars(int n)
 {
     if (n == 0) n = 1; // Default
 
-    if (int(_screenLines[_cuY].size()) < _cuX)
-        _screenLines[_cuY].resize(_cuX);
+    if (lineLength(_cuY) < _cuX)
+        resizeLine(_cuY, _cuX);
 
-    _screenLines[_cuY].insert(_screenLines[_cuY].begin() + _cuX, n, Character(' '));
+    if (_cuX >= _columns)
+        return;
+
+    // characters pushed beyond the last column are lost
+    n = std::min(n, _columns - _cuX);
+    const int len = lineLength(_cuY);
+    const int newLen = std::min(_columns, len + n);
 
-    if (int(_screenLines[_cuY].size()) > _columns)
-        _screenLines[_cuY].resize(_columns);
+    CellSpan const cells = writableLine(_cuY);
+    cells.move(std::size_t(_cuX), std::size_t(newLen - n), std::size_t(_cuX + n));
+    cells.fill(std::size_t(_cuX), std::size_t(_cuX + n), Cell());
+    _lineLength[physicalRow(_cuY)] = newLen;
 }
 
 void Screen::deleteLines(int n)
@@ -328,22 +575,25 @@ void Screen::resizeImage(strictly_positif new_lines, strictly_positif new_column
 {
     if ((new_lines == _lines) && (new_columns == _columns)) return;
 
-    if (_cuY > new_lines - 1) {
-        // attempt to preserve focus and _lines
-        _bottomMargin = _lines - 1; //FIXME: margin lost
-        for (int i = 0; i < _cuY - (new_lines - 1); i++) {
-            scrollUp(0, 1);
-        }
-    }
+    saveDeferredLines();
 
-    // create new screen _lines and copy from old to new
-    _screenLines.resize(new_lines + 1);
-    for (auto & line : _screenLines) {
-        if (line.size() > std::size_t(new_columns)) {
-            line.resize(new_columns); // TODO + max konsole_wcwidth - 1
+    if (_reflowLines) {
+        reflowRows(new_lines, new_columns);
+    }
+    else {
+        if (_cuY > new_lines - 1) {
+            // attempt to preserve focus and _lines
+            _bottomMargin = _lines - 1; //FIXME: margin lost
+            for (int i = 0; i < _cuY - (new_lines - 1); i++) {
+                scrollUp(0, 1);
+            }
         }
+
+        reallocateRows(new_lines, new_columns);
     }
-    _lineProperties.resize(new_lines + 1, LineProperty::Default);
+
+    _dirtyLines.assign(std::size_t(new_lines.get()), true);
+    _damage |= Damage::Lines | Damage::Size;
 
     _lines = new_lines;
     _columns = new_columns;
@@ -357,8 +607,261 @@ void Screen::resizeImage(strictly_positif new_lines, strictly_positif new_column
     initTabStops();
 }
 
+void Screen::reallocateRows(int new_lines, int new_columns)
+{
+    // create new screen _lines and copy from old to new.
+    // the snapshots keep the previous rows alive
+    auto rows = std::make_shared<RowPool>(std::size_t(new_lines), std::size_t(new_columns));
+    std::vector<int> lineLength(new_lines, 0);
+    std::vector<LineProperty> lineProperties(new_lines, LineProperty::Default);
+    std::vector<bool> unsavedRows(std::size_t(new_lines), true);
+    for (int y = 0; y < std::min(_lines, new_lines); ++y) {
+        // TODO + max char_width - 1
+        const int len = std::min(this->lineLength(y), new_columns);
+        rows->row(std::size_t(y)).copy(line(y), std::size_t(len));
+        lineLength[y] = len;
+        lineProperties[y] = getLineProperty(y);
+        unsavedRows[std::size_t(y)] = _unsavedRows[std::size_t(physicalRow(y))];
+    }
+    _rows = std::move(rows);
+    _lineLength = std::move(lineLength);
+    _lineProperties = std::move(lineProperties);
+    _unsavedRows = std::move(unsavedRows);
+    _rowIndex.resize(new_lines);
+    std::iota(_rowIndex.begin(), _rowIndex.end(), 0);
+    _firstRow = 0;
+    _freeRows = std::vector<int>();
+    _retiredRows = std::vector<int>();
+}
+
+void Screen::reflowRows(int new_lines, int new_columns)
+{
+    // Calls piece(y, x, n, col) for each run of n cells of the line y copied
+    // at col in the current new row and endRow(wrapped, y0) at the end of each
+    // new row, y0 is the first line of the logical line.
+    // Each line also starts with an empty piece which locates its beginning.
+    auto split = [this, new_columns](auto && piece, auto && endRow) {
+        for (int y = 0; y < _lines; ++y) {
+            int const y0 = y;
+            int col = 0;
+            for (;;) {
+                int const len = lineLength(y);
+                CellSpan const cells = line(y);
+                // first half of a wide character, the other cells which are not real
+                // (erased with a background color) can be split
+                auto is_wide = [&](int x) {
+                    if (!bool(cells.flags[x] & CellFlags::Real)) {
+                        return false;
+                    }
+                    ucs4_char c = cells.codePoints[x];
+                    if (bool(cells.flags[x] & CellFlags::Extended)) {
+                        c = (*_extendedCharTable)[c][0];
+                    }
+                    return char_width(c) == 2;
+                };
+                piece(y, 0, 0, col);
+                int x = 0;
+                while (x < len) {
+                    if (col == new_columns) {
+                        endRow(true, y0);
+                        col = 0;
+                    }
+                    int n = std::min(len - x, new_columns - col);
+                    // a wide character is not split, unless it is wider than a row
+                    if (x + n < len && is_wide(x + n - 1)) {
+                        int const s = x + n - 1;
+                        if (s > x || col > 0) {
+                            n = s - x;
+                        }
+                    }
+                    if (n == 0) {
+                        endRow(true, y0);
+                        col = 0;
+                        continue;
+                    }
+                    piece(y, x, n, col);
+                    x += n;
+                    col += n;
+                }
+                if (!bool(getLineProperty(y) & LineProperty::Wrapped) || y + 1 == _lines) {
+                    break;
+                }
+                ++y;
+            }
+            endRow(false, y0);
+        }
+    };
+
+    // count the new rows and locate the cursor
+    int nrows = 0;
+    int lastNonEmptyRow = -1;
+    int cursorRow = 0;
+    int cursorCol = 0;
+    bool cursorFound = false;
+    split(
+        [&](int y, int x, int n, int col) {
+            if (n) {
+                lastNonEmptyRow = nrows;
+            }
+            if (y == _cuY && !cursorFound) {
+                // beyond the cells of the line, the distance to its end is kept
+                cursorRow = nrows;
+                cursorCol = col + (_cuX - x);
+                cursorFound = (_cuX < x + n);
+            }
+        },
+        [&](bool /*wrapped*/, int /*y0*/) { ++nrows; }
+    );
+
+    // the rows [firstRow, lastRow) are kept: blank rows below the cursor are
+    // dropped before the top rows, the cursor remains on the screen
+    int lastRow = std::min(nrows, std::max(std::max(cursorRow, lastNonEmptyRow) + 1, new_lines));
+    lastRow = std::min(lastRow, cursorRow + new_lines);
+    int const firstRow = std::max(0, lastRow - new_lines);
+
+    auto rows = std::make_shared<RowPool>(std::size_t(new_lines), std::size_t(new_columns));
+    std::vector<int> lineLength(new_lines, 0);
+    std::vector<LineProperty> lineProperties(new_lines, LineProperty::Default);
+    // the rows dropped at the top go to the history
+    bool const saveDroppedRows = _scrollback && firstRow > 0;
+    CellArray droppedRow(saveDroppedRows ? std::size_t(new_columns) : 0);
+    int droppedRowLength = 0;
+
+    int r = 0;
+    split(
+        [&](int y, int x, int n, int col) {
+            if (!n || r >= lastRow || (r < firstRow && !saveDroppedRows)) {
+                return;
+            }
+            CellSpan const src = line(y);
+            CellSpan const dst = r < firstRow ? droppedRow.span(0) : rows->row(std::size_t(r - firstRow));
+            CellSpan{dst.codePoints + col, dst.styles + col, dst.flags + col}.copy(
+                CellSpan{src.codePoints + x, src.styles + x, src.flags + x}, std::size_t(n));
+            (r < firstRow ? droppedRowLength : lineLength[r - firstRow]) = col + n;
+        },
+        [&](bool wrapped, int y0) {
+            LineProperty property = getLineProperty(y0) & ~LineProperty::Wrapped;
+            if (wrapped) {
+                property |= LineProperty::Wrapped;
+            }
+            if (firstRow <= r && r < lastRow) {
+                lineProperties[r - firstRow] = property;
+            }
+            else if (r < firstRow && saveDroppedRows) {
+                _scrollback->push(
+                    ImageLine(droppedRow.codePoints(), droppedRow.styles(), droppedRow.flags(),
+                              std::size_t(droppedRowLength), *_styleTable),
+                    property, *_extendedCharTable);
+                droppedRowLength = 0;
+            }
+            ++r;
+        }
+    );
+
+    _rows = std::move(rows);
+    _lineLength = std::move(lineLength);
+    _lineProperties = std::move(lineProperties);
+    _unsavedRows.assign(std::size_t(new_lines), true);
+    _rowIndex.resize(new_lines);
+    std::iota(_rowIndex.begin(), _rowIndex.end(), 0);
+    _firstRow = 0;
+    _freeRows = std::vector<int>();
+    _retiredRows = std::vector<int>();
+
+    _cuY = cursorRow - firstRow;
+    _cuX = std::min(cursorCol, new_columns - 1);
+}
+
+void Screen::markLinesDirty(int top, int bottom) noexcept
+{
+    std::fill(_dirtyLines.begin() + top, _dirtyLines.begin() + bottom + 1, true);
+    _damage |= Damage::Lines;
+}
+
+Damage Screen::getDamage() const noexcept
+{
+    Damage damage = _damage;
+    if (_cuX != _damageCursorX || _cuY != _damageCursorY) {
+        damage |= Damage::Cursor;
+    }
+    if (_currentModes != _damageModes) {
+        damage |= Damage::Modes;
+    }
+    return damage;
+}
+
+void Screen::resetDamage() noexcept
+{
+    if (bool(_damage & Damage::Lines)) {
+        std::fill(_dirtyLines.begin(), _dirtyLines.end(), false);
+    }
+    _damage = Damage::None;
+    _damageCursorX = _cuX;
+    _damageCursorY = _cuY;
+    _damageModes = _currentModes;
+}
+
+Screen::MemoryUsage Screen::memoryUsage() const noexcept
+{
+    MemoryUsage usage;
+    usage.cells = _rows->memoryUsage();
+    usage.lineProperties
+      = _lineLength.capacity() * sizeof(int)
+      + _lineProperties.capacity() * sizeof(LineProperty)
+      + _rowIndex.capacity() * sizeof(int)
+      + (_freeRows.capacity() + _retiredRows.capacity()) * sizeof(int)
+      + (_unsavedRows.capacity() + CHAR_BIT - 1) / CHAR_BIT
+      + (_dirtyLines.capacity() + CHAR_BIT - 1) / CHAR_BIT;
+    usage.tabStops = (_tabStops.capacity() + CHAR_BIT - 1) / CHAR_BIT;
+    usage.styles = _styleTable->memoryUsage();
+    usage.extendedChars = _extendedCharTable->memoryUsage()
+                        + _spareExtendedCharTable.memoryUsage();
+    if (_scrollback) {
+        usage.scrollback = sizeof(Scrollback) + _scrollback->memoryUsage();
+    }
+    return usage;
+}
+
+void Screen::reduceMemoryUsage()
+{
+    // rows added by the copies on write, only once no snapshot uses the pool
+    if (_rows->size() > std::size_t(_lines) && _rows.use_count() == 1) {
+        reallocateRows(_lines, _columns);
+    }
+
+    if (_extendedCharTable->arenaSize()) {
+        compactExtendedChars();
+    }
+    _spareExtendedCharTable = ExtendedCharTable();
+    if (_extendedCharTable.use_count() == 1) {
+        _extendedCharTable->shrinkToFit();
+    }
+
+    if (_scrollback) {
+        _scrollback->shrinkToFit();
+    }
+}
+
+void Screen::trim()
+{
+    reduceMemoryUsage();
+
+    compactStyles();
+    _styleTable->shrinkToFit();
+
+    _lineLength.shrink_to_fit();
+    _lineProperties.shrink_to_fit();
+    _rowIndex.shrink_to_fit();
+    _freeRows.shrink_to_fit();
+    _retiredRows.shrink_to_fit();
+    _unsavedRows.shrink_to_fit();
+    _tabStops.shrink_to_fit();
+    _dirtyLines.shrink_to_fit();
+}
+
 void Screen::setDefaultMargins()
 {
+    saveDeferredLines();
     _topMargin = 0;
     _bottomMargin = _lines - 1;
 }
@@ -421,6 +924,89 @@ void Screen::updateEffectiveRendition()
         _effectiveForeground.setIntensive();
     if (bool(_currentRendition & Rendition::Dim))
         _effectiveForeground.setDim();
+
+    _effectiveStyle = internStyle({_effectiveRendition, _effectiveForeground, _effectiveBackground});
+}
+
+StyleId Screen::internStyle(CharacterStyle const & style)
+{
+    CharacterStyle const s{style.rendition & ~Rendition::ExtendedChar,
+                           style.foregroundColor, style.backgroundColor};
+    StyleId id;
+    if (_styleTable->find(s, id)) {
+        return id;
+    }
+    if (REDEMPTION_UNLIKELY(!writableStyleTable().intern(s, id))) {
+        compactStyles();
+        if (!_styleTable->intern(s, id)) {
+            id = StyleTable::DefaultStyle;
+        }
+    }
+    return id;
+}
+
+void Screen::compactStyles()
+{
+    std::size_t const size = _styleTable->size();
+    std::unique_ptr<bool[]> used(new bool[size]{});
+    for (int y = 0; y < _lines; ++y) {
+        StyleId const * const styles = line(y).styles;
+        std::for_each(styles, styles + lineLength(y), [&used](StyleId id) { used[id] = true; });
+    }
+    used[_effectiveStyle] = true;
+
+    std::unique_ptr<StyleId[]> remap(new StyleId[size]);
+    writableStyleTable().compact({used.get(), size}, {remap.get(), size});
+
+    for (int y = 0; y < _lines; ++y) {
+        StyleId * const styles = writableRow(y).styles;
+        std::for_each(styles, styles + lineLength(y), [&remap](StyleId & id) { id = remap[id]; });
+    }
+    _effectiveStyle = remap[_effectiveStyle];
+}
+
+void Screen::compactExtendedChars()
+{
+    ExtendedCharTable & table = _spareExtendedCharTable;
+    table.clear();
+    for (int y = 0; y < _lines; ++y) {
+        CellSpan cells = line(y);
+        bool writable = false;
+        for (int x = 0; x < lineLength(y); ++x) {
+            if (bool(cells.flags[x] & CellFlags::Extended)) {
+                if (!writable) {
+                    cells = writableRow(y);
+                    writable = true;
+                }
+                cells.codePoints[x] = _extendedCharTable->compactInto(table, cells.codePoints[x]);
+            }
+        }
+    }
+    // both tables keep their memory: once warmed up, compactions no longer allocate
+    // (unless a snapshot still uses the current table)
+    if (REDEMPTION_UNLIKELY(_extendedCharTable.use_count() > 1)) {
+        _extendedCharTable = std::make_shared<ExtendedCharTable>();
+    }
+    _extendedCharTable->swap(table);
+
+    // the next compaction happens after at least as many new code points
+    // as there are cells and live code points: its cost is amortized
+    _extendedCharTableLimit = _extendedCharTable->arenaSize() * 2
+                            + std::size_t(_lines) * std::size_t(_columns);
+}
+
+void Screen::reserveExtendedCharTables()
+{
+    // the arenas are sized for the next compaction, the margin absorbs the
+    // relocation of a sequence which crosses the limit. Half more is reserved
+    // so that a slightly higher limit does not reallocate at each compaction
+    std::size_t const capacity = _extendedCharTableLimit + 64;
+    if (_extendedCharTable->arenaCapacity() < capacity
+     || _spareExtendedCharTable.arenaCapacity() < capacity
+    ) {
+        writableExtendedCharTable().reserve(capacity + capacity / 2);
+        _spareExtendedCharTable.reserve(capacity + capacity / 2);
+    }
 }
 
 void Screen::reset(bool clearScreen)
@@ -438,6 +1024,7 @@ void Screen::reset(bool clearScreen)
     resetMode(Mode::Screen);                         // screen not inverse
     resetMode(Mode::NewLine);
 
+    saveDeferredLines();
     _topMargin = 0;
     _bottomMargin = _lines - 1;
 
@@ -459,12 +1046,13 @@ void Screen::backspace()
     _cuX = std::min(_columns - 1, _cuX); // nowrap!
     _cuX = std::max(0, _cuX - 1);
 
-    if (int(_screenLines[_cuY].size()) < _cuX + 1)
-        _screenLines[_cuY].resize(_cuX + 1);
+    if (lineLength(_cuY) < _cuX + 1)
+        resizeLine(_cuY, _cuX + 1);
 
     if (BS_CLEARS) {
-        _screenLines[_cuY][_cuX].character = ' ';
-        _screenLines[_cuY][_cuX].rendition &= ~Rendition::ExtendedChar;
+        CellSpan const cells = writableLine(_cuY);
+        cells.codePoints[_cuX] = ' ';
+        cells.flags[_cuX] &= ~CellFlags::Extended;
     }
 }
 
@@ -527,146 +1115,6 @@ void Screen::newLine()
 }
 
 
-struct interval {
-    unsigned long first;
-    unsigned long last;
-};
-
-/* auxiliary function for binary search in interval table */
-static bool bisearch(ucs4_char ucs, const interval * table, int max)
-{
-    int min = 0;
-    int mid;
-
-    if (ucs < table[0].first || ucs > table[max].last)
-        return false;
-    while (max >= min) {
-        mid = (min + max) / 2;
-        if (ucs > table[mid].last)
-            min = mid + 1;
-        else if (ucs < table[mid].first)
-            max = mid - 1;
-        else
-            return true;
-    }
-
-    return false;
-}
-
-
-/* The following functions define the column width of an ISO 10646
- * character as follows:
- *
- *    - The null character (U+0000) has a column width of 0.
- *
- *    - Other C0/C1 control characters and DEL will lead to a return
- *      value of -1.
- *
- *    - Non-spacing and enclosing combining characters (general
- *      category code Mn or Me in the Unicode database) have a
- *      column width of 0.
- *
- *    - Other format characters (general category code Cf in the Unicode
- *      database) and ZERO WIDTH SPACE (U+200B) have a column width of 0.
- *
- *    - Hangul Jamo medial vowels and final consonants (U+1160-U+11FF)
- *      have a column width of 0.
- *
- *    - Spacing characters in the East Asian Wide (W) or East Asian
- *      FullWidth (F) category as defined in Unicode Technical
- *      Report #11 have a column width of 2.
- *
- *    - All remaining characters (including all printable
- *      ISO 8859-1 and WGL4 characters, Unicode control characters,
- *      etc.) have a column width of 1.
- *
- * This implementation assumes that quint16 characters are encoded
- * in ISO 10646.
- */
-inline int konsole_wcwidth(ucs4_char ucs)
-{
-    /* sorted list of non-overlapping intervals of non-spacing characters */
-    /* generated by "uniset +cat=Me +cat=Mn +cat=Cf -00AD +1160-11FF +200B c" */
-    static const struct interval combining[] = {
-        { 0x0300, 0x036F }, { 0x0483, 0x0486 }, { 0x0488, 0x0489 },
-        { 0x0591, 0x05BD }, { 0x05BF, 0x05BF }, { 0x05C1, 0x05C2 },
-        { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0600, 0x0603 },
-        { 0x0610, 0x0615 }, { 0x064B, 0x065E }, { 0x0670, 0x0670 },
-        { 0x06D6, 0x06E4 }, { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED },
-        { 0x070F, 0x070F }, { 0x0711, 0x0711 }, { 0x0730, 0x074A },
-        { 0x07A6, 0x07B0 }, { 0x07EB, 0x07F3 }, { 0x0901, 0x0902 },
-        { 0x093C, 0x093C }, { 0x0941, 0x0948 }, { 0x094D, 0x094D },
-        { 0x0951, 0x0954 }, { 0x0962, 0x0963 }, { 0x0981, 0x0981 },
-        { 0x09BC, 0x09BC }, { 0x09C1, 0x09C4 }, { 0x09CD, 0x09CD },
-        { 0x09E2, 0x09E3 }, { 0x0A01, 0x0A02 }, { 0x0A3C, 0x0A3C },
-        { 0x0A41, 0x0A42 }, { 0x0A47, 0x0A48 }, { 0x0A4B, 0x0A4D },
-        { 0x0A70, 0x0A71 }, { 0x0A81, 0x0A82 }, { 0x0ABC, 0x0ABC },
-        { 0x0AC1, 0x0AC5 }, { 0x0AC7, 0x0AC8 }, { 0x0ACD, 0x0ACD },
-        { 0x0AE2, 0x0AE3 }, { 0x0B01, 0x0B01 }, { 0x0B3C, 0x0B3C },
-        { 0x0B3F, 0x0B3F }, { 0x0B41, 0x0B43 }, { 0x0B4D, 0x0B4D },
-        { 0x0B56, 0x0B56 }, { 0x0B82, 0x0B82 }, { 0x0BC0, 0x0BC0 },
-        { 0x0BCD, 0x0BCD }, { 0x0C3E, 0x0C40 }, { 0x0C46, 0x0C48 },
-        { 0x0C4A, 0x0C4D }, { 0x0C55, 0x0C56 }, { 0x0CBC, 0x0CBC },
-        { 0x0CBF, 0x0CBF }, { 0x0CC6, 0x0CC6 }, { 0x0CCC, 0x0CCD },
-        { 0x0CE2, 0x0CE3 }, { 0x0D41, 0x0D43 }, { 0x0D4D, 0x0D4D },
-        { 0x0DCA, 0x0DCA }, { 0x0DD2, 0x0DD4 }, { 0x0DD6, 0x0DD6 },
-        { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E },
-        { 0x0EB1, 0x0EB1 }, { 0x0EB4, 0x0EB9 }, { 0x0EBB, 0x0EBC },
-        { 0x0EC8, 0x0ECD }, { 0x0F18, 0x0F19 }, { 0x0F35, 0x0F35 },
-        { 0x0F37, 0x0F37 }, { 0x0F39, 0x0F39 }, { 0x0F71, 0x0F7E },
-        { 0x0F80, 0x0F84 }, { 0x0F86, 0x0F87 }, { 0x0F90, 0x0F97 },
-        { 0x0F99, 0x0FBC }, { 0x0FC6, 0x0FC6 }, { 0x102D, 0x1030 },
-        { 0x1032, 0x1032 }, { 0x1036, 0x1037 }, { 0x1039, 0x1039 },
-        { 0x1058, 0x1059 }, { 0x1160, 0x11FF }, { 0x135F, 0x135F },
-        { 0x1712, 0x1714 }, { 0x1732, 0x1734 }, { 0x1752, 0x1753 },
-        { 0x1772, 0x1773 }, { 0x17B4, 0x17B5 }, { 0x17B7, 0x17BD },
-        { 0x17C6, 0x17C6 }, { 0x17C9, 0x17D3 }, { 0x17DD, 0x17DD },
-        { 0x180B, 0x180D }, { 0x18A9, 0x18A9 }, { 0x1920, 0x1922 },
-        { 0x1927, 0x1928 }, { 0x1932, 0x1932 }, { 0x1939, 0x193B },
-        { 0x1A17, 0x1A18 }, { 0x1B00, 0x1B03 }, { 0x1B34, 0x1B34 },
-        { 0x1B36, 0x1B3A }, { 0x1B3C, 0x1B3C }, { 0x1B42, 0x1B42 },
-        { 0x1B6B, 0x1B73 }, { 0x1DC0, 0x1DCA }, { 0x1DFE, 0x1DFF },
-        { 0x200B, 0x200F }, { 0x202A, 0x202E }, { 0x2060, 0x2063 },
-        { 0x206A, 0x206F }, { 0x20D0, 0x20EF }, { 0x302A, 0x302F },
-        { 0x3099, 0x309A }, { 0xA806, 0xA806 }, { 0xA80B, 0xA80B },
-        { 0xA825, 0xA826 }, { 0xFB1E, 0xFB1E }, { 0xFE00, 0xFE0F },
-        { 0xFE20, 0xFE23 }, { 0xFEFF, 0xFEFF }, { 0xFFF9, 0xFFFB },
-        { 0x10A01, 0x10A03 }, { 0x10A05, 0x10A06 }, { 0x10A0C, 0x10A0F },
-        { 0x10A38, 0x10A3A }, { 0x10A3F, 0x10A3F }, { 0x1D167, 0x1D169 },
-        { 0x1D173, 0x1D182 }, { 0x1D185, 0x1D18B }, { 0x1D1AA, 0x1D1AD },
-        { 0x1D242, 0x1D244 }, { 0xE0001, 0xE0001 }, { 0xE0020, 0xE007F },
-        { 0xE0100, 0xE01EF }
-    };
-
-    /* test for 8-bit control characters */
-    if (ucs == 0)
-        return 0;
-    if (ucs < 32 || (ucs >= 0x7f && ucs < 0xa0))
-        return -1;
-
-    /* binary search in table of non-spacing characters */
-    if (bisearch(ucs, combining, sizeof(combining) / sizeof(struct interval) - 1))
-        return 0;
-
-    /* if we arrive here, ucs is not a combining or C0/C1 control character */
-
-    return 1 +
-           (ucs >= 0x1100 &&
-            (ucs <= 0x115f ||                    /* Hangul Jamo init. consonants */
-             ucs == 0x2329 || ucs == 0x232a ||
-             (ucs >= 0x2e80 && ucs <= 0xa4cf &&
-              ucs != 0x303f) ||                  /* CJK ... Yi */
-             (ucs >= 0xac00 && ucs <= 0xd7a3) || /* Hangul Syllables */
-             (ucs >= 0xf900 && ucs <= 0xfaff) || /* CJK Compatibility Ideographs */
-             (ucs >= 0xfe10 && ucs <= 0xfe19) || /* Vertical forms */
-             (ucs >= 0xfe30 && ucs <= 0xfe6f) || /* CJK Compatibility Forms */
-             (ucs >= 0xff00 && ucs <= 0xff60) || /* Fullwidth Forms */
-             (ucs >= 0xffe0 && ucs <= 0xffe6) ||
-             (ucs >= 0x20000 && ucs <= 0x2fffd) ||
-             (ucs >= 0x30000 && ucs <= 0x3fffd)));
-}
-
-
 void Screen::displayCharacter(ucs4_char c)
 {
     // Note that VT100 does wrapping BEFORE putting the character.
@@ -674,7 +1122,7 @@ void Screen::displayCharacter(ucs4_char c)
     // We indicate the fact that a newline has to be triggered by
     // putting the cursor one right to the last column of the screen.
 
-    int w = konsole_wcwidth(c);
+    int w = char_width(c);
     if (w < 0)
         return;
     else if (w == 0) {
@@ -686,7 +1134,7 @@ void Screen::displayCharacter(ucs4_char c)
         if (_cuX == 0) {
             // We are at the beginning of a line, check
             // if previous line has a character at the end we can combine with
-            if (_cuY > 0 && _columns == int(_screenLines[_cuY - 1].size())) {
+            if (_cuY > 0 && _columns == lineLength(_cuY - 1)) {
                 charToCombineWithX = _columns - 1;
                 charToCombineWithY = _cuY - 1;
             } else {
@@ -701,73 +1149,108 @@ void Screen::displayCharacter(ucs4_char c)
         }
 
         // Prevent "cat"ing binary files from causing crashes.
-        if (charToCombineWithX >= int(_screenLines[charToCombineWithY].size())) {
+        if (charToCombineWithX >= lineLength(charToCombineWithY)) {
             return;
         }
 
-        Character & currentChar = _screenLines[charToCombineWithY][charToCombineWithX];
-        _extendedCharTable.growChar(currentChar, c);
-        if (int(_extendedCharTable.size()) >= _lines * _columns) {
-            std::vector<ExtendedCharacter> new_table;
-            new_table.resize(_lines * _columns);
-            auto b = new_table.begin();
-            auto p = b;
-            for (auto & line : getMutableScreenLines()) {
-                for (Character & ch : line) {
-                    if (ch.is_extended()) {
-                        ch.character = p - b;
-                        *p = std::move(_extendedCharTable.extendedCharTable[ch.character]);
-                        ++p;
-                    }
-                }
-            }
-            new_table.resize(p - b);
-            _extendedCharTable.extendedCharTable = std::move(new_table);
+        CellSpan const cells = writableLine(charToCombineWithY);
+        std::size_t const currentIndex = std::size_t(charToCombineWithX);
+        Cell currentChar = cells.get(currentIndex);
+        if (REDEMPTION_UNLIKELY(_extendedCharTable->arenaCapacity() == 0)) {
+            reserveExtendedCharTables();
+        }
+        writableExtendedCharTable().growChar(currentChar, c);
+        cells.set(currentIndex, currentChar);
+        if (_extendedCharTable->arenaSize() >= _extendedCharTableLimit) {
+            compactExtendedChars();
+            reserveExtendedCharTables();
         }
         return;
     }
 
     if (_cuX + w > _columns) {
         if (getMode(Mode::Wrap)) {
-            _lineProperties[_cuY] |= LineProperty::Wrapped;
+            lineProperty(_cuY) |= LineProperty::Wrapped;
             nextLine();
         } else {
             _cuX = _columns - w;
         }
     }
 
-    // ensure current line vector has enough elements
-    if (int(_screenLines[_cuY].size()) < _cuX + w) {
-        _screenLines[_cuY].resize(_cuX + w);
+    // ensure current line has enough elements
+    if (lineLength(_cuY) < _cuX + w) {
+        resizeLine(_cuY, _cuX + w);
     }
 
     if (getMode(Mode::Insert)) insertChars(w);
 
-    Character& currentChar = _screenLines[_cuY][_cuX];
-
-    currentChar.character = c;
-    currentChar.foregroundColor = _effectiveForeground;
-    currentChar.backgroundColor = _effectiveBackground;
-    currentChar.rendition = _effectiveRendition;
-    currentChar.isRealCharacter = true;
+    CellSpan const cells = writableLine(_cuY);
+    cells.set(std::size_t(_cuX), Cell{c, _effectiveStyle, true, false});
 
     int i = 0;
     const int newCursorX = _cuX + w--;
     while (w) {
         i++;
-
-        Character& ch = _screenLines[_cuY][_cuX + i];
-        ch.character = 0;
-        ch.foregroundColor = _effectiveForeground;
-        ch.backgroundColor = _effectiveBackground;
-        ch.rendition = _effectiveRendition;
-        ch.isRealCharacter = false;
-
+        cells.set(std::size_t(_cuX + i), Cell{0, _effectiveStyle, false, false});
         w--;
     }
     _cuX = newCursorX;
 }
 
+static bool is_single_width(ucs4_char c)
+{
+    if (c < 0x300) {
+        return c >= 0x20 && (c < 0x7f || c >= 0xa0);
+    }
+    return char_width(c) == 1;
+}
+
+void Screen::displayString(ucs4_carray_view str)
+{
+    auto p = str.begin();
+    auto const e = str.end();
+
+    while (p != e) {
+        if (getMode(Mode::Insert) || !is_single_width(*p)) {
+            displayCharacter(*p);
+            ++p;
+            continue;
+        }
+
+        auto const run_end = std::find_if_not(p + 1, e, is_single_width);
+
+        CellFlags const flags = CellArray::to_flags(Cell{' ', _effectiveStyle, true, false});
+
+        while (p != run_end) {
+            if (_cuX >= _columns) {
+                if (getMode(Mode::Wrap)) {
+                    lineProperty(_cuY) |= LineProperty::Wrapped;
+                    nextLine();
+                }
+                else {
+                    // without wrapping, only the last character remains visible
+                    p = run_end - 1;
+                    _cuX = _columns - 1;
+                }
+            }
+
+            auto const n = std::min(run_end - p, std::ptrdiff_t(_columns - _cuX));
+
+            if (lineLength(_cuY) < _cuX + n) {
+                resizeLine(_cuY, int(_cuX + n));
+            }
+
+            CellSpan const cells = writableLine(_cuY);
+            std::copy(p, p + n, cells.codePoints + _cuX);
+            std::fill_n(cells.styles + _cuX, n, _effectiveStyle);
+            std::fill_n(cells.flags + _cuX, n, flags);
+            p += n;
+
+            _cuX += int(n);
+        }
+    }
+}
+
 void Screen::scrollUp(int n)
 {
     if (n == 0) n = 1; // Default
@@ -779,8 +1262,16 @@ void Screen::scrollUp(int from, int n)
     if (n <= 0 || from + n > _bottomMargin) return;
 
     saveLines(_bottomMargin - n + 1, _bottomMargin);
+    scrollRegionUp(from, n);
+}
+
+void Screen::scrollRegionUp(int from, int n)
+{
+    if (from == 0) {
+        pushToScrollback(0, n - 1);
+    }
     //FIXME: make sure `topMargin', `bottomMargin', `from', `n' is in bounds.
-    moveImage(loc(0, from), loc(0, from + n), loc(_columns - 1, _bottomMargin));
+    rotateLines(from, _bottomMargin, n);
     clearImage(loc(0, _bottomMargin - n + 1), loc(_columns - 1, _bottomMargin), ' ');
 }
 
@@ -797,11 +1288,14 @@ void Screen::scrollDown(int from, int n)
         return;
     if (from > _bottomMargin)
         return;
-    if (from + n > _bottomMargin)
-        n = _bottomMargin - from;
+    if (from + n > _bottomMargin + 1)
+        n = _bottomMargin - from + 1;
 
     saveLines(from, from + n - 1);
-    moveImage(loc(0, from + n), loc(0, from), loc(_columns - 1, _bottomMargin - n));
+    // every line of [from, _bottomMargin] is cleared, nothing to move
+    if (from + n <= _bottomMargin) {
+        rotateLines(from, _bottomMargin, -n);
+    }
     clearImage(loc(0, from), loc(_columns - 1, from + n - 1), ' ');
 }
 
@@ -870,55 +1364,54 @@ void Screen::clearImage(int loca, int loce, char c)
     const int topLine = loca / _columns;
     const int bottomLine = loce / _columns;
 
-    Character clearCh(c, _currentForeground, _currentBackground, Rendition::Default, false);
+    Cell const clearCh{
+        ucs4_char(c),
+        internStyle({Rendition::Default, _currentForeground, _currentBackground}),
+        false, false};
 
     //if the character being used to clear the area is the same as the
     //default character, the affected _lines can simply be shrunk.
-    const bool isDefaultCh = (clearCh == Screen::DefaultChar);
+    const bool isDefaultCh = (c == ' ' && clearCh.style == StyleTable::DefaultStyle);
 
     for (int y = topLine; y <= bottomLine; y++) {
-        _lineProperties[y] = LineProperty::Default;
+        lineProperty(y) = LineProperty::Default;
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
 
-        std::vector<Character>& line = _screenLines[y];
-
         if (isDefaultCh && endCol == _columns - 1) {
-            line.resize(startCol/*, clearCh*/);
+            resizeLine(y, startCol/*, clearCh*/);
         } else {
-            if (line.size() < std::size_t(endCol + 1))
-                line.resize(endCol + 1/*, clearCh*/);
+            if (lineLength(y) < endCol + 1)
+                resizeLine(y, endCol + 1/*, clearCh*/);
 
-            Character* data = line.data();
-            for (int i = startCol; i <= endCol; i++)
-                data[i] = clearCh;
+            writableLine(y).fill(std::size_t(startCol), std::size_t(endCol + 1), clearCh);
         }
     }
 }
 
-void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
+void Screen::rotateLines(int top, int bottom, int n)
 {
-    assert(sourceBegin <= sourceEnd);
+    assert(0 <= top && top <= bottom && bottom < _lines);
+    assert(std::abs(n) <= bottom - top);
 
-    const int lines = (sourceEnd - sourceBegin) / _columns;
+    markLinesDirty(top, bottom);
 
-    //move screen image and line properties:
-    //the source and destination areas of the image may overlap,
-    //so it matters that we do the copy in the right order -
-    //forwards if dest < sourceBegin or backwards otherwise.
-    //(search the web for 'memmove implementation' for details)
-    if (dest < sourceBegin) {
-        for (int i = 0; i <= lines; i++) {
-            _screenLines[(dest / _columns) + i ] = std::move(_screenLines[(sourceBegin / _columns) + i ]);
-            _lineProperties[(dest / _columns) + i] = std::move(_lineProperties[(sourceBegin / _columns) + i]);
-        }
-    } else {
-        for (int i = lines; i >= 0; i--) {
-            _screenLines[(dest / _columns) + i ] = std::move(_screenLines[(sourceBegin / _columns) + i ]);
-            _lineProperties[(dest / _columns) + i] = std::move(_lineProperties[(sourceBegin / _columns) + i]);
-        }
+    //the whole screen is a ring buffer: only the first row changes.
+    if (top == 0 && bottom == _lines - 1) {
+        _firstRow = (_firstRow + n + _lines) % _lines;
+        return;
     }
+
+    //linearize the ring before permuting the rows of the region
+    if (_firstRow) {
+        std::rotate(_rowIndex.begin(), _rowIndex.begin() + _firstRow, _rowIndex.end());
+        _firstRow = 0;
+    }
+
+    auto const first = _rowIndex.begin() + top;
+    auto const last = _rowIndex.begin() + bottom + 1;
+    std::rotate(first, n >= 0 ? first + n : last + n, last);
 }
 
 void Screen::clearToEndOfScreen()
@@ -928,15 +1421,17 @@ void Screen::clearToEndOfScreen()
 
 void Screen::clearToBeginOfScreen()
 {
-    clearImage(loc(0, 0), loc(_cuX, _cuY), ' ');
+    saveDeferredLines();
+    clearImage(loc(0, 0), loc(std::min(_cuX, _columns - 1), _cuY), ' ');
 }
 
 void Screen::clearEntireScreen()
 {
+    saveDeferredLines();
+    markLinesDirty(0, _lines - 1);
+    std::fill(_unsavedRows.begin(), _unsavedRows.end(), true);
     std::fill(_lineProperties.begin(), _lineProperties.end(), LineProperty::Default);
-    for (auto & v : getMutableScreenLines()) {
-        v.resize(0);
-    }
+    std::fill(_lineLength.begin(), _lineLength.end(), 0);
 }
 
 /*! fill screen with 'E'
@@ -945,12 +1440,14 @@ void Screen::clearEntireScreen()
 
 void Screen::helpAlign()
 {
+    saveDeferredLines();
+    markLinesDirty(0, _lines - 1);
     std::fill(_lineProperties.begin(), _lineProperties.end(), LineProperty::Default);
-    Character clearCh('E');
-    for (auto & v : getMutableScreenLines()) {
-        std::fill(v.begin(), v.end(), clearCh);
-        v.resize(_columns, clearCh);
+    Cell const clearCh{'E'};
+    for (int y = 0; y < _lines; ++y) {
+        writableLine(y).fill(0, std::size_t(_columns), clearCh);
     }
+    std::fill(_lineLength.begin(), _lineLength.end(), _columns);
 }
 
 void Screen::clearToEndOfLine()
@@ -960,7 +1457,7 @@ void Screen::clearToEndOfLine()
 
 void Screen::clearToBeginOfLine()
 {
-    clearImage(loc(0, _cuY), loc(_cuX, _cuY), ' ');
+    clearImage(loc(0, _cuY), loc(std::min(_cuX, _columns - 1), _cuY), ' ');
 }
 
 void Screen::clearEntireLine()
@@ -988,6 +1485,23 @@ void Screen::setDefaultRendition()
     updateEffectiveRendition();
 }
 
+Screen::GraphicRendition Screen::getGraphicRendition() const
+{
+    return {_currentRendition, _currentForeground, _currentBackground};
+}
+
+void Screen::setGraphicRendition(GraphicRendition const & rendition)
+{
+    _currentRendition = rendition.rendition;
+    _currentForeground = rendition.foreground.isValid()
+        ? rendition.foreground
+        : CharacterColor(ColorSpace::Default, DEFAULT_FORE_COLOR);
+    _currentBackground = rendition.background.isValid()
+        ? rendition.background
+        : CharacterColor(ColorSpace::Default, DEFAULT_BACK_COLOR);
+    updateEffectiveRendition();
+}
+
 void Screen::setForeColor(ColorSpace space, int color)
 {
     _currentForeground = CharacterColor(space, color);
@@ -1011,9 +1525,9 @@ void Screen::setBackColor(ColorSpace space, int color)
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if (enable)
-        _lineProperties[_cuY] |= property;
+        lineProperty(_cuY) |= property;
     else
-        _lineProperties[_cuY] &= ~property;
+        lineProperty(_cuY) &= ~property;
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
@@ -23,11 +23,13 @@
 #pragma once
 
 #include "rvt/character.hpp"
+#include "rvt/cell_array.hpp"
 
 #include "utils/sugar/enum_flags_operators.hpp"
 
 #include <vector>
-#include <functional>
+#include <iterator>
+#include <memory>
 
 #include <cstdint>
 #include <cassert>
@@ -41,8 +43,21 @@ namespace rvt
         DoubleWidth  = (1 << 1),
         DoubleHeight = (1 << 2),
     };
+
+    /// What changed since the last reset of the damage (see Screen::getDamage()).
+    enum class Damage : uint8_t
+    {
+        None          = 0,
+        Lines         = (1 << 0), // at least one line is dirty
+        Cursor        = (1 << 1), // position of the cursor
+        Modes         = (1 << 2), // Screen::Mode, the visibility of the cursor included
+        Size          = (1 << 3),
+        Title         = (1 << 4), // only for VtEmulator
+        CurrentScreen = (1 << 5), // only for VtEmulator: primary <-> alternate screen
+    };
 }
 template<> struct is_enum_flags<rvt::LineProperty> : std::true_type {};
+template<> struct is_enum_flags<rvt::Damage> : std::true_type {};
 
 
 namespace rvt
@@ -59,6 +74,9 @@ struct Flags
     void copy_of(Bit pos, Flags f) { this->value_ = (this->value_ & ~to_flag(pos)) | (f.value_ & to_flag(pos)); }
     bool has(Bit pos) const { return bool(this->value_ & to_flag(pos)); }
 
+    bool operator==(Flags other) const { return this->value_ == other.value_; }
+    bool operator!=(Flags other) const { return this->value_ != other.value_; }
+
 private:
     constexpr static Underlying to_flag(Bit pos) { return 1u << Underlying(pos); }
 
@@ -82,6 +100,129 @@ private:
 };
 
 
+/**
+ * Cells of a line. Indexing expands a cell to a Character with the style table of the screen.
+ * codePoints(), styles() and flags() give access to each field as a contiguous array.
+ */
+class ImageLine // [0..columns]
+{
+public:
+    struct iterator
+    {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Character;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Character;
+
+        Character operator*() const
+        {
+            return styleTable->toCharacter(Cell{
+                *codePoint, *style, bool(*flags & CellFlags::Real), bool(*flags & CellFlags::Extended)});
+        }
+        iterator & operator++() { ++codePoint; ++style; ++flags; return *this; }
+        bool operator==(iterator const & other) const { return codePoint == other.codePoint; }
+        bool operator!=(iterator const & other) const { return codePoint != other.codePoint; }
+
+        ucs4_char const * codePoint;
+        StyleId const * style;
+        CellFlags const * flags;
+        StyleTable const * styleTable;
+    };
+
+    ImageLine(CellSpan cells, std::size_t size, StyleTable const & styles) noexcept
+    : _codePoints(cells.codePoints)
+    , _styles(cells.styles)
+    , _flags(cells.flags)
+    , _size(size)
+    , _styleTable(&styles)
+    {}
+
+    ImageLine(ucs4_char const * codePoints, StyleId const * styles, CellFlags const * flags,
+              std::size_t size, StyleTable const & styleTable) noexcept
+    : _codePoints(codePoints)
+    , _styles(styles)
+    , _flags(flags)
+    , _size(size)
+    , _styleTable(&styleTable)
+    {}
+
+    Character operator[](std::size_t i) const { return _styleTable->toCharacter(cell(i)); }
+    std::size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return !_size; }
+
+    iterator begin() const { return {_codePoints, _styles, _flags, _styleTable}; }
+    iterator end() const { return {_codePoints + _size, _styles + _size, _flags + _size, _styleTable}; }
+
+    Cell cell(std::size_t i) const noexcept
+    {
+        assert(i < _size);
+        return Cell{_codePoints[i], _styles[i],
+                    bool(_flags[i] & CellFlags::Real), bool(_flags[i] & CellFlags::Extended)};
+    }
+
+    array_view<const ucs4_char> codePoints() const noexcept { return {_codePoints, _size}; }
+    array_view<const StyleId> styles() const noexcept { return {_styles, _size}; }
+    array_view<const CellFlags> flags() const noexcept { return {_flags, _size}; }
+
+    StyleTable const & styleTable() const noexcept { return *_styleTable; }
+
+private:
+    ucs4_char const * _codePoints;
+    StyleId const * _styles;
+    CellFlags const * _flags;
+    std::size_t _size;
+    StyleTable const * _styleTable;
+};
+
+/// Random access view of the lines of a Screen or a ScreenSnapshot, in display order.
+template<class ScreenT>
+class BasicScreenLines
+{
+public:
+    struct iterator
+    {
+        ImageLine operator*() const { return screen->getScreenLine(y); }
+        iterator & operator++() { ++y; return *this; }
+        bool operator==(iterator const & other) const { return y == other.y; }
+        bool operator!=(iterator const & other) const { return y != other.y; }
+
+        ScreenT const * screen;
+        int y;
+    };
+
+    ImageLine operator[](std::size_t y) const { return _screen->getScreenLine(int(y)); }
+    std::size_t size() const noexcept { return std::size_t(_screen->getLines()); }
+
+    iterator begin() const { return {_screen, 0}; }
+    iterator end() const { return {_screen, _screen->getLines()}; }
+
+private:
+    friend ScreenT;
+    explicit BasicScreenLines(ScreenT const & screen) : _screen(&screen) {}
+
+    ScreenT const * _screen;
+};
+
+/// Random access view of the line properties of a Screen or a ScreenSnapshot, in display order.
+template<class ScreenT>
+class BasicScreenLineProperties
+{
+public:
+    LineProperty operator[](std::size_t y) const { return _screen->getLineProperty(int(y)); }
+    std::size_t size() const noexcept { return std::size_t(_screen->getLines()); }
+
+private:
+    friend ScreenT;
+    explicit BasicScreenLineProperties(ScreenT const & screen) : _screen(&screen) {}
+
+    ScreenT const * _screen;
+};
+
+class ScreenSnapshot;
+class Scrollback;
+
+
 /**
     \brief An image of characters with associated attributes.
 
@@ -119,7 +260,38 @@ public:
         COUNT_
     };
 
-    using LineSaver = std::function<void(Screen const&, size_t y, size_t yend)>;
+    /**
+     * Receives the lines [y, yend) which leave the cursor or the screen.
+     * Only the lines modified since their previous commit are given and
+     * the contiguous lines of a commit come in a single call.
+     */
+    struct LineSaver
+    {
+        using Function = void(void * ctx, Screen const & screen, size_t y, size_t yend);
+
+        Function * fn = nullptr;
+        void * ctx = nullptr;
+
+        LineSaver() noexcept = default;
+        LineSaver(std::nullptr_t) noexcept {}
+        LineSaver(Function * fn, void * ctx) noexcept
+        : fn(fn), ctx(ctx)
+        {}
+
+        /// Calls f(screen, y, yend), f must outlive the screen.
+        template<class F>
+        static LineSaver from(F & f) noexcept
+        {
+            return LineSaver([](void * ctx, Screen const & screen, size_t y, size_t yend){
+                (*static_cast<F*>(ctx))(screen, y, yend);
+            }, &f);
+        }
+
+        explicit operator bool () const noexcept { return fn != nullptr; }
+
+        void operator()(Screen const & screen, size_t y, size_t yend) const
+        { fn(ctx, screen, y, yend); }
+    };
 
     /** Construct a new screen image of size @p lines by @p columns. */
     Screen(strictly_positif lines, strictly_positif columns);
@@ -130,6 +302,13 @@ public:
 
     void setLineSaver(LineSaver lineSaver);
 
+    /**
+     * The lines which go up with index() at the bottom margin are committed
+     * together: once the first of them would leave the scrolling region,
+     * before any other commit or with this function.
+     */
+    void saveDeferredLines();
+
     // VT100/2 Operations
     // Cursor Movement
 
@@ -283,6 +462,22 @@ public:
     /** Returns whether the specified screen @p mode is enabled or not .*/
     bool getMode(Mode mode) const;
 
+    using ModeFlags = Flags<Mode>;
+
+    /** Returns all the current modes. */
+    ModeFlags getModes() const noexcept { return _currentModes; }
+    /** Returns all the modes saved by saveMode(). */
+    ModeFlags getSavedModes() const noexcept { return _savedModes; }
+    /**
+     * Replaces the current and saved modes.
+     * Unlike setMode(), no side effect is applied (the cursor does not move).
+     */
+    void setModes(ModeFlags modes, ModeFlags savedModes) noexcept
+    {
+        _currentModes = modes;
+        _savedModes = savedModes;
+    }
+
     /**
      * Saves the current position and appearance (text color and style) of the cursor.
      * It can be restored by calling restoreCursor()
@@ -352,6 +547,22 @@ public:
      */
     void setDefaultRendition();
 
+    /** Colors and rendition flags of the cursor. */
+    struct GraphicRendition
+    {
+        Rendition rendition;
+        CharacterColor foreground;
+        CharacterColor background;
+    };
+
+    /** Returns the cursor's colors and rendition flags. */
+    GraphicRendition getGraphicRendition() const;
+    /**
+     * Sets the cursor's colors and rendition flags at once.
+     * Invalid colors are replaced with the default colors.
+     */
+    void setGraphicRendition(GraphicRendition const & rendition);
+
     /** Returns the column which the cursor is positioned at. */
     int  getCursorX() const;
     /** Returns the line which the cursor is positioned on. */
@@ -406,6 +617,14 @@ public:
      */
     void displayCharacter(ucs4_char c);
 
+    /**
+     * Displays a sequence of characters at the current cursor position.
+     *
+     * Equivalent to calling displayCharacter() for each character, but runs
+     * of single-width characters are written to the current line in one go.
+     */
+    void displayString(ucs4_carray_view str);
+
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
      * In the case that @p new_columns is smaller than the current number of columns,
@@ -415,9 +634,36 @@ public:
      * The top and bottom margins are reset to the top and bottom of the new
      * screen size.  Tab stops are also reset and the current selection is
      * cleared.
+     *
+     * With setReflowLines(true), the lines joined by LineProperty::Wrapped are
+     * wrapped again at the new width and the cursor keeps its place in the text.
      */
     void resizeImage(strictly_positif new_lines, strictly_positif new_columns);
 
+    /**
+     * Enables the reflow of the wrapped lines by resizeImage() (disabled by default).
+     * When the reflowed text is higher than the screen, the top lines are dropped,
+     * blank lines below the cursor are dropped first.
+     */
+    void setReflowLines(bool enable) noexcept { _reflowLines = enable; }
+    bool getReflowLines() const noexcept { return _reflowLines; }
+
+    /**
+     * Keeps up to \c maxLines lines scrolled out of the top of the screen in
+     * a compressed history (see Scrollback). 0 disables it and releases the history.
+     */
+    void setScrollbackSize(std::size_t maxLines);
+    std::size_t getScrollbackSize() const noexcept;
+
+    /**
+     * Moves the compressed blocks of the history to \c filename (see Scrollback::setFile()).
+     * The history must be enabled with setScrollbackSize().
+     */
+    void setScrollbackFile(char const * filename, int mode);
+
+    /// History of the screen, nullptr when disabled.
+    Scrollback const * scrollback() const noexcept { return _scrollback.get(); }
+
     /**
      * Sets or clears an attribute of the current line.
      *
@@ -445,28 +691,84 @@ public:
 
     static const Character DefaultChar;
 
-    using ImageLine = std::vector<Character> ; // [0..columns]
+    using ImageLine = rvt::ImageLine;
+    using ScreenLines = BasicScreenLines<Screen>;
+    using ScreenLineProperties = BasicScreenLineProperties<Screen>;
 
-    array_view<const LineProperty> getLineProperties() const;
+    ScreenLineProperties getLineProperties() const;
+    LineProperty getLineProperty(int y) const;
 
-    array_view<const ImageLine> getScreenLines() const;
+    ScreenLines getScreenLines() const;
+    ImageLine getScreenLine(int y) const;
 
     ExtendedCharTable const & extendedCharTable() const;
 
+    StyleTable const & styleTable() const;
+
+    /**
+     * Captures the current state of the screen in O(lines): the rows are shared
+     * until the screen modifies them (copy-on-write). The snapshot can be read
+     * and destroyed by another thread while this screen keeps receiving characters.
+     */
+    ScreenSnapshot snapshot() const;
+
+    /// Bytes allocated by the screen, by category.
+    struct MemoryUsage
+    {
+        std::size_t cells = 0;          // rows, including the copies made for the snapshots
+        std::size_t lineProperties = 0; // length, properties, order and damage of the rows
+        std::size_t tabStops = 0;
+        std::size_t styles = 0;
+        std::size_t extendedChars = 0;
+        std::size_t scrollback = 0;
+
+        std::size_t total() const noexcept
+        { return cells + lineProperties + tabStops + styles + extendedChars + scrollback; }
+    };
+
+    MemoryUsage memoryUsage() const noexcept;
+
+    /**
+     * Releases the memory which is not needed by the displayed content:
+     * compacts the extended characters, drops their preallocated space and
+     * the rows copied for the snapshots which have been destroyed.
+     * The lines of the history which are not yet in a block are compressed.
+     */
+    void reduceMemoryUsage();
+
+    /**
+     * Same as reduceMemoryUsage(), the styles which are no longer displayed
+     * are also removed and every buffer is shrunk to its content.
+     */
+    void trim();
+
+    /**
+     * Changes since the last resetDamage(), a new screen is entirely damaged.
+     * Every operation which changes the content of a line marks it as dirty,
+     * scrolling marks the whole scrolled region.
+     */
+    Damage getDamage() const noexcept;
+    bool isLineDirty(int y) const noexcept
+    {
+        assert(0 <= y && y < _lines);
+        return _dirtyLines[std::size_t(y)];
+    }
+    void resetDamage() noexcept;
+
 private:
     //fills a section of the screen image with the character 'c'
     //the parameters are specified as offsets from the start of the screen image.
     //the loc(x,y) macro can be used to generate these values from a column,line pair.
     void clearImage(int loca, int loce, char c);
 
-    //move screen image between 'sourceBegin' and 'sourceEnd' to 'dest'.
-    //the parameters are specified as offsets from the start of the screen image.
-    //the loc(x,y) macro can be used to generate these values from a column,line pair.
-    //
-    //NOTE: moveImage() can only move whole lines
-    void moveImage(int dest, int sourceBegin, int sourceEnd);
-    // scroll up 'i' lines in current region, clearing the bottom 'i' lines
+    //rotate the lines between 'top' and 'bottom' (inclusive) up by 'n' lines
+    //(down when 'n' is negative). Only the row index is updated, cells never move.
+    void rotateLines(int top, int bottom, int n);
+    // scroll up 'i' lines in current region, clearing the bottom 'i' lines.
+    // With from == 0, the lines leave the screen and go to the history
     void scrollUp(int from, int i);
+    // same as scrollUp() without commit
+    void scrollRegionUp(int from, int i);
     // scroll down 'i' lines in current region, clearing the top 'i' lines
     void scrollDown(int from, int i);
 
@@ -479,13 +781,73 @@ private:
     int _lines;
     int _columns;
 
-    std::vector<ImageLine> _screenLines;       // [lines]
+    // cells of all the lines, _columns cells by row, shared with the snapshots.
+    // rows are indexed physically, display order goes through _rowIndex
+    std::shared_ptr<RowPool> _rows;            // [lines * columns] or more with snapshots
+    std::vector<int> _lineLength;              // [rows] number of cells in use by row
+    std::vector<LineProperty> _lineProperties; // [rows]
+
+    // display line -> physical row.
+    // Scrolling the whole screen only moves _firstRow (ring buffer),
+    // scrolling a region permutes the indexes of this region.
+    std::vector<int> _rowIndex;                // [lines]
+    int _firstRow;
+
+    // rows which are not displayed. A row replaced while a snapshot uses
+    // it is retired and becomes free once no snapshot refers to it.
+    std::vector<int> _freeRows;
+    std::vector<int> _retiredRows;
 
 private:
-    array_view<ImageLine> getMutableScreenLines()
-    { return array_view<ImageLine>{_screenLines.data(), std::size_t(_lines)};  }
+    int physicalRow(int y) const noexcept
+    {
+        assert(0 <= y && y < _lines);
+        int const i = _firstRow + y;
+        return _rowIndex[i < _lines ? i : i - _lines];
+    }
+
+    // cells of the line y
+    CellSpan line(int y) const noexcept
+    { return _rows->row(std::size_t(physicalRow(y))); }
+
+    // cells of the line y before modifying them, the row is copied when a snapshot uses it.
+    // The line is marked as dirty
+    CellSpan writableLine(int y);
+    // same as writableLine() for changes which are not visible
+    CellSpan writableRow(int y);
+    // replaces the row of the line y by a copy
+    void copyRow(int & row);
+
+    int lineLength(int y) const noexcept
+    { return _lineLength[physicalRow(y)]; }
+
+    LineProperty & lineProperty(int y) noexcept
+    {
+        markLineDirty(y);
+        return _lineProperties[physicalRow(y)];
+    }
+
+    void markLineDirty(int y) noexcept
+    {
+        _dirtyLines[std::size_t(y)] = true;
+        _unsavedRows[std::size_t(physicalRow(y))] = true;
+        _damage |= Damage::Lines;
+    }
+    // lines [top, bottom]
+    void markLinesDirty(int top, int bottom) noexcept;
 
-    std::vector<LineProperty> _lineProperties; // QVarLengthArray<LineProperty, 64>
+    // new cells are default characters
+    void resizeLine(int y, int length);
+
+    // moves the displayed lines in a new pool of new_lines rows, in display order
+    void reallocateRows(int new_lines, int new_columns);
+    // same with the logical lines wrapped at new_columns, updates the cursor
+    void reflowRows(int new_lines, int new_columns);
+
+    // returns StyleTable::DefaultStyle when no more styles can be allocated
+    StyleId internStyle(CharacterStyle const & style);
+    // removes the styles unused by the cells
+    void compactStyles();
 
     // cursor location
     int _cuX;
@@ -501,8 +863,6 @@ private:
     int _bottomMargin;
 
     // states ----------------
-    using ModeFlags = Flags<Mode>;
-
     ModeFlags _currentModes;
     ModeFlags _savedModes;
 
@@ -514,6 +874,11 @@ private:
     CharacterColor _effectiveForeground; // These are derived from
     CharacterColor _effectiveBackground; // the cu_* variables above
     Rendition _effectiveRendition;          // to speed up operation
+    StyleId _effectiveStyle;
+
+    // tables are shared with the snapshots, they are copied before a modification
+    std::shared_ptr<StyleTable> _styleTable;
+    StyleTable & writableStyleTable();
 
     class SavedState
     {
@@ -529,12 +894,102 @@ private:
     };
     SavedState _savedState;
 
-    ExtendedCharTable _extendedCharTable;
+    std::shared_ptr<ExtendedCharTable> _extendedCharTable;
+    ExtendedCharTable & writableExtendedCharTable();
+    // target of compactExtendedChars(), swapped with _extendedCharTable
+    ExtendedCharTable _spareExtendedCharTable;
+    // arena size of _extendedCharTable which triggers a compaction
+    std::size_t _extendedCharTableLimit;
+
+    // removes the extended characters which are no longer on the screen
+    void compactExtendedChars();
+    // preallocates the extended character tables up to the next compaction
+    void reserveExtendedCharTables();
 
-    void saveLine() const;
-    void saveLines(int topLine, int bottomLine) const;
+    // commits the deferred lines then the modified lines of [top, bottom] to _lineSaver
+    void saveLine();
+    void saveLines(int topLine, int bottomLine);
+    void commitLines(int topLine, int bottomLine);
 
     LineSaver _lineSaver;
+    // lines [_bottomMargin - n, _bottomMargin - 1] left by index()
+    int _deferredLines = 0;
+    // rows modified since their last commit
+    std::vector<bool> _unsavedRows;            // [rows]
+
+    // lines [top, bottom] to the history
+    void pushToScrollback(int topLine, int bottomLine);
+
+    std::unique_ptr<Scrollback> _scrollback;
+
+    bool _reflowLines = false;
+
+    // damage since the last resetDamage(), the cursor and the modes
+    // are compared with their value at this time
+    std::vector<bool> _dirtyLines;             // [lines]
+    Damage _damage = Damage::Lines | Damage::Size;
+    int _damageCursorX = 0;
+    int _damageCursorY = 0;
+    ModeFlags _damageModes;
+};
+
+
+/**
+ * Frozen state of a Screen returned by Screen::snapshot().
+ * Provides the read interface of Screen used by the renderers.
+ */
+class ScreenSnapshot
+{
+public:
+    using ScreenLines = BasicScreenLines<ScreenSnapshot>;
+    using ScreenLineProperties = BasicScreenLineProperties<ScreenSnapshot>;
+
+    ScreenSnapshot() = default;
+    ScreenSnapshot(ScreenSnapshot && other) noexcept = default;
+    ScreenSnapshot & operator=(ScreenSnapshot && other) noexcept;
+    ~ScreenSnapshot();
+
+    int getLines() const noexcept { return int(_rows.size()); }
+    int getColumns() const noexcept { return _columns; }
+    int getCursorX() const noexcept { return _cuX; }
+    int getCursorY() const noexcept { return _cuY; }
+    bool hasCursorVisible() const noexcept { return _cursorVisible; }
+
+    ScreenLineProperties getLineProperties() const { return ScreenLineProperties(*this); }
+    LineProperty getLineProperty(int y) const { return _rows[std::size_t(y)].property; }
+
+    ScreenLines getScreenLines() const { return ScreenLines(*this); }
+    ImageLine getScreenLine(int y) const
+    {
+        Row const & row = _rows[std::size_t(y)];
+        return ImageLine(row.cells, row.length, *_styleTable);
+    }
+
+    ExtendedCharTable const & extendedCharTable() const noexcept { return *_extendedCharTable; }
+    StyleTable const & styleTable() const noexcept { return *_styleTable; }
+
+private:
+    friend class Screen;
+
+    void release() noexcept;
+
+    struct Row
+    {
+        CellSpan cells;
+        std::atomic<uint32_t> * references;
+        std::size_t length;
+        LineProperty property;
+    };
+
+    std::vector<Row> _rows;
+    // keeps the rows alive
+    std::shared_ptr<RowPool const> _pool;
+    std::shared_ptr<StyleTable const> _styleTable;
+    std::shared_ptr<ExtendedCharTable const> _extendedCharTable;
+    int _columns = 0;
+    int _cuX = 0;
+    int _cuY = 0;
+    bool _cursorVisible = false;
 };
 
 }
@@ -0,0 +1,436 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#include "rvt/scrollback.hpp"
+#include "rvt/lz_compression.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace rvt
+{
+
+namespace
+{
+    void push_varint(std::vector<uint8_t> & out, uint32_t x)
+    {
+        while (x >= 0x80) {
+            out.push_back(uint8_t(x | 0x80));
+            x >>= 7;
+        }
+        out.push_back(uint8_t(x));
+    }
+
+    uint32_t read_varint(uint8_t const *& p) noexcept
+    {
+        uint32_t x = 0;
+        unsigned shift = 0;
+        while (*p & 0x80) {
+            x |= uint32_t(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        return x | uint32_t(*p++) << shift;
+    }
+
+    void push_u32(std::vector<uint8_t> & out, uint32_t x)
+    {
+        uint8_t const bytes[] {uint8_t(x), uint8_t(x >> 8), uint8_t(x >> 16), uint8_t(x >> 24)};
+        out.insert(out.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    uint32_t read_u32(uint8_t const *& p) noexcept
+    {
+        uint32_t const x = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        p += 4;
+        return x;
+    }
+
+    // tags of the cells, the other values are the code point + cell_code_point
+    constexpr uint32_t cell_not_real = 0;     // followed by the code point
+    constexpr uint32_t cell_extended = 1;     // followed by the length and the code points
+    constexpr uint32_t cell_code_point = 2;
+}
+
+struct Scrollback::File
+{
+    File(int fd) noexcept
+    : fd(fd)
+    {}
+
+    ~File()
+    {
+        if (mapping) {
+            munmap(mapping, mappingSize);
+        }
+        close(fd);
+    }
+
+    void append(uint8_t const * p, std::size_t len)
+    {
+        while (len) {
+            ssize_t const n = ::write(fd, p, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "scrollback file");
+            }
+            p += n;
+            len -= std::size_t(n);
+            size += uint64_t(n);
+        }
+    }
+
+    // bytes [0, end) of the file
+    uint8_t const * map(uint64_t end)
+    {
+        if (end > mappingSize) {
+            if (mapping) {
+                munmap(mapping, mappingSize);
+                mapping = nullptr;
+                mappingSize = 0;
+            }
+            void * p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "scrollback file");
+            }
+            mapping = p;
+            mappingSize = size;
+        }
+        return static_cast<uint8_t const *>(mapping);
+    }
+
+    int fd;
+    uint64_t size = 0;
+    // the whole file at the time of the last map()
+    void * mapping = nullptr;
+    std::size_t mappingSize = 0;
+};
+
+Scrollback::Scrollback(std::size_t maxLines) noexcept
+: _maxLines(maxLines)
+{}
+
+Scrollback::~Scrollback() = default;
+
+// A line is encoded as:
+//  - the number of cells (varint) and the LineProperty (byte) ;
+//  - the runs of styles until the number of cells is reached: the length of
+//    the run (varint), the rendition (byte) and the packed foreground and
+//    background colors (4 bytes each) ;
+//  - the cells (see cell_not_real, cell_extended and cell_code_point).
+void Scrollback::push(ImageLine const & line, LineProperty property, ExtendedCharTable const & extendedChars)
+{
+    if (!_maxLines) {
+        return;
+    }
+
+    _pendingOffsets.push_back(uint32_t(_pending.size()));
+
+    auto const size = line.size();
+    push_varint(_pending, uint32_t(size));
+    _pending.push_back(uint8_t(property));
+
+    StyleTable const & styleTable = line.styleTable();
+    StyleId const * const styles = line.styles().data();
+    for (StyleId const * p = styles; p != styles + size; ) {
+        StyleId const * const e = find_style_run_end(p, styles + size);
+        CharacterStyle const & style = styleTable[*p];
+        push_varint(_pending, uint32_t(e - p));
+        _pending.push_back(uint8_t(style.rendition));
+        push_u32(_pending, style.foregroundColor.packed());
+        push_u32(_pending, style.backgroundColor.packed());
+        p = e;
+    }
+
+    auto const codePoints = line.codePoints();
+    auto const flags = line.flags();
+    for (std::size_t i = 0; i < size; ++i) {
+        if (!bool(flags[i] & CellFlags::Real)) {
+            push_varint(_pending, cell_not_real);
+            push_varint(_pending, codePoints[i]);
+        }
+        else if (bool(flags[i] & CellFlags::Extended)) {
+            auto const chars = extendedChars[codePoints[i]];
+            push_varint(_pending, cell_extended);
+            push_varint(_pending, uint32_t(chars.size()));
+            for (ucs4_char uc : chars) {
+                push_varint(_pending, uc);
+            }
+        }
+        else {
+            push_varint(_pending, codePoints[i] + cell_code_point);
+        }
+    }
+
+    ++_size;
+
+    if (_pendingOffsets.size() >= linesByBlock) {
+        compressPendingLines();
+    }
+
+    dropOldLines();
+}
+
+uint8_t const * Scrollback::readLine(uint8_t const * p, ScrollbackLines * lines)
+{
+    std::size_t const size = read_varint(p);
+    auto const property = LineProperty(*p++);
+
+    std::size_t const start = lines ? lines->_lineStarts.back() : 0;
+    if (lines) {
+        lines->_cells.resize(start + size);
+    }
+
+    for (std::size_t n = 0; n < size; ) {
+        std::size_t const len = read_varint(p);
+        CharacterStyle style;
+        style.rendition = Rendition(*p++);
+        style.foregroundColor = CharacterColor::fromPacked(read_u32(p));
+        style.backgroundColor = CharacterColor::fromPacked(read_u32(p));
+        if (lines) {
+            StyleId id;
+            if (!lines->_styleTable.intern(style, id)) {
+                id = StyleTable::DefaultStyle;
+            }
+            std::fill_n(lines->_cells.styles() + start + n, len, id);
+        }
+        n += len;
+    }
+
+    for (std::size_t i = 0; i < size; ++i) {
+        uint32_t const tag = read_varint(p);
+        Cell cell{};
+        if (tag == cell_not_real) {
+            cell.character = read_varint(p);
+            cell.isRealCharacter = false;
+        }
+        else if (tag == cell_extended) {
+            std::size_t const len = read_varint(p);
+            for (std::size_t k = 0; k < len; ++k) {
+                ucs4_char const uc = read_varint(p);
+                if (k == 0) {
+                    cell.character = uc;
+                }
+                else if (lines) {
+                    lines->_extendedCharTable.growChar(cell, uc);
+                }
+            }
+        }
+        else {
+            cell.character = tag - cell_code_point;
+        }
+
+        if (lines) {
+            cell.style = lines->_cells.styles()[start + i];
+            lines->_cells.set(start + i, cell);
+        }
+    }
+
+    if (lines) {
+        lines->_lineStarts.push_back(start + size);
+        lines->_properties.push_back(property);
+    }
+
+    return p;
+}
+
+void Scrollback::readLines(std::size_t first, std::size_t count, ScrollbackLines & lines) const
+{
+    lines.clear();
+
+    if (first >= _size) {
+        return;
+    }
+    std::size_t const last = first + std::min(count, _size - first);
+
+    // index in the history of the first line of the current block
+    std::size_t index = 0;
+    std::vector<uint8_t> data;
+
+    // appends the lines [begin, end) of the lines which start at p
+    auto read = [&](uint8_t const * p, std::size_t begin, std::size_t end) {
+        for (std::size_t i = 0; i < begin; ++i) {
+            p = readLine(p, nullptr);
+        }
+        for (std::size_t i = begin; i < end; ++i) {
+            p = readLine(p, &lines);
+        }
+    };
+
+    for (std::size_t i = 0; i < _blocks.size() && index < last; ++i) {
+        Block const & block = _blocks[i];
+        std::size_t const skipped = i ? 0 : _droppedLines;
+        std::size_t const lineCount = block.lineCount - skipped;
+        if (index + lineCount > first) {
+            data.clear();
+            if (!lz::decompress(blockData(block), block.size, block.rawSize, data)) {
+                throw std::runtime_error("corrupted scrollback block");
+            }
+            std::size_t const begin = first > index ? first - index : 0;
+            std::size_t const end = std::min(lineCount, last - index);
+            read(data.data(), skipped + begin, skipped + end);
+        }
+        index += lineCount;
+    }
+
+    if (index < last) {
+        std::size_t const begin = first > index ? first - index : 0;
+        read(_pending.data() + _pendingOffsets[begin], 0, last - index - begin);
+    }
+}
+
+void Scrollback::setMaxLines(std::size_t maxLines)
+{
+    _maxLines = maxLines;
+    dropOldLines();
+}
+
+void Scrollback::clear() noexcept
+{
+    _blocks.clear();
+    _pending.clear();
+    _pendingOffsets.clear();
+    _droppedLines = 0;
+    _size = 0;
+}
+
+std::size_t Scrollback::memoryUsage() const noexcept
+{
+    std::size_t n = _pending.capacity() + _pendingOffsets.capacity() * sizeof(uint32_t);
+    n += _compressed.capacity() + _blocks.size() * sizeof(Block);
+    if (_file) {
+        n += sizeof(File);
+    }
+    else {
+        for (Block const & block : _blocks) {
+            n += block.size;
+        }
+    }
+    return n;
+}
+
+void Scrollback::shrinkToFit()
+{
+    if (!_pendingOffsets.empty()) {
+        compressPendingLines();
+    }
+    _pending.shrink_to_fit();
+    _pendingOffsets.shrink_to_fit();
+    _compressed = std::vector<uint8_t>();
+    _blocks.shrink_to_fit();
+}
+
+void Scrollback::setFile(char const * filename, int mode)
+{
+    int const fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "scrollback file");
+    }
+    auto file = std::make_unique<File>(fd);
+
+    for (Block & block : _blocks) {
+        block.offset = file->size;
+        file->append(blockData(block), block.size);
+    }
+    for (Block & block : _blocks) {
+        block.data.reset();
+    }
+
+    _file = std::move(file);
+}
+
+uint8_t const * Scrollback::blockData(Block const & block) const
+{
+    if (block.data) {
+        return block.data.get();
+    }
+    return _file->map(block.offset + block.size) + block.offset;
+}
+
+void Scrollback::compressPendingLines()
+{
+    _compressed.clear();
+    lz::compress(_pending.data(), _pending.size(), _compressed);
+
+    Block block{nullptr, 0, uint32_t(_compressed.size()),
+                uint32_t(_pendingOffsets.size()), uint32_t(_pending.size())};
+    if (_file) {
+        block.offset = _file->size;
+        _file->append(_compressed.data(), _compressed.size());
+    }
+    else {
+        block.data.reset(new uint8_t[_compressed.size()]);
+        std::copy(_compressed.begin(), _compressed.end(), block.data.get());
+    }
+
+    _blocks.emplace_back(std::move(block));
+    _pending.clear();
+    _pendingOffsets.clear();
+}
+
+void Scrollback::dropOldLines()
+{
+    while (_size > _maxLines) {
+        std::size_t const excess = _size - _maxLines;
+        if (!_blocks.empty()) {
+            Block const & block = _blocks.front();
+            std::size_t const n = std::min(excess, block.lineCount - _droppedLines);
+            _droppedLines += n;
+            _size -= n;
+            if (_droppedLines == block.lineCount) {
+                _blocks.pop_front();
+                _droppedLines = 0;
+            }
+        }
+        else {
+            // only the uncompressed lines remain, they are removed
+            std::size_t const bytes = excess < _pendingOffsets.size()
+                ? _pendingOffsets[excess]
+                : _pending.size();
+            _pending.erase(_pending.begin(), _pending.begin() + std::ptrdiff_t(bytes));
+            _pendingOffsets.erase(_pendingOffsets.begin(), _pendingOffsets.begin() + std::ptrdiff_t(excess));
+            for (uint32_t & offset : _pendingOffsets) {
+                offset -= uint32_t(bytes);
+            }
+            _size -= excess;
+        }
+    }
+}
+
+
+void ScrollbackLines::clear()
+{
+    _cells.resize(0);
+    _lineStarts.assign(1, 0);
+    _properties.clear();
+    _styleTable.clear();
+    _extendedCharTable.clear();
+}
+
+}
@@ -0,0 +1,163 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#pragma once
+
+#include "rvt/screen.hpp"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+
+
+namespace rvt
+{
+
+class ScrollbackLines;
+
+/**
+ * History of the lines scrolled out of the top of a Screen, oldest first,
+ * bounded to maxLines() lines: the oldest lines are dropped first.
+ *
+ * A line is encoded with its styles as runs of resolved CharacterStyle and
+ * its extended characters inlined, so it does not depend on the tables of
+ * the screen. The lines are packed by blocks of linesByBlock lines which are
+ * compressed with lz::compress(), the last block is kept uncompressed until it is full.
+ *
+ * With setFile(), the compressed blocks are appended to a file and read back
+ * through a memory mapping: only the last block and the index of the blocks
+ * (a few bytes by block) stay in memory.
+ */
+class Scrollback
+{
+public:
+    static constexpr std::size_t linesByBlock = 64;
+
+    explicit Scrollback(std::size_t maxLines) noexcept;
+    ~Scrollback();
+
+    Scrollback(Scrollback const &) = delete;
+    Scrollback & operator=(Scrollback const &) = delete;
+
+    /// Appends a line, \c extendedChars is the table of the cells of \c line.
+    void push(ImageLine const & line, LineProperty property, ExtendedCharTable const & extendedChars);
+
+    /// Number of lines in the history.
+    std::size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return !_size; }
+
+    std::size_t maxLines() const noexcept { return _maxLines; }
+    void setMaxLines(std::size_t maxLines);
+
+    void clear() noexcept;
+
+    /**
+     * Replaces the content of \c lines with the lines [first, first + count)
+     * of the history, 0 is the oldest line. The range is clamped to size().
+     */
+    void readLines(std::size_t first, std::size_t count, ScrollbackLines & lines) const;
+
+    /// Bytes allocated by the history.
+    std::size_t memoryUsage() const noexcept;
+
+    /// Compresses the lines which are not yet in a block and releases the unused memory.
+    void shrinkToFit();
+
+    /**
+     * Stores the blocks in \c filename, which is created or truncated with \c mode.
+     * The blocks already in memory are moved to the file. The file is append-only:
+     * the blocks dropped from the history remain in it.
+     * Throws std::system_error when the file cannot be opened or written,
+     * push() also throws it when a block cannot be written.
+     */
+    void setFile(char const * filename, int mode);
+    bool hasFile() const noexcept { return bool(_file); }
+
+private:
+    struct Block
+    {
+        // nullptr when the block is in the file
+        std::unique_ptr<uint8_t[]> data;
+        uint64_t offset; // in the file
+        uint32_t size;
+        uint32_t lineCount;
+        uint32_t rawSize;
+    };
+
+    struct File;
+
+    // compressed bytes of the block
+    uint8_t const * blockData(Block const & block) const;
+
+    void compressPendingLines();
+    void dropOldLines();
+
+    // decodes the line which starts at p and appends it to lines when not null.
+    // Returns the end of the line
+    static uint8_t const * readLine(uint8_t const * p, ScrollbackLines * lines);
+
+    std::deque<Block> _blocks;
+    // lines of the last block, not yet compressed
+    std::vector<uint8_t> _pending;
+    std::vector<uint32_t> _pendingOffsets;
+    // number of lines of the first block which are no longer in the history
+    std::size_t _droppedLines = 0;
+    std::size_t _size = 0;
+    std::size_t _maxLines;
+    std::vector<uint8_t> _compressed;
+    std::unique_ptr<File> _file;
+};
+
+
+/// Lines decoded by Scrollback::readLines() with their own tables.
+class ScrollbackLines
+{
+public:
+    ImageLine operator[](std::size_t i) const noexcept
+    {
+        std::size_t const start = _lineStarts[i];
+        return ImageLine(
+            _cells.codePoints() + start, _cells.styles() + start, _cells.flags() + start,
+            _lineStarts[i + 1] - start, _styleTable);
+    }
+
+    LineProperty lineProperty(std::size_t i) const noexcept { return _properties[i]; }
+
+    std::size_t size() const noexcept { return _properties.size(); }
+    bool empty() const noexcept { return _properties.empty(); }
+
+    StyleTable const & styleTable() const noexcept { return _styleTable; }
+    ExtendedCharTable const & extendedCharTable() const noexcept { return _extendedCharTable; }
+
+    void clear();
+
+private:
+    friend class Scrollback;
+
+    CellArray _cells;
+    std::vector<std::size_t> _lineStarts {0}; // [size() + 1]
+    std::vector<LineProperty> _properties;
+    StyleTable _styleTable;
+    ExtendedCharTable _extendedCharTable;
+};
+
+}
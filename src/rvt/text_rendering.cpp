@@ -21,13 +21,18 @@
 #include "utils/sugar/numerics/safe_conversions.hpp"
 #include "rvt/text_rendering.hpp"
 
+#include "rvt/ascii_scan.hpp"
 #include "rvt/character.hpp"
+#include "rvt/char_width.hpp"
 #include "rvt/screen.hpp"
+#include "rvt/scrollback.hpp"
 
 #include "rvt/ucs.hpp"
 #include "rvt/utf8_decoder.hpp"
 
+#include <algorithm>
 #include <charconv>
+#include <cstdlib>
 
 namespace rvt {
 
@@ -135,14 +140,14 @@ struct RenderingBuffer2
         }
     }
 
-    void unsafe_push_quoted_character(Character const & ch, const rvt::ExtendedCharTable & extended_char_table, std::size_t extra_capacity)
+    void unsafe_push_quoted_character(ucs4_char ch, CellFlags flags, const rvt::ExtendedCharTable & extended_char_table, std::size_t extra_capacity)
     {
-        if (ch.isRealCharacter) {
-            if (REDEMPTION_UNLIKELY(ch.is_extended())) {
-                this->push_ucs_array(extended_char_table[ch.character], extra_capacity);
+        if (bool(flags & CellFlags::Real)) {
+            if (REDEMPTION_UNLIKELY(bool(flags & CellFlags::Extended))) {
+                this->push_ucs_array(extended_char_table[ch], extra_capacity);
             }
             else {
-                this->unsafe_push_quoted_ucs(ch.character);
+                this->unsafe_push_quoted_ucs(ch);
             }
         }
         else {
@@ -151,6 +156,36 @@ struct RenderingBuffer2
         }
     }
 
+    // characters of n cells, at most 4 bytes by cell except for the extended characters
+    // \pre remaining() >= n * 4 + reserved
+    void unsafe_push_quoted_cells(
+        ucs4_char const * code_points, CellFlags const * flags, std::size_t n,
+        const rvt::ExtendedCharTable & extended_char_table, std::size_t reserved)
+    {
+        assert(remaining() >= n * 4 + reserved);
+        auto const flags_u8 = reinterpret_cast<uint8_t const *>(flags);
+        std::size_t i = 0;
+        while (i < n) {
+            // printable ASCII characters without escape
+            auto const ascii_end = find_json_non_plain_ascii(code_points + i, code_points + n);
+            auto const real_end = find_not_equal(
+                flags_u8 + i, flags_u8 + (ascii_end - code_points), uint8_t(CellFlags::Real));
+            auto const plain_end = std::size_t(real_end - flags_u8);
+            _p = narrow_ascii(code_points + i, code_points + plain_end, _p);
+            i = plain_end;
+
+            if (i != n) {
+                bool const is_extended = bool(flags[i] & CellFlags::Extended);
+                unsafe_push_quoted_character(code_points[i], flags[i], extended_char_table, 4096);
+                ++i;
+                if (REDEMPTION_UNLIKELY(is_extended)) {
+                    std::size_t const len = (n - i) * 4 + reserved;
+                    prepare_buffer(len, std::max(len, std::size_t(4096)));
+                }
+            }
+        }
+    }
+
     void unsafe_push_quoted_ucs_array(ucs4_carray_view ucs_array)
     {
         for (ucs4_char ucs : ucs_array) {
@@ -289,12 +324,166 @@ private:
 
 }
 
+// Strings of the style changes of a rendering, indexed by the previous and the
+// new style: a change which comes back costs one copy. The table is
+// direct-mapped, a collision renders the string again.
+class StyleChangeCache
+{
+public:
+    static constexpr std::size_t max_length = 64;
+
+    StyleChangeCache() noexcept
+    {
+        clear();
+    }
+
+    // for a new style table
+    void clear() noexcept
+    {
+        for (Entry & entry : _entries) {
+            entry.key = ~uint64_t();
+        }
+    }
+
+    // render(RenderingBuffer2&) writes the string of the change, at most max_length bytes
+    template<class Render>
+    chars_view get(rvt::StyleId previous_style, rvt::StyleId style, Render && render)
+    {
+        uint64_t const key = uint64_t(previous_style) << 16 | style;
+        Entry & entry = _entries[(previous_style * 31u + style) % nb_entries];
+        if (entry.key != key) {
+            RenderingBuffer2 buf{RenderingBuffer{nullptr, entry.data, max_length, nullptr, nullptr}};
+            render(buf);
+            entry.length = uint8_t(buf.buffer_length());
+            entry.key = key;
+        }
+        return chars_view{entry.data, entry.length};
+    }
+
+private:
+    static constexpr std::size_t nb_entries = 64;
+
+    struct Entry
+    {
+        uint64_t key;
+        uint8_t length;
+        char data[max_length];
+    };
+
+    Entry _entries[nb_entries];
+};
+
+static uint32_t color2int(rvt::Color const & color)
+{
+    return uint32_t((color.red() << 16) | (color.green() << 8) |  (color.blue() << 0));
+}
+
+constexpr std::size_t json_max_size_by_loop = 111; // approximate
+
+// $line without the styles of \c previous_style
+static void json_push_line(
+    RenderingBuffer2 & buf,
+    ImageLine const & line,
+    rvt::StyleTable const & styles,
+    rvt::ExtendedCharTable const & extended_char_table,
+    ColorTableView palette,
+    StyleChangeCache & style_changes,
+    rvt::StyleId & previous_style
+) {
+    constexpr std::size_t max_size_by_loop = json_max_size_by_loop;
+
+    buf.unsafe_push_s("[[{"_av);
+
+    bool is_s_enable = false;
+    auto const code_points = line.codePoints();
+    auto const flags = line.flags();
+    rvt::StyleId const * const line_styles = line.styles().begin();
+    rvt::StyleId const * const line_styles_end = line.styles().end();
+    for (rvt::StyleId const * run = line_styles; run != line_styles_end; ) {
+        rvt::StyleId const * const run_end = rvt::find_style_run_end(run, line_styles_end);
+
+        buf.prepare_buffer(max_size_by_loop, 4096);
+
+        if (*run != previous_style) {
+            // empty when the format is the same
+            chars_view const format = style_changes.get(previous_style, *run, [&](RenderingBuffer2 & format_buf) {
+                constexpr auto rendition_flags
+                    = rvt::Rendition::Bold
+                    | rvt::Rendition::Italic
+                    | rvt::Rendition::Underline
+                    | rvt::Rendition::Blink;
+                rvt::CharacterStyle const & ch = styles[*run];
+                rvt::CharacterStyle const & previous_ch = styles[previous_style];
+                bool const is_same_bg = ch.backgroundColor == previous_ch.backgroundColor;
+                bool const is_same_fg = ch.foregroundColor == previous_ch.foregroundColor;
+                bool const is_same_rendition
+                    = (ch.rendition & rendition_flags) == (previous_ch.rendition & rendition_flags);
+
+                if (!is_same_rendition) {
+                    int const r = (0
+                        | (bool(ch.rendition & rvt::Rendition::Bold)      ? 1 : 0)
+                        | (bool(ch.rendition & rvt::Rendition::Italic)    ? 2 : 0)
+                        | (bool(ch.rendition & rvt::Rendition::Underline) ? 4 : 0)
+                        | (bool(ch.rendition & rvt::Rendition::Blink)     ? 8 : 0)
+                    );
+                    if (r < 10) {
+                        format_buf.unsafe_push_values("\"r\":"_av, char(r + '0'), ',');
+                    }
+                    else {
+                        format_buf.unsafe_push_values("\"r\":"_av, '1', char(r - 10 + '0'), ',');
+                    }
+                }
+
+                if (!is_same_fg) {
+                    format_buf.unsafe_push_values("\"f\":"_av,
+                        color2int(ch.foregroundColor.color(palette)), ',');
+                }
+                if (!is_same_bg) {
+                    format_buf.unsafe_push_values("\"b\":"_av,
+                        color2int(ch.backgroundColor.color(palette)), ',');
+                }
+            });
+
+            if (!format.empty()) {
+                if (is_s_enable) {
+                    buf.unsafe_push_s("\"},{"_av);
+                }
+                buf.unsafe_push_s(format);
+                is_s_enable = false;
+            }
+
+            previous_style = *run;
+        }
+
+        if (!is_s_enable) {
+            is_s_enable = true;
+            buf.unsafe_push_s(R"("s":")"_av);
+        }
+
+        auto const i = std::size_t(run - line_styles);
+        auto const n = std::size_t(run_end - run);
+        std::size_t const len = n * 4 + max_size_by_loop;
+        buf.prepare_buffer(len, std::max(len, std::size_t(4096)));
+        buf.unsafe_push_quoted_cells(code_points.begin() + i, flags.begin() + i, n,
+                                     extended_char_table, max_size_by_loop);
+
+        run = run_end;
+    }
+
+    buf.prepare_buffer(max_size_by_loop, 4096);
+    if (is_s_enable) {
+        buf.unsafe_push_c('"');
+    }
+    buf.unsafe_push_s("}]]"_av);
+}
+
 // format = "{
 //      $cursor,
 //      lines: %d,
 //      columns: %d,
 //      title: %s,
 //      style: {$render $foreground $background},
+//      history: [ $line... ] // if history != nullptr
 //      data: [ $line... ]
 //      extra: extra_data // if extra_data != nullptr
 // }"
@@ -310,17 +499,15 @@ private:
 // $background = "b: $color"
 // $color = %d
 //      decimal rgb
-void json_rendering(
+template<class ScreenT>
+static void json_rendering_impl(
     ucs4_carray_view title,
-    Screen const & screen,
+    ScreenT const & screen,
+    rvt::ScrollbackLines const * history,
     ColorTableView palette,
     RenderingBuffer buffer,
     std::string_view extra_data
 ) {
-    auto color2int = [](rvt::Color const & color){
-        return uint32_t((color.red() << 16) | (color.green() << 8) |  (color.blue() << 0));
-    };
-
     RenderingBuffer2 buf{buffer};
 
     buf.prepare_buffer(4096, std::max(title.size() * 4 + 512, std::size_t(4096)));
@@ -338,77 +525,38 @@ void json_rendering(
     buf.unsafe_push_quoted_ucs_array(title);
     buf.unsafe_push_values("\",\"style\":{\"r\":0"
                            ",\"f\":"_av, color2int(palette[0]),
-                           ",\"b\":"_av, color2int(palette[1]), "},\"data\":["_av);
+                           ",\"b\":"_av, color2int(palette[1]), "},"_av);
 
-    constexpr std::size_t max_size_by_loop = 111; // approximate
+    StyleChangeCache style_changes;
 
-    if (screen.getColumns() && screen.getLines()) {
-        rvt::Character const default_ch; // Default format
-        rvt::Character const* previous_ch = &default_ch;
-
-        for (auto const & line : screen.getScreenLines()) {
-            buf.unsafe_push_s("[[{"_av);
-
-            bool is_s_enable = false;
-            for (rvt::Character const & ch : line) {
-                buf.prepare_buffer(max_size_by_loop, 4096);
-
-                constexpr auto rendition_flags
-                    = rvt::Rendition::Bold
-                    | rvt::Rendition::Italic
-                    | rvt::Rendition::Underline
-                    | rvt::Rendition::Blink;
-                bool const is_same_bg = ch.backgroundColor == previous_ch->backgroundColor;
-                bool const is_same_fg = ch.foregroundColor == previous_ch->foregroundColor;
-                bool const is_same_rendition
-                    = (ch.rendition & rendition_flags) == (previous_ch->rendition & rendition_flags);
-                bool const is_same_format = is_same_bg & is_same_fg & is_same_rendition;
-                if (!is_same_format) {
-                    if (is_s_enable) {
-                        buf.unsafe_push_s("\"},{"_av);
-                    }
-                    if (!is_same_rendition) {
-                        int const r = (0
-                            | (bool(ch.rendition & rvt::Rendition::Bold)      ? 1 : 0)
-                            | (bool(ch.rendition & rvt::Rendition::Italic)    ? 2 : 0)
-                            | (bool(ch.rendition & rvt::Rendition::Underline) ? 4 : 0)
-                            | (bool(ch.rendition & rvt::Rendition::Blink)     ? 8 : 0)
-                        );
-                        if (r < 10) {
-                            buf.unsafe_push_values("\"r\":"_av, char(r + '0'), ',');
-                        }
-                        else {
-                            buf.unsafe_push_values("\"r\":"_av, '1', char(r - 10 + '0'), ',');
-                        }
-                    }
-
-                    if (!is_same_fg) {
-                        buf.unsafe_push_values("\"f\":"_av,
-                            color2int(ch.foregroundColor.color(palette)), ',');
-                    }
-                    if (!is_same_bg) {
-                        buf.unsafe_push_values("\"b\":"_av,
-                            color2int(ch.backgroundColor.color(palette)), ',');
-                    }
+    if (history) {
+        buf.unsafe_push_s("\"history\":["_av);
+        if (!history->empty()) {
+            rvt::StyleId previous_style = rvt::StyleTable::DefaultStyle;
 
-                    is_s_enable = false;
-                }
+            for (std::size_t y = 0; y < history->size(); ++y) {
+                json_push_line(buf, (*history)[y], history->styleTable(), history->extendedCharTable(),
+                               palette, style_changes, previous_style);
+                buf.unsafe_push_c(',');
+            }
 
-                if (!is_s_enable) {
-                    is_s_enable = true;
-                    buf.unsafe_push_s(R"("s":")"_av);
-                }
+            buf.pop_c();
+        }
+        buf.prepare_buffer(16, 4096);
+        buf.unsafe_push_s("],"_av);
+        // the styles of the screen are another table
+        style_changes.clear();
+    }
 
-                buf.unsafe_push_quoted_character(ch, screen.extendedCharTable(), 4096);
+    buf.unsafe_push_s("\"data\":["_av);
 
-                previous_ch = &ch;
-            }
+    if (screen.getColumns() && screen.getLines()) {
+        rvt::StyleId previous_style = rvt::StyleTable::DefaultStyle; // Default format
 
-            buf.prepare_buffer(max_size_by_loop, 4096);
-            if (is_s_enable) {
-                buf.unsafe_push_c('"');
-            }
-            buf.unsafe_push_s("}]],"_av);
+        for (auto const & line : screen.getScreenLines()) {
+            json_push_line(buf, line, screen.styleTable(), screen.extendedCharTable(),
+                           palette, style_changes, previous_style);
+            buf.unsafe_push_c(',');
         }
 
         buf.pop_c();
@@ -428,9 +576,222 @@ void json_rendering(
 }
 
 
-void ansi_rendering(
+namespace
+{
+    struct LineHasher
+    {
+        void mix(uint64_t x) noexcept
+        {
+            h = ((h << 5 | h >> 59) ^ x) * 0x9E3779B97F4A7C15u;
+        }
+
+        uint64_t value() const noexcept
+        {
+            uint64_t x = h;
+            x ^= x >> 32;
+            x *= 0xD6E8FEB86659FD93u;
+            x ^= x >> 32;
+            return x;
+        }
+
+        uint64_t h;
+    };
+}
+
+// the styles are hashed by value, the ids are not stable over a compaction of the style table
+static uint64_t hash_line(
+    ImageLine const & line,
+    rvt::StyleTable const & styles,
+    rvt::ExtendedCharTable const & extended_char_table
+) noexcept {
+    LineHasher hasher{line.size()};
+
+    auto const code_points = line.codePoints();
+    auto const flags = line.flags();
+    rvt::StyleId const * const line_styles = line.styles().begin();
+    rvt::StyleId const * const line_styles_end = line.styles().end();
+    for (rvt::StyleId const * run = line_styles; run != line_styles_end; ) {
+        rvt::StyleId const * const run_end = rvt::find_style_run_end(run, line_styles_end);
+
+        rvt::CharacterStyle const & style = styles[*run];
+        hasher.mix(uint64_t(style.foregroundColor.packed()) << 32 | style.backgroundColor.packed());
+        hasher.mix(uint64_t(style.rendition) << 32 | uint64_t(run_end - run));
+
+        for (auto i = std::size_t(run - line_styles); i < std::size_t(run_end - line_styles); ++i) {
+            if (REDEMPTION_UNLIKELY(bool(flags[i] & CellFlags::Extended))) {
+                for (ucs4_char ucs : extended_char_table[code_points[i]]) {
+                    hasher.mix(ucs);
+                }
+            }
+            hasher.mix(uint64_t(flags[i]) << 32 | code_points[i]);
+        }
+
+        run = run_end;
+    }
+
+    return hasher.value();
+}
+
+// returns n such as the line y of \c new_hashes is the line y+n of \c old_hashes
+// for most of the lines which are not empty, 0 when no scrolling is found
+static int find_scrolling(
+    std::vector<uint64_t> const & old_hashes,
+    std::vector<uint64_t> const & new_hashes,
+    uint64_t empty_line_hash
+) noexcept {
+    assert(old_hashes.size() == new_hashes.size());
+    int const lines = int(new_hashes.size());
+
+    auto count_same_lines = [&](int n){
+        int count = 0;
+        for (int y = std::max(0, -n), end = std::min(lines, lines - n); y < end; ++y) {
+            count += (new_hashes[y] == old_hashes[y + n] && new_hashes[y] != empty_line_hash);
+        }
+        return count;
+    };
+
+    int best_n = 0;
+    int best_count = count_same_lines(0);
+    // lines - n is the maximum of count_same_lines(n)
+    for (int n = 1; n < lines && lines - n > best_count; ++n) {
+        for (int signed_n : {n, -n}) {
+            int const count = count_same_lines(signed_n);
+            if (count > best_count) {
+                best_count = count;
+                best_n = signed_n;
+            }
+        }
+    }
+
+    return best_n;
+}
+
+// format = "{
+//      patch: [ [ %d, $line ]... ],  // line number and its new content
+//      scroll: %d,                   // if != 0
+//      $cursor,                      // if changed
+//      title: %s,                    // if changed
+//      extra: extra_data             // if extra_data != nullptr
+// }" | $keyframe
+// $keyframe = format of json_rendering
+// $line, $cursor = see json_rendering, the styles of $line are relative to
+//      the default style of the last keyframe
+// scroll = lines move up by n (down when negative) before the patch is applied,
+//      the uncovered lines are empty
+template<class ScreenT>
+static void json_patch_rendering_impl(
     ucs4_carray_view title,
-    Screen const & screen,
+    ScreenT const & screen,
+    ColorTableView palette,
+    RenderingBuffer buffer,
+    JsonPatchState & state,
+    std::string_view extra_data
+) {
+    int const lines = screen.getLines();
+    int const cursor_x = screen.hasCursorVisible() ? screen.getCursorX() : -1;
+    int const cursor_y = screen.hasCursorVisible() ? screen.getCursorY() : -1;
+    rvt::StyleTable const & styles = screen.styleTable();
+    rvt::ExtendedCharTable const & extended_char_table = screen.extendedCharTable();
+
+    auto& hashes = state.newLineHashes;
+    hashes.clear();
+    for (auto const & line : screen.getScreenLines()) {
+        hashes.push_back(hash_line(line, styles, extended_char_table));
+    }
+
+    bool const is_keyframe
+        = lines != state.lines
+       || screen.getColumns() != state.columns
+       || (state.keyframeInterval && state.renderingsSinceKeyframe + 1 >= state.keyframeInterval);
+
+    if (is_keyframe) {
+        json_rendering_impl(title, screen, nullptr, palette, buffer, extra_data);
+        state.renderingsSinceKeyframe = 0;
+    }
+    else {
+        uint64_t const empty_line_hash = LineHasher{0}.value();
+        int const scroll = find_scrolling(state.lineHashes, hashes, empty_line_hash);
+
+        RenderingBuffer2 buf{buffer};
+
+        buf.prepare_buffer(4096, 4096);
+        buf.unsafe_push_s("{\"patch\":["_av);
+
+        bool has_line = false;
+        StyleChangeCache style_changes;
+        auto const&& screen_lines = screen.getScreenLines();
+        for (int y = 0; y < lines; ++y) {
+            int const old_y = y + scroll;
+            uint64_t const old_hash = (old_y >= 0 && old_y < lines)
+                ? state.lineHashes[old_y]
+                : empty_line_hash;
+            if (hashes[y] != old_hash) {
+                has_line = true;
+                buf.prepare_buffer(json_max_size_by_loop, 4096);
+                buf.unsafe_push_values('[', y, ',');
+                rvt::StyleId previous_style = rvt::StyleTable::DefaultStyle;
+                json_push_line(buf, screen_lines[y], styles, extended_char_table,
+                               palette, style_changes, previous_style);
+                buf.unsafe_push_values(']', ',');
+            }
+        }
+        if (has_line) {
+            buf.pop_c();
+        }
+
+        bool const is_same_title = state.title.size() == title.size()
+            && std::equal(title.begin(), title.end(), state.title.begin());
+
+        buf.prepare_buffer(
+            (is_same_title ? 0 : title.size() * 4) + extra_data.size() + 128,
+            std::max((is_same_title ? 0 : title.size() * 4) + extra_data.size() + 128, std::size_t(4096)));
+        buf.unsafe_push_c(']');
+
+        if (scroll) {
+            buf.unsafe_push_values(",\"scroll\":"_av, scroll);
+        }
+
+        if (cursor_x != state.cursorX || cursor_y != state.cursorY) {
+            if (cursor_y >= 0) {
+                buf.unsafe_push_values(",\"x\":"_av, cursor_x, ",\"y\":"_av, cursor_y);
+            }
+            else {
+                buf.unsafe_push_s(R"(,"y":-1)"_av);
+            }
+        }
+
+        if (!is_same_title) {
+            buf.unsafe_push_s(",\"title\":\""_av);
+            buf.unsafe_push_quoted_ucs_array(title);
+            buf.unsafe_push_c('"');
+        }
+
+        if (!extra_data.empty()) {
+            buf.unsafe_push_s(",\"extra\":"_av);
+            buf.unsafe_push_s(extra_data);
+        }
+
+        buf.unsafe_push_c('}');
+
+        buf.set_final();
+
+        ++state.renderingsSinceKeyframe;
+    }
+
+    // only updated when the rendering succeeded
+    state.lineHashes.swap(hashes);
+    state.title.assign(title.begin(), title.end());
+    state.lines = lines;
+    state.columns = screen.getColumns();
+    state.cursorX = cursor_x;
+    state.cursorY = cursor_y;
+}
+
+
+template<class ScreenT>
+static void ansi_rendering_impl(
+    ucs4_carray_view title,
+    ScreenT const & screen,
     ColorTableView palette,
     RenderingBuffer buffer,
     std::string_view extra_data
@@ -448,37 +809,55 @@ void ansi_rendering(
     buf.prepare_buffer(4096, 4096);
     buf.push_values('\033', ']', title, '\a');
 
-    rvt::Character const default_ch; // Default format
-    rvt::Character const* previous_ch = &default_ch;
+    rvt::StyleTable const & styles = screen.styleTable();
+    rvt::StyleId previous_style = rvt::StyleTable::DefaultStyle; // Default format
+    bool previous_is_extended = false;
+    StyleChangeCache style_changes;
 
     constexpr std::size_t max_size_by_loop = 64; // approximate
 
     for (auto const & line : screen.getScreenLines()) {
-        for (rvt::Character const & ch : line) {
-            buf.prepare_buffer(max_size_by_loop, 4096);
-
-            bool const is_same_bg = ch.backgroundColor == previous_ch->backgroundColor;
-            bool const is_same_fg = ch.foregroundColor == previous_ch->foregroundColor;
-            bool const is_same_rendition = ch.rendition == previous_ch->rendition;
-            bool const is_same_format = is_same_bg & is_same_fg & is_same_rendition;
-            if (!is_same_format) {
-                buf.unsafe_push_s("\033[0"_av);
+        auto const code_points = line.codePoints();
+        auto const flags = line.flags();
+        rvt::StyleId const * const line_styles = line.styles().begin();
+        rvt::StyleId const * const line_styles_end = line.styles().end();
+        for (rvt::StyleId const * run = line_styles; run != line_styles_end; ) {
+            rvt::StyleId const * const run_end = rvt::find_style_run_end(run, line_styles_end);
+            rvt::CharacterStyle const & ch = styles[*run];
+            rvt::CharacterStyle const & previous_ch = styles[previous_style];
+            bool is_same_style = *run == previous_style;
+
+            for (auto i = std::size_t(run - line_styles); i < std::size_t(run_end - line_styles); ++i) {
+                buf.prepare_buffer(max_size_by_loop, 4096);
+
+                // the ExtendedChar flag is part of the rendition
+                bool const is_extended = bool(flags[i] & CellFlags::Extended);
+                bool const is_same_format = is_same_style & (is_extended == previous_is_extended);
                 if (!is_same_format) {
-                    auto const r = ch.rendition;
-                    if (bool(r & rvt::Rendition::Bold))     { buf.unsafe_push_s(";1"_av); }
-                    if (bool(r & rvt::Rendition::Italic))   { buf.unsafe_push_s(";3"_av); }
-                    if (bool(r & rvt::Rendition::Underline)){ buf.unsafe_push_s(";4"_av); }
-                    if (bool(r & rvt::Rendition::Blink))    { buf.unsafe_push_s(";5"_av); }
-                    if (bool(r & rvt::Rendition::Reverse))  { buf.unsafe_push_s(";6"_av); }
+                    auto const previous_id = is_same_style ? *run : previous_style;
+                    buf.unsafe_push_s(style_changes.get(previous_id, *run, [&](RenderingBuffer2 & sgr_buf) {
+                        bool const is_same_bg = is_same_style || ch.backgroundColor == previous_ch.backgroundColor;
+                        bool const is_same_fg = is_same_style || ch.foregroundColor == previous_ch.foregroundColor;
+                        sgr_buf.unsafe_push_s("\033[0"_av);
+                        auto const r = ch.rendition;
+                        if (bool(r & rvt::Rendition::Bold))     { sgr_buf.unsafe_push_s(";1"_av); }
+                        if (bool(r & rvt::Rendition::Italic))   { sgr_buf.unsafe_push_s(";3"_av); }
+                        if (bool(r & rvt::Rendition::Underline)){ sgr_buf.unsafe_push_s(";4"_av); }
+                        if (bool(r & rvt::Rendition::Blink))    { sgr_buf.unsafe_push_s(";5"_av); }
+                        if (bool(r & rvt::Rendition::Reverse))  { sgr_buf.unsafe_push_s(";6"_av); }
+                        if (!is_same_fg) write_color(sgr_buf, '3', ch.foregroundColor);
+                        if (!is_same_bg) write_color(sgr_buf, '4', ch.backgroundColor);
+                        sgr_buf.unsafe_push_c('m');
+                    }));
+                    is_same_style = true;
+                    previous_is_extended = is_extended;
                 }
-                if (!is_same_fg) write_color(buf, '3', ch.foregroundColor);
-                if (!is_same_bg) write_color(buf, '4', ch.backgroundColor);
-                buf.unsafe_push_c('m');
-            }
 
-            buf.unsafe_push_quoted_character(ch, screen.extendedCharTable(), 4096);
+                buf.unsafe_push_quoted_character(code_points[i], flags[i], screen.extendedCharTable(), 4096);
+            }
 
-            previous_ch = &ch;
+            previous_style = *run;
+            run = run_end;
         }
 
         buf.prepare_buffer(max_size_by_loop, 4096);
@@ -494,26 +873,521 @@ void ansi_rendering(
 }
 
 
+static bool is_blank_cell(AnsiDiffState::Cell const & cell) noexcept
+{
+    return cell.ch == ' ' && !cell.extendedLength && !cell.isWideContinuation
+        && cell.style == CharacterStyle();
+}
+
+static bool is_same_cell(
+    AnsiDiffState::Cell const & a, ucs4_char const * a_chars,
+    AnsiDiffState::Cell const & b, ucs4_char const * b_chars
+) noexcept {
+    if (a.style != b.style
+     || a.isWideContinuation != b.isWideContinuation
+     || a.extendedLength != b.extendedLength
+    ) {
+        return false;
+    }
+    if (!a.extendedLength) {
+        return a.ch == b.ch;
+    }
+    return std::equal(a_chars + a.ch, a_chars + a.ch + a.extendedLength, b_chars + b.ch);
+}
+
+// lines * columns cells, the cells after the end of a line are blank
+template<class ScreenT>
+static void ansi_diff_fill_cells(
+    ScreenT const & screen,
+    std::vector<AnsiDiffState::Cell> & cells,
+    std::vector<ucs4_char> & chars
+) {
+    rvt::StyleTable const & styles = screen.styleTable();
+    rvt::ExtendedCharTable const & extended_char_table = screen.extendedCharTable();
+    auto const columns = std::size_t(screen.getColumns());
+
+    cells.clear();
+    chars.clear();
+    cells.reserve(std::size_t(screen.getLines()) * columns);
+
+    for (auto const & line : screen.getScreenLines()) {
+        auto const code_points = line.codePoints();
+        auto const flags = line.flags();
+        auto const line_styles = line.styles();
+        std::size_t const len = std::min(line.size(), columns);
+        bool previous_is_wide = false;
+        for (std::size_t i = 0; i < len; ++i) {
+            AnsiDiffState::Cell cell{styles[line_styles[i]]};
+            ucs4_char first_ch = ' ';
+            if (bool(flags[i] & CellFlags::Real)) {
+                if (REDEMPTION_UNLIKELY(bool(flags[i] & CellFlags::Extended))) {
+                    auto const ucs_array = extended_char_table[code_points[i]];
+                    if (!ucs_array.empty()) {
+                        cell.ch = ucs4_char(chars.size());
+                        cell.extendedLength = uint32_t(ucs_array.size());
+                        chars.insert(chars.end(), ucs_array.begin(), ucs_array.end());
+                        first_ch = ucs_array[0];
+                    }
+                }
+                else {
+                    cell.ch = code_points[i];
+                    first_ch = code_points[i];
+                }
+            }
+            else {
+                cell.isWideContinuation = previous_is_wide;
+            }
+            previous_is_wide = char_width(first_ch) == 2;
+            // a wide character without its right half (overwritten or cut by
+            // a resize) would be written over the next cell: it is blanked
+            if (previous_is_wide && (i + 1 == len || bool(flags[i + 1] & CellFlags::Real))) {
+                chars.resize(chars.size() - cell.extendedLength);
+                cell.ch = ' ';
+                cell.extendedLength = 0;
+                previous_is_wide = false;
+            }
+            cells.push_back(cell);
+        }
+        cells.resize(cells.size() + columns - len);
+    }
+}
+
+// code of the color when the rendition is not reversed
+static void push_sgr_color(RenderingBuffer2 & buf, bool is_foreground, CharacterColor const & color)
+{
+    int32_t const value = color.value();
+    switch (color.colorSpace()) {
+        case ColorSpace::Undefined:
+        case ColorSpace::Default:
+            buf.unsafe_push_values(is_foreground ? '3' : '4', '9', ';');
+            break;
+        case ColorSpace::System:
+            buf.unsafe_push_values(
+                (value < 8 ? (is_foreground ? 30 : 40) : (is_foreground ? 90 : 100)) + (value & 7), ';');
+            break;
+        case ColorSpace::Index256:
+            buf.unsafe_push_values(is_foreground ? '3' : '4', "8;5;"_av, value, ';');
+            break;
+        case ColorSpace::RGB:
+            buf.unsafe_push_values(is_foreground ? '3' : '4', "8;2;"_av,
+                (value >> 16) & 0xff, ';', (value >> 8) & 0xff, ';', value & 0xff, ';');
+            break;
+    }
+}
+
+// the colors of a style are already reversed and intensified by the bold rendition,
+// the sent colors are those which give the same style with the rendition
+static void push_sgr(RenderingBuffer2 & buf, CharacterStyle const & from, CharacterStyle const & to)
+{
+    constexpr auto rendition_flags
+        = rvt::Rendition::Bold
+        | rvt::Rendition::Dim
+        | rvt::Rendition::Italic
+        | rvt::Rendition::Underline
+        | rvt::Rendition::Blink
+        | rvt::Rendition::Reverse;
+
+    struct SgrColors
+    {
+        CharacterColor const & foreground;
+        CharacterColor const & background;
+    };
+
+    auto sgr_colors = [](CharacterStyle const & style){
+        return bool(style.rendition & rvt::Rendition::Reverse)
+            ? SgrColors{style.backgroundColor, style.foregroundColor}
+            : SgrColors{style.foregroundColor, style.backgroundColor};
+    };
+
+    // the dim and intensive flags come from the rendition
+    auto is_same_color = [](CharacterColor const & a, CharacterColor const & b){
+        return a.colorSpace() == b.colorSpace() && a.value() == b.value();
+    };
+
+    auto const from_rendition = from.rendition & rendition_flags;
+    auto const to_rendition = to.rendition & rendition_flags;
+    bool const is_reset = bool(from_rendition & ~to_rendition);
+
+    CharacterStyle const default_style {};
+    SgrColors const from_colors = sgr_colors(is_reset ? default_style : from);
+    SgrColors const to_colors = sgr_colors(to);
+    auto const added = is_reset ? to_rendition : to_rendition & ~from_rendition;
+    bool const is_same_fg = is_same_color(from_colors.foreground, to_colors.foreground);
+    bool const is_same_bg = is_same_color(from_colors.background, to_colors.background);
+
+    if (!is_reset && !bool(added) && is_same_fg && is_same_bg) {
+        return;
+    }
+
+    buf.unsafe_push_s("\033["_av);
+    if (is_reset) { buf.unsafe_push_s("0;"_av); }
+    if (bool(added & rvt::Rendition::Bold))     { buf.unsafe_push_s("1;"_av); }
+    if (bool(added & rvt::Rendition::Dim))      { buf.unsafe_push_s("2;"_av); }
+    if (bool(added & rvt::Rendition::Italic))   { buf.unsafe_push_s("3;"_av); }
+    if (bool(added & rvt::Rendition::Underline)){ buf.unsafe_push_s("4;"_av); }
+    if (bool(added & rvt::Rendition::Blink))    { buf.unsafe_push_s("5;"_av); }
+    if (bool(added & rvt::Rendition::Reverse))  { buf.unsafe_push_s("7;"_av); }
+    if (!is_same_fg) { push_sgr_color(buf, true, to_colors.foreground); }
+    if (!is_same_bg) { push_sgr_color(buf, false, to_colors.background); }
+    buf.pop_c();
+    buf.unsafe_push_c('m');
+}
+
+template<class ScreenT>
+static void ansi_diff_rendering_impl(
+    ucs4_carray_view title,
+    ScreenT const & screen,
+    RenderingBuffer buffer,
+    AnsiDiffState & state,
+    std::string_view extra_data
+) {
+    using Cell = AnsiDiffState::Cell;
+
+    int const lines = screen.getLines();
+    int const columns = screen.getColumns();
+    auto const ucolumns = std::size_t(columns);
+
+    ansi_diff_fill_cells(screen, state.newCells, state.newExtendedChars);
+
+    auto& hashes = state.newLineHashes;
+    hashes.clear();
+    for (auto const & line : screen.getScreenLines()) {
+        hashes.push_back(hash_line(line, screen.styleTable(), screen.extendedCharTable()));
+    }
+
+    RenderingBuffer2 buf{buffer};
+
+    buf.prepare_buffer(4096, std::max(title.size() * 4 + 512, std::size_t(4096)));
+
+    // state of the terminal, cur_x = -1 when the position is unknown
+    CharacterStyle style = state.style;
+    int cur_x = state.cursorX;
+    int cur_y = state.cursorY;
+
+    bool const is_redraw = lines != state.lines || columns != state.columns;
+
+    try {
+        if (is_redraw) {
+            buf.unsafe_push_s("\033[0m\033[H\033[2J"_av);
+            style = CharacterStyle();
+            cur_x = 0;
+            cur_y = 0;
+            state.cells.assign(std::size_t(lines) * ucolumns, Cell());
+            state.extendedChars.clear();
+        }
+
+        if (is_redraw || !std::equal(title.begin(), title.end(), state.title.begin(), state.title.end())) {
+            buf.unsafe_push_s("\033]2;"_av);
+            buf.unsafe_push_ucs_array(title);
+            buf.unsafe_push_c('\a');
+        }
+
+        if (!is_redraw) {
+            uint64_t const empty_line_hash = LineHasher{0}.value();
+            int const n = find_scrolling(state.lineHashes, hashes, empty_line_hash);
+            if (n) {
+                // scrolling region of the moved lines
+                int first = lines;
+                int last = -1;
+                for (int y = std::max(0, -n), end = std::min(lines, lines - n); y < end; ++y) {
+                    if (hashes[y] == state.lineHashes[y + n] && hashes[y] != empty_line_hash) {
+                        first = std::min(first, y);
+                        last = y;
+                    }
+                }
+                int const count = std::abs(n);
+                int top = (n > 0) ? first : first + n;
+                int bottom = (n > 0) ? last + n : last;
+                // the whole screen scrolls when no line kept outside the region would be lost
+                bool is_full_region = true;
+                for (int y = 0; y < lines && is_full_region; ++y) {
+                    if (y < top || y > bottom) {
+                        is_full_region = (hashes[y] != state.lineHashes[y] || hashes[y] == empty_line_hash);
+                    }
+                }
+                if (is_full_region) {
+                    top = 0;
+                    bottom = lines - 1;
+                }
+
+                // the new lines take the background of the current rendition
+                if (style != CharacterStyle()) {
+                    buf.unsafe_push_s("\033[0m"_av);
+                    style = CharacterStyle();
+                }
+                if (!is_full_region) {
+                    // the cursor goes to the home position
+                    buf.unsafe_push_values("\033["_av, top + 1, ';', bottom + 1, 'r');
+                    cur_x = -1;
+                    cur_y = -1;
+                }
+                buf.unsafe_push_values("\033["_av, count, (n > 0) ? 'S' : 'T');
+                if (!is_full_region) {
+                    buf.unsafe_push_s("\033[r"_av);
+                }
+
+                auto row = [&](int y){ return state.cells.begin() + y * columns; };
+                if (n > 0) {
+                    std::copy(row(top + count), row(bottom + 1), row(top));
+                    std::fill(row(bottom + 1 - count), row(bottom + 1), Cell());
+                }
+                else {
+                    std::copy_backward(row(top), row(bottom + 1 - count), row(bottom + 1));
+                    std::fill(row(top), row(top + count), Cell());
+                }
+            }
+        }
+
+        constexpr std::size_t max_size_by_loop = 128; // approximate
+
+        auto move_to = [&](int x, int y){
+            if (x == cur_x && y == cur_y) {
+                return;
+            }
+            if (y == cur_y && cur_x >= 0) {
+                if (x == 0) {
+                    buf.unsafe_push_c('\r');
+                }
+                else if (x > cur_x) {
+                    buf.unsafe_push_values("\033["_av, x - cur_x, 'C');
+                }
+                else {
+                    buf.unsafe_push_values("\033["_av, cur_x - x, 'D');
+                }
+            }
+            else if (x == 0 && y == cur_y + 1 && cur_x >= 0) {
+                buf.unsafe_push_s("\r\n"_av);
+            }
+            else if (x == 0 && y == 0) {
+                buf.unsafe_push_s("\033[H"_av);
+            }
+            else if (x == 0) {
+                buf.unsafe_push_values("\033["_av, y + 1, 'H');
+            }
+            else {
+                buf.unsafe_push_values("\033["_av, y + 1, ';', x + 1, 'H');
+            }
+            cur_x = x;
+            cur_y = y;
+        };
+
+        ucs4_char const * const new_chars = state.newExtendedChars.data();
+        ucs4_char const * const old_chars = state.extendedChars.data();
+
+        auto write_cell = [&](Cell const & cell){
+            if (cell.isWideContinuation) {
+                return;
+            }
+            push_sgr(buf, style, cell.style);
+            style = cell.style;
+            ucs4_char first_ch = cell.ch;
+            if (cell.extendedLength) {
+                ucs4_carray_view ucs_array{new_chars + cell.ch, cell.extendedLength};
+                buf.prepare_buffer(ucs_array.size() * 4, std::max(ucs_array.size() * 4, std::size_t(4096)));
+                buf.unsafe_push_ucs_array(ucs_array);
+                first_ch = ucs_array[0];
+            }
+            else {
+                buf.unsafe_push_ucs(cell.ch);
+            }
+            cur_x += (char_width(first_ch) == 2) ? 2 : 1;
+            // pending wrap at the end of the line
+            if (cur_x >= columns) {
+                cur_x = -1;
+            }
+        };
+
+        // spans separated by less unchanged cells are joined
+        constexpr int max_unchanged_cells = 4;
+
+        for (int y = 0; y < lines; ++y) {
+            Cell const * const old_line = state.cells.data() + std::size_t(y) * ucolumns;
+            Cell const * const new_line = state.newCells.data() + std::size_t(y) * ucolumns;
+
+            auto is_same = [&](int x){
+                return is_same_cell(old_line[x], old_chars, new_line[x], new_chars);
+            };
+
+            // blank cells at the end of the line
+            int end = columns;
+            while (end > 0 && is_blank_cell(new_line[end - 1])) {
+                --end;
+            }
+
+            for (int x = 0; x < end; ) {
+                if (is_same(x)) {
+                    ++x;
+                    continue;
+                }
+
+                int last_changed = x;
+                for (int i = x + 1; i < end && i - last_changed <= max_unchanged_cells; ++i) {
+                    if (!is_same(i)) {
+                        last_changed = i;
+                    }
+                }
+
+                // a wide character is written with its right half
+                int start = x;
+                if (start > 0 && new_line[start].isWideContinuation) {
+                    --start;
+                }
+
+                buf.prepare_buffer(max_size_by_loop, 4096);
+                move_to(start, y);
+                for (int i = start; i <= last_changed; ++i) {
+                    buf.prepare_buffer(max_size_by_loop, 4096);
+                    write_cell(new_line[i]);
+                }
+
+                x = last_changed + 1;
+            }
+
+            if (!std::all_of(old_line + end, old_line + columns, is_blank_cell)) {
+                buf.prepare_buffer(max_size_by_loop, 4096);
+                move_to(end, y);
+                push_sgr(buf, style, CharacterStyle());
+                style = CharacterStyle();
+                buf.unsafe_push_s("\033[K"_av);
+            }
+        }
+
+        buf.prepare_buffer(max_size_by_loop + extra_data.size(), std::max(extra_data.size(), std::size_t(4096)));
+
+        bool const cursor_visible = screen.hasCursorVisible();
+        if (cursor_visible && lines && columns) {
+            move_to(std::min(screen.getCursorX(), columns - 1), screen.getCursorY());
+        }
+        if (is_redraw || cursor_visible != state.cursorVisible) {
+            buf.unsafe_push_s(cursor_visible ? "\033[?25h"_av : "\033[?25l"_av);
+        }
+
+        if (!extra_data.empty()) {
+            buf.unsafe_push_s(extra_data);
+        }
+
+        buf.set_final();
+
+        state.cursorVisible = cursor_visible;
+    }
+    catch (...) {
+        state.reset();
+        throw;
+    }
+
+    state.cells.swap(state.newCells);
+    state.extendedChars.swap(state.newExtendedChars);
+    state.lineHashes.swap(hashes);
+    state.title.assign(title.begin(), title.end());
+    state.style = style;
+    state.lines = lines;
+    state.columns = columns;
+    state.cursorX = cur_x;
+    state.cursorY = cur_y;
+}
+
+
+void json_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    json_rendering_impl(title, screen, nullptr, palette, buffer, extra_data);
+}
+
+void json_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    json_rendering_impl(title, screen, nullptr, palette, buffer, extra_data);
+}
+
+void json_rendering(
+    ucs4_carray_view title, Screen const & screen, rvt::ScrollbackLines const & history,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    json_rendering_impl(title, screen, &history, palette, buffer, extra_data);
+}
+
+void json_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen, rvt::ScrollbackLines const & history,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    json_rendering_impl(title, screen, &history, palette, buffer, extra_data);
+}
+
+void json_patch_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    JsonPatchState & state, std::string_view extra_data
+) {
+    json_patch_rendering_impl(title, screen, palette, buffer, state, extra_data);
+}
+
+void json_patch_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    JsonPatchState & state, std::string_view extra_data
+) {
+    json_patch_rendering_impl(title, screen, palette, buffer, state, extra_data);
+}
+
+void ansi_diff_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    RenderingBuffer buffer, AnsiDiffState & state,
+    std::string_view extra_data
+) {
+    ansi_diff_rendering_impl(title, screen, buffer, state, extra_data);
+}
+
+void ansi_diff_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    RenderingBuffer buffer, AnsiDiffState & state,
+    std::string_view extra_data
+) {
+    ansi_diff_rendering_impl(title, screen, buffer, state, extra_data);
+}
+
+void ansi_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    ansi_rendering_impl(title, screen, palette, buffer, extra_data);
+}
+
+void ansi_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data
+) {
+    ansi_rendering_impl(title, screen, palette, buffer, extra_data);
+}
+
+
 TranscriptPartialBuffer transcript_partial_rendering(
     Screen const & screen, size_t y, size_t yend,
     RenderingBuffer buffer, std::size_t consumed_buffer
 ) {
     RenderingBuffer2 buf{buffer, consumed_buffer};
 
-    using Line = array_view<const rvt::Character>;
-
-    auto write_line_impl = [&](Line line){
+    auto write_line_impl = [&](Screen::ImageLine const & line){
         std::size_t nb_byte_for_ascii_line = line.size() * 4u;
         buf.prepare_buffer(nb_byte_for_ascii_line);
-        for (auto const& ch : line) {
-            if (REDEMPTION_UNLIKELY(ch.is_extended())) {
-                auto chars = screen.extendedCharTable()[ch.character];
+        auto const code_points = line.codePoints();
+        auto const flags = line.flags();
+        for (std::size_t i = 0; i < line.size(); ++i) {
+            if (REDEMPTION_UNLIKELY(bool(flags[i] & CellFlags::Extended))) {
+                auto chars = screen.extendedCharTable()[code_points[i]];
                 buf.prepare_buffer(chars.size() * 4);
                 buf.unsafe_push_ucs_array(chars);
-                buf.prepare_buffer(checked_int((line.end() - &ch) * 4), nb_byte_for_ascii_line);
+                buf.prepare_buffer((line.size() - i) * 4, nb_byte_for_ascii_line);
             }
             else {
-                buf.unsafe_push_ucs(ch.character);
+                buf.unsafe_push_ucs(code_points[i]);
             }
         }
     };
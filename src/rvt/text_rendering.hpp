@@ -28,6 +28,8 @@
 namespace rvt {
 
 class Screen;
+class ScreenSnapshot;
+class ScrollbackLines;
 
 struct RenderingBuffer
 {
@@ -50,12 +52,134 @@ void json_rendering(
     std::string_view extra_data = {}
 );
 
+void json_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data = {}
+);
+
+/**
+ * Same as json_rendering() with the lines of \c history (see Scrollback::readLines())
+ * in a "history" array before "data". As for "data", the styles of the first
+ * line of "history" are relative to the default style.
+ */
+void json_rendering(
+    ucs4_carray_view title, Screen const & screen, ScrollbackLines const & history,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data = {}
+);
+
+void json_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen, ScrollbackLines const & history,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data = {}
+);
+
+/**
+ * What a client of json_patch_rendering() already received.
+ * A default constructed state (or reset()) starts with a keyframe.
+ */
+struct JsonPatchState
+{
+    /// A keyframe is emitted every \c keyframeInterval renderings, 0 for only when required.
+    unsigned keyframeInterval = 64;
+
+    /// Emits a keyframe on the next rendering.
+    void reset() noexcept { lines = -1; }
+
+    std::vector<uint64_t> lineHashes;
+    std::vector<uint64_t> newLineHashes;
+    std::vector<ucs4_char> title;
+    int lines = -1;
+    int columns = -1;
+    int cursorX = -1;
+    int cursorY = -1;
+    unsigned renderingsSinceKeyframe = 0;
+};
+
+/**
+ * Like json_rendering(), but only with the differences since the previous
+ * rendering of \c state: changed lines, scrolling, cursor and title.
+ * A full json_rendering() (keyframe) is emitted when the size changes and
+ * every \c state.keyframeInterval renderings.
+ */
+void json_patch_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    JsonPatchState & state, std::string_view extra_data = {}
+);
+
+void json_patch_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    JsonPatchState & state, std::string_view extra_data = {}
+);
+
 void ansi_rendering(
     ucs4_carray_view title, Screen const & screen,
     ColorTableView palette, RenderingBuffer buffer,
     std::string_view extra_data = {}
 );
 
+void ansi_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    ColorTableView palette, RenderingBuffer buffer,
+    std::string_view extra_data = {}
+);
+
+/**
+ * What the terminal of a client of ansi_diff_rendering() displays.
+ * A default constructed state (or reset()) starts with a full redraw.
+ */
+struct AnsiDiffState
+{
+    struct Cell
+    {
+        CharacterStyle style {};
+        /// code point, or offset in extendedChars when extendedLength != 0
+        ucs4_char ch = ' ';
+        uint32_t extendedLength = 0;
+        /// right half of a wide character
+        bool isWideContinuation = false;
+    };
+
+    /// Redraws the whole screen on the next rendering.
+    void reset() noexcept { lines = -1; }
+
+    std::vector<Cell> cells; // lines * columns
+    std::vector<ucs4_char> extendedChars;
+    std::vector<Cell> newCells;
+    std::vector<ucs4_char> newExtendedChars;
+    std::vector<uint64_t> lineHashes;
+    std::vector<uint64_t> newLineHashes;
+    std::vector<ucs4_char> title;
+    CharacterStyle style {}; // graphic rendition of the terminal
+    int lines = -1;
+    int columns = -1;
+    int cursorX = 0;
+    int cursorY = 0;
+    bool cursorVisible = true;
+};
+
+/**
+ * Escape sequences which bring a terminal from the screen of \c state to
+ * \c screen: changed spans of the lines, erase-line, scrolling of the lines
+ * in a scrolling region, cursor moves and graphic renditions with the
+ * attributes which change.
+ * The colors are sent in their color space, the palette of the terminal is used.
+ */
+void ansi_diff_rendering(
+    ucs4_carray_view title, Screen const & screen,
+    RenderingBuffer buffer, AnsiDiffState & state,
+    std::string_view extra_data = {}
+);
+
+void ansi_diff_rendering(
+    ucs4_carray_view title, ScreenSnapshot const & screen,
+    RenderingBuffer buffer, AnsiDiffState & state,
+    std::string_view extra_data = {}
+);
+
 struct TranscriptPartialBuffer
 {
     char* buffer;
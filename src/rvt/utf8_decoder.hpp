@@ -21,6 +21,7 @@
 #pragma once
 
 #include "rvt/ucs.hpp"
+#include "rvt/ascii_scan.hpp"
 
 #include "cxx/cxx.hpp"
 #include "utils/sugar/array.hpp"
@@ -28,6 +29,7 @@
 #include "utils/sugar/array_view.hpp"
 #include "utils/sugar/numerics/safe_conversions.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 
@@ -199,6 +201,76 @@ struct Utf8Decoder
         return f;
     }
 
+    /// Same as decode(), but \c f receives a ucs4_carray_view of consecutive code points.
+    /// Runs of printable ASCII characters are copied without decoding.
+    template<class F>
+    F decode_block(utf8_array utf8_string, F && f)
+    {
+        struct Block
+        {
+            ucs4_char buffer[512];
+            std::size_t len = 0;
+            F & f;
+
+            void operator()(ucs4_char uc)
+            {
+                if (REDEMPTION_UNLIKELY(len == utils::size(buffer))) {
+                    flush();
+                }
+                buffer[len++] = uc;
+            }
+
+            void append_ascii(uint8_t const * first, uint8_t const * last)
+            {
+                while (first != last) {
+                    if (len == utils::size(buffer)) {
+                        flush();
+                    }
+                    auto const n = std::min(std::size_t(last - first), utils::size(buffer) - len);
+                    std::copy(first, first + n, buffer + len);
+                    len += n;
+                    first += n;
+                }
+            }
+
+            void flush()
+            {
+                f(ucs4_carray_view{buffer, len});
+                len = 0;
+            }
+        };
+
+        Block block{{}, 0, f};
+
+        auto it = utf8_string.begin();
+        auto const end = utf8_string.end();
+
+        // terminate a pending sequence
+        while (data_len_ && it != end) {
+            decode(utf8_array{it, 1}, block);
+            ++it;
+        }
+
+        while (it != end) {
+            auto const ascii_end = find_non_printable_ascii(it, end);
+            block.append_ascii(it, ascii_end);
+            it = ascii_end;
+
+            while (it != end && !is_printable_ascii(*it)) {
+                if (!advance_and_decode(checked_size{}, it, end, block)) {
+                    data_len_ = this->copy_to_data(it, end);
+                    it = end;
+                }
+            }
+        }
+
+        if (block.len) {
+            block.flush();
+        }
+
+        return f;
+    }
+
     template<class F>
     F end_decode(F && f)
     {
@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <cstdio>
 
 #include "utils/sugar/array_view.hpp"
 #include "utils/sugar/underlying_cast.hpp"
@@ -39,11 +40,13 @@ namespace rvt
 
 VtEmulator::VtEmulator(int lines, int columns, Screen::LineSaver lineSaver)
 : _screen0{lines, columns}
-, _screen1{lines, columns}
+// an alternate screen would be in the same state than the new primary screen
+, _altScreenModes{_screen0.getModes()}
+, _altScreenSavedModes{_screen0.getSavedModes()}
+, _lineSaver{lineSaver}
 {
     reset();
-    _screen0.setLineSaver(lineSaver);
-    _screen1.setLineSaver(std::move(lineSaver));
+    _screen0.setLineSaver(_lineSaver);
 }
 
 VtEmulator::~VtEmulator() = default;
@@ -152,14 +155,285 @@ const int MAX_ARGUMENT = 4096;
 
 /* The tokenizer's state
 
-   The state is represented by the buffer (tokenBuffer, tokenBufferPos),
-   and accompanied by decoded arguments kept in (argv,argc).
-   Note that they are kept internal in the tokenizer.
+   The tokenizer is a state machine in the manner of the DEC ANSI parser
+   (see https://vt100.net/emu/dec_ansi_parser). The current state is kept
+   in _parserState, each incoming character is mapped to an input class and
+   both select an entry of a constant transition table which gives the
+   action to perform and the next state.
+
+   Numeric arguments are accumulated directly in (argv,argc), the private
+   marker of a CSI sequence in _csiPrefix and the intermediate character
+   of an escape sequence in _intermediate. The payload of an OSC sequence
+   is streamed to _oscFunction, only a window title is kept in
+   _pendingTitle.
+
+   Within strings (OSC, DCS, PM, APC), control characters are ignored.
+   receiveChars() takes advantage of it to skip a whole string payload
+   without going through the transition table for each character.
 */
 
+enum class VtParserState : uint8_t
+{
+    Ground,
+    Escape,             // ESC
+    EscapeIntermediate, // ESC [()+*%#]
+    CsiEntry,           // ESC [
+    CsiParam,           // ESC [ [?>] {Pn} ; ...
+    CsiBang,            // ESC [ !
+    CsiIntermediate,    // ESC [ ... [ !"#$%&'()*+,-./]
+    OscCommand,         // ESC ] {Pn}
+    OscString,          // ESC ] {Pn} ; ...
+    DcsString,          // ESC [P^_] ... (IGNORED) XTerm
+    Vt52Escape,         // ESC
+    Vt52CursorRow,      // ESC Y
+    Vt52CursorColumn,   // ESC Y {Pc}
+    MAX_
+};
+
+namespace
+{
+
+const int ESC = 27;
+const int DEL = 127;
+
+enum class ParserInput : uint8_t
+{
+    Control,        // C0 control characters but the following ones
+    Bel,            // BEL
+    CanSub,         // CAN and SUB
+    Esc,            // ESC
+    Del,            // DEL
+    Csi,            // 8-bit CSI (ESC+128)
+    Digit,          // 0-9
+    Semicolon,      // ;
+    Scs,            // ( ) + * %
+    Hash,           // #
+    Bang,           // !
+    Intermediate,   // others characters of 0x20-0x2f
+    PrivateMarker,  // ? >
+    CsiIntroducer,  // [
+    OscIntroducer,  // ]
+    Backslash,      // \ (string terminator)
+    Dcs,            // P (final character of CSI_PN too)
+    PmApc,          // ^ _
+    Vt52Cursor,     // Y
+    Cpn,            // final character of CSI_PN
+    Cps,            // final character of CSI_PS with 2 parameters
+    Printable,
+    MAX_
+};
+
+constexpr ParserInput to_parser_input(unsigned char c) noexcept
+{
+    using I = ParserInput;
+    switch (c) {
+        case 7:         return I::Bel;
+        case 0x18:
+        case 0x1a:      return I::CanSub;
+        case ESC:       return I::Esc;
+        case DEL:       return I::Del;
+        case ESC+128:   return I::Csi;
+        case ';':       return I::Semicolon;
+        case '#':       return I::Hash;
+        case '!':       return I::Bang;
+        case '?':
+        case '>':       return I::PrivateMarker;
+        case '[':       return I::CsiIntroducer;
+        case ']':       return I::OscIntroducer;
+        case '\\':      return I::Backslash;
+        case 'P':       return I::Dcs;
+        case '^':
+        case '_':       return I::PmApc;
+        case 'Y':       return I::Vt52Cursor;
+        default:;
+    }
+    return (charClass[c] & CTL) ? I::Control
+         : (charClass[c] & DIG) ? I::Digit
+         : (charClass[c] & SCS) ? I::Scs
+         : (charClass[c] & CPN) ? I::Cpn
+         : (charClass[c] & CPS) ? I::Cps
+         : (c >= 0x20 && c <= 0x2f) ? I::Intermediate
+         : I::Printable;
+}
+
+constexpr auto parser_inputs = []{
+    std::array<ParserInput, 256> inputs {};
+    for (std::size_t c = 0; c < inputs.size(); ++c) {
+        inputs[c] = to_parser_input(static_cast<unsigned char>(c));
+    }
+    return inputs;
+}();
+
+inline ParserInput get_parser_input(ucs4_char cc) noexcept
+{
+    return REDEMPTION_LIKELY(cc < parser_inputs.size())
+        ? parser_inputs[cc]
+        : ParserInput::Printable;
+}
+
+enum class ParserAction : uint8_t
+{
+    None,
+    Print,
+    Execute,
+    Cancel,             // execute and abort the current sequence
+    Escape,             // start a new sequence
+    Csi,                // 8-bit CSI or printable character in VT52 mode
+    EscDispatch,
+    Collect,
+    EscIntermediateDispatch,
+    Param,
+    ParamSeparator,
+    SetPrefix,
+    CsiPnDispatch,
+    CsiPsDispatch,
+    CsiDispatch,
+    CsiPeDispatch,
+    CsiIgnore,
+    OscInvalid,
+    OscPut,
+    OscEnd,
+    OscEndAndEscape,
+    Vt52Dispatch,
+    Vt52Param,
+    Vt52CursorDispatch,
+};
+
+struct ParserTransition
+{
+    ParserAction action;
+    VtParserState next;
+};
+
+constexpr ParserTransition parser_transition(VtParserState state, ParserInput input) noexcept
+{
+    using S = VtParserState;
+    using I = ParserInput;
+    using A = ParserAction;
+
+    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
+    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
+    // of course. Guess this originates from a weakly layered handling of the X-on
+    // X-off protocol, which comes really below this level.
+    bool const is_osc = (state == S::OscCommand || state == S::OscString);
+    bool const is_string = (is_osc || state == S::DcsString);
+    switch (input) {
+        case I::Del:     return {A::None, state}; //VT100: ignore.
+        case I::CanSub:  return {A::Cancel, S::Ground}; //VT100: CAN or SUB, also abort a string
+        case I::Control: return is_string
+                            ? ParserTransition{A::None, state}
+                            : ParserTransition{A::Execute, state};
+        case I::Bel:     return is_osc
+                            ? ParserTransition{A::OscEnd, S::Ground}
+                            : ParserTransition{is_string ? A::None : A::Execute, state};
+        case I::Esc:     return is_osc
+                            ? ParserTransition{A::OscEndAndEscape, S::Escape}
+                            : ParserTransition{A::Escape, S::Escape};
+        default:;
+    }
+
+    switch (state) {
+        case S::Ground:
+            return {(input == I::Csi) ? A::Csi : A::Print, S::Ground};
+
+        case S::Escape:
+            switch (input) {
+                case I::Scs:
+                case I::Hash:           return {A::Collect, S::EscapeIntermediate};
+                case I::CsiIntroducer:  return {A::None, S::CsiEntry};
+                case I::OscIntroducer:  return {A::None, S::OscCommand};
+                case I::Dcs:
+                case I::PmApc:          return {A::None, S::DcsString};
+                case I::Backslash:      return {A::None, S::Ground}; // string terminator
+                default:                return {A::EscDispatch, S::Ground};
+            }
+
+        case S::EscapeIntermediate:
+            return {A::EscIntermediateDispatch, S::Ground};
+
+        case S::CsiEntry:
+        case S::CsiParam:
+            switch (input) {
+                case I::Digit:          return {A::Param, S::CsiParam};
+                case I::Semicolon:      return {A::ParamSeparator, S::CsiParam};
+                case I::PrivateMarker:  return (state == S::CsiEntry)
+                                            ? ParserTransition{A::SetPrefix, S::CsiParam}
+                                            : ParserTransition{A::CsiDispatch, S::Ground};
+                case I::Bang:           return (state == S::CsiEntry)
+                                            ? ParserTransition{A::None, S::CsiBang}
+                                            : ParserTransition{A::Collect, S::CsiIntermediate};
+                case I::Scs:
+                case I::Hash:
+                case I::Intermediate:   return {A::Collect, S::CsiIntermediate};
+                case I::Cpn:
+                case I::Dcs:            return {A::CsiPnDispatch, S::Ground};
+                case I::Cps:            return {A::CsiPsDispatch, S::Ground};
+                default:                return {A::CsiDispatch, S::Ground};
+            }
+
+        case S::CsiBang:
+            return {A::CsiPeDispatch, S::Ground};
+
+        case S::CsiIntermediate:
+            switch (input) {
+                case I::Scs:
+                case I::Hash:
+                case I::Bang:
+                case I::Intermediate:   return {A::Collect, S::CsiIntermediate};
+                default:                return {A::CsiIgnore, S::Ground};
+            }
+
+        case S::OscCommand:
+            switch (input) {
+                case I::Digit:          return {A::Param, S::OscCommand};
+                case I::Semicolon:      return {A::ParamSeparator, S::OscString};
+                default:                return {A::OscInvalid, S::OscString};
+            }
+
+        case S::OscString:
+            return {A::OscPut, S::OscString};
+
+        case S::DcsString:
+            return {A::None, S::DcsString};
+
+        case S::Vt52Escape:
+            return (input == I::Vt52Cursor)
+                ? ParserTransition{A::None, S::Vt52CursorRow}
+                : ParserTransition{A::Vt52Dispatch, S::Ground};
+
+        case S::Vt52CursorRow:
+            return {A::Vt52Param, S::Vt52CursorColumn};
+
+        case S::Vt52CursorColumn:
+            return {A::Vt52CursorDispatch, S::Ground};
+
+        case S::MAX_:;
+    }
+
+    return {A::None, S::Ground};
+}
+
+constexpr auto parser_transitions = []{
+    constexpr auto nb_state = std::size_t(VtParserState::MAX_);
+    constexpr auto nb_input = std::size_t(ParserInput::MAX_);
+    std::array<std::array<ParserTransition, nb_input>, nb_state> transitions {};
+    for (std::size_t state = 0; state < nb_state; ++state) {
+        for (std::size_t input = 0; input < nb_input; ++input) {
+            transitions[state][input] = parser_transition(
+                VtParserState(state), ParserInput(input));
+        }
+    }
+    return transitions;
+}();
+
+}
+
 void VtEmulator::resetTokenizer()
 {
-    tokenBufferPos = 0;
+    _parserState = VtParserState::Ground;
+    _csiPrefix = 0;
+    _intermediate = 0;
+    _pendingTitle.clear();
     argc = 0;
     argv[0] = 0;
     argv[1] = 0;
@@ -176,181 +450,389 @@ void VtEmulator::addArgument()
     argv[argc] = 0;
 }
 
-void VtEmulator::addToCurrentToken(ucs4_char cc)
+void VtEmulator::receiveChar(ucs4_char cc)
 {
-    tokenBuffer[tokenBufferPos] = cc;
-    tokenBufferPos = std::min(tokenBufferPos + 1, MAX_TOKEN_LENGTH - 1);
+    processChar(cc);
+    saveDeferredLines();
 }
 
-/* Ok, here comes the nasty part of the decoder.
+// process an incoming unicode character
+void VtEmulator::processChar(ucs4_char cc)
+{
+    auto const transition = parser_transitions
+        [underlying_cast(_parserState)]
+        [underlying_cast(get_parser_input(cc))];
 
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+    _parserState = transition.next;
 
-   This is done by the following defines.
+    switch (transition.action)
+    {
+    case ParserAction::None:
+        break;
 
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'charClass').
+    case ParserAction::Print:
+        _currentScreen->displayCharacter(getMode(Mode::Ansi) ? applyCharset(cc) : cc);
+        break;
 
-   - 'cc' is the current character
-   - 's' is a pointer to the start of the token buffer
-   - 'p' is the current position within the token buffer
+    case ParserAction::Execute:
+        processToken(TY_CTL(cc+'@'), 0, 0);
+        break;
 
-   Note that they need to applied in proper order.
-*/
+    case ParserAction::Cancel:
+        resetTokenizer();
+        processToken(TY_CTL(cc+'@'), 0, 0);
+        break;
 
-#define lec(P,L,C) (p == (P) && s[(L)] == (C))
-#define lun(     ) (p ==  1  && cc >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  && cc == (C))
-#define ees(C)     (p >=  3  && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?')
-#define epe( )     (p >=  3  && s[2] == '!')
-#define egt( )     (p >=  3  && s[2] == '>')
-#define Xpe        (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte        (Xpe      && (cc ==  7 || cc == 27))
-#define ces(C)     (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
-#define dcs()      (p >= 2 && s[1] == 'P')
-#define pm()       (p >= 2 && s[1] == '^')
-#define apc()      (p >= 2 && s[1] == '_')
-
-#define CNTL(c) ((c)-'@')
-const int ESC = 27;
-const int DEL = 127;
+    case ParserAction::OscEndAndEscape:
+        processOscEnd();
+        [[fallthrough]];
+    case ParserAction::Escape:
+        resetTokenizer();
+        _parserState = getMode(Mode::Ansi) ? VtParserState::Escape : VtParserState::Vt52Escape;
+        break;
 
-// process an incoming unicode character
-void VtEmulator::receiveChar(ucs4_char cc)
-{
-    if (cc == DEL)
-        return; //VT100: ignore.
+    case ParserAction::Csi:
+        if (getMode(Mode::Ansi)) {
+            _parserState = VtParserState::CsiEntry;
+        }
+        else {
+            _currentScreen->displayCharacter(cc);
+        }
+        break;
 
-    if (ces(CTL))
-    {
-        // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-        // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
-        // of course. Guess this originates from a weakly layered handling of the X-on
-        // X-off protocol, which comes really below this level.
-        if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-            resetTokenizer(); //VT100: CAN or SUB
-        if (cc != ESC)
-        {
-            processToken(TY_CTL(cc+'@' ),0,0);
-            return;
+    case ParserAction::EscDispatch:
+        processToken(TY_ESC(cc), 0, 0);
+        resetTokenizer();
+        break;
+
+    case ParserAction::Collect:
+        _intermediate = cc;
+        break;
+
+    case ParserAction::EscIntermediateDispatch:
+        if (_intermediate == '#') {
+            processToken(TY_ESC_DE(cc), 0, 0);
         }
-    }
-    // advance the state
-    addToCurrentToken(cc);
+        else {
+            processToken(TY_ESC_CS(_intermediate, cc), 0, 0);
+        }
+        resetTokenizer();
+        break;
 
-    ucs4_char * s = tokenBuffer;
-    const int  p = tokenBufferPos;
+    case ParserAction::Param:
+        addDigit(int(cc - '0'));
+        break;
 
-    if (getMode(Mode::Ansi))
-    {
-        if (lec(1,0,ESC)) { return; }
-        if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('['); return; }
-        if (les(2,1,GRP)) { return; }
-        if (Xte         ) { processWindowAttributeRequest(); resetTokenizer(); return; }
-        if (Xpe         ) { return; }
-        if (lec(2,1,'\\')) { resetTokenizer(); return; } // string terminator (Xte)
-        if (dcs()) { if (cc == '\\') { resetTokenizer(); } return; } // (IGNORED) XTerm
-        if ( pm()) { if (cc == '\\') { resetTokenizer(); } return; } // (IGNORED) XTerm
-        if (apc()) { if (cc == '\\') { resetTokenizer(); } return; } // (IGNORED) XTerm
-        if (lec(3,2,'?')) { return; }
-        if (lec(3,2,'>')) { return; }
-        if (lec(3,2,'!')) { return; }
-        if (lun(       )) { processToken( TY_CHR(), applyCharset(cc), 0);   resetTokenizer(); return; }
-        if (lec(2,0,ESC)) { processToken( TY_ESC(s[1]), 0, 0);              resetTokenizer(); return; }
-        if (les(3,1,SCS)) { processToken( TY_ESC_CS(s[1],s[2]), 0, 0);      resetTokenizer(); return; }
-        if (lec(3,1,'#')) { processToken( TY_ESC_DE(s[2]), 0, 0);           resetTokenizer(); return; }
-        if (eps(    CPN)) { processToken( TY_CSI_PN(cc), argv[0], argv[1]); resetTokenizer(); return; }
+    case ParserAction::ParamSeparator:
+        addArgument();
+        break;
+
+    case ParserAction::SetPrefix:
+        _csiPrefix = cc;
+        break;
 
+    case ParserAction::CsiPnDispatch:
+        if (!_csiPrefix) {
+            processToken(TY_CSI_PN(cc), argv[0], argv[1]);
+            resetTokenizer();
+            break;
+        }
+        [[fallthrough]];
+    case ParserAction::CsiPsDispatch:
         // resize = \e[8;<row>;<col>t
-        if (eps(CPS))
-        {
-            processToken( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+        if (!_csiPrefix && cc == 't') {
+            processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
             resetTokenizer();
-            return;
+            break;
+        }
+        [[fallthrough]];
+    case ParserAction::CsiDispatch:
+        if (cc == 'm' && !_csiPrefix) {
+            processSelectGraphicRendition();
+            resetTokenizer();
+            break;
         }
-
-        if (epe(   )) { processToken( TY_CSI_PE(cc), 0, 0); resetTokenizer(); return; }
-        if (ees(DIG)) { addDigit(cc-'0'); return; }
-        if (eec(';')) { addArgument();    return; }
         for (int i = 0; i <= argc; i++)
         {
-            if (epp())
+            if (_csiPrefix == '?')
                 processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
-            else if (egt())
+            else if (_csiPrefix == '>')
                 processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-            else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
-            {
-                // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
-                i += 2;
-                processToken(TY_CSI_PS(cc, argv[i-2]), static_cast<int32_t>(ColorSpace::RGB), (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
-                i += 2;
-            }
-            else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
-            {
-                // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
-                i += 2;
-                processToken(TY_CSI_PS(cc, argv[i-2]), static_cast<int32_t>(ColorSpace::Index256), argv[i]);
-            }
             else
                 processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
         }
         resetTokenizer();
+        break;
+
+    case ParserAction::CsiPeDispatch:
+        processToken(TY_CSI_PE(cc), 0, 0);
+        resetTokenizer();
+        break;
+
+    case ParserAction::CsiIgnore:
+        // sequences with intermediate characters are not supported
+        reportDecodingError(TY_CSI_PS(cc, 0));
+        resetTokenizer();
+        break;
+
+    case ParserAction::OscInvalid: {
+        ucs4_char sequence[] {ESC, ']', cc};
+        reportDecodingError(ucs4_carray_view(sequence));
+        argv[0] = -1;
+        argc = 1;
+        break;
     }
-    else
-    {
-        // VT52 Mode
-        if (lec(1,0,ESC))
-            return;
-        if (les(1,0,CHR))
-        {
-            processToken( TY_CHR(), s[0], 0);
-            resetTokenizer();
-            return;
+
+    case ParserAction::OscPut:
+        processOscData({&cc, 1});
+        break;
+
+    case ParserAction::OscEnd:
+        processOscEnd();
+        resetTokenizer();
+        break;
+
+    case ParserAction::Vt52Dispatch:
+        processToken(TY_VT52(cc), 0, 0);
+        resetTokenizer();
+        break;
+
+    case ParserAction::Vt52Param:
+        argv[0] = static_cast<int>(cc);
+        break;
+
+    case ParserAction::Vt52CursorDispatch:
+        processToken(TY_VT52('Y'), argv[0], static_cast<int>(cc));
+        resetTokenizer();
+        break;
+    }
+}
+
+void VtEmulator::receiveChars(ucs4_carray_view chars)
+{
+    if (REDEMPTION_UNLIKELY(_screen1 && _currentScreen == &_screen0)
+     && _altScreenReleaseDelay.count() >= 0
+     && std::chrono::steady_clock::now() - _altScreenLeavingTime >= _altScreenReleaseDelay
+    ) {
+        releaseAlternateScreen();
+    }
+
+    auto is_printable = [](ucs4_char cc) {
+        return get_parser_input(cc) >= ParserInput::Digit;
+    };
+
+    auto p = chars.begin();
+    auto const e = chars.end();
+
+    while (p != e) {
+        switch (_parserState) {
+            case VtParserState::Ground:
+                if (getMode(Mode::Ansi) && is_printable(*p)) {
+                    auto const run_end = std::find_if_not(p + 1, e, is_printable);
+                    displayString({p, run_end});
+                    p = run_end;
+                    continue;
+                }
+                break;
+
+            case VtParserState::OscString: {
+                auto const data_end = std::find_if(p, e, [](ucs4_char cc) {
+                    return cc < 32 || cc == DEL;
+                });
+                if (data_end != p) {
+                    processOscData({p, data_end});
+                    p = data_end;
+                    continue;
+                }
+                break;
+            }
+
+            case VtParserState::DcsString:
+                // everything is ignored until ESC, CAN or SUB
+                p = std::find_if(p, e, [](ucs4_char cc) {
+                    return cc == ESC || cc == 0x18 || cc == 0x1a;
+                });
+                if (p == e) {
+                    continue;
+                }
+                break;
+
+            default:
+                break;
         }
-        if (lec(2,1,'Y'))
-            return;
-        if (lec(3,1,'Y'))
-            return;
-        if (p < 4)
-        {
-            processToken(TY_VT52(s[1] ), 0, 0);
-            resetTokenizer();
-            return;
+
+        processChar(*p);
+        ++p;
+    }
+
+    saveDeferredLines();
+
+    if (REDEMPTION_UNLIKELY(_memoryBudget)) {
+        applyMemoryBudget();
+    }
+}
+
+void VtEmulator::saveDeferredLines()
+{
+    _screen0.saveDeferredLines();
+    if (_screen1) {
+        _screen1->saveDeferredLines();
+    }
+}
+
+VtEmulator::MemoryUsage VtEmulator::memoryUsage() const noexcept
+{
+    MemoryUsage usage;
+    usage.emulator = sizeof(VtEmulator)
+                   + (_pendingTitle.capacity() + _windowTitle.capacity()) * sizeof(ucs4_char)
+                   + _logBuffer.capacity();
+    usage.primaryScreen = _screen0.memoryUsage();
+    if (_screen1) {
+        usage.emulator += sizeof(Screen);
+        usage.alternateScreen = _screen1->memoryUsage();
+    }
+    return usage;
+}
+
+void VtEmulator::applyMemoryBudget()
+{
+    std::size_t const usage = memoryUsage().total();
+    // the reduction is only tried again when the memory has grown enough
+    // since the previous one, otherwise it would run on each call
+    if (usage > _memoryBudget && usage > _memoryUsageAfterReduction + _memoryBudget / 8) {
+        reduceMemoryUsage();
+        _memoryUsageAfterReduction = memoryUsage().total();
+    }
+}
+
+void VtEmulator::reduceMemoryUsage()
+{
+    if (_screen1 && _currentScreen == &_screen0) {
+        releaseAlternateScreen();
+    }
+    _screen0.reduceMemoryUsage();
+    if (_screen1) {
+        _screen1->reduceMemoryUsage();
+    }
+    shrinkBuffers();
+}
+
+Damage VtEmulator::getDamage() const noexcept
+{
+    Damage damage = _currentScreen->getDamage() | _damage;
+    if (bool(_damage & Damage::CurrentScreen)) {
+        damage |= Damage::Lines;
+    }
+    return damage;
+}
+
+bool VtEmulator::isLineDirty(int y) const noexcept
+{
+    return bool(_damage & Damage::CurrentScreen) || _currentScreen->isLineDirty(y);
+}
+
+void VtEmulator::resetDamage() noexcept
+{
+    _damage = Damage::None;
+    _screen0.resetDamage();
+    if (_screen1) {
+        _screen1->resetDamage();
+    }
+}
+
+void VtEmulator::trim()
+{
+    if (_screen1 && _currentScreen == &_screen0) {
+        releaseAlternateScreen();
+    }
+    _screen0.trim();
+    if (_screen1) {
+        _screen1->trim();
+    }
+    shrinkBuffers();
+}
+
+void VtEmulator::shrinkBuffers()
+{
+    _pendingTitle.shrink_to_fit();
+    _windowTitle.shrink_to_fit();
+    _logBuffer = std::vector<char>();
+}
+
+void VtEmulator::displayString(ucs4_carray_view str)
+{
+    if (_charsets[_currentScreen != &_screen0].charset_id == CharsetId::Latin1) {
+        _currentScreen->displayString(str);
+    }
+    else {
+        ucs4_char buf[256];
+        auto p = str.begin();
+        while (p != str.end()) {
+            auto const n = std::min(str.end() - p, std::ptrdiff_t(utils::size(buf)));
+            std::transform(p, p + n, buf, [this](ucs4_char c) { return applyCharset(c); });
+            _currentScreen->displayString({buf, std::size_t(n)});
+            p += n;
         }
-        processToken(TY_VT52(s[1]), s[2], s[3]);
-        resetTokenizer();
+    }
+}
+
+static bool is_window_title_attribute(int attribute)
+{
+    return attribute == 0 || attribute == 2;
+}
+
+// Describes the window or terminal session attribute to change
+// See "Operating System Controls" section on http://rtfm.etla.org/xterm/ctlseq.html
+void VtEmulator::processOscData(ucs4_carray_view data)
+{
+    int const attribute = argv[0];
+
+    if (attribute < 0) {
         return;
     }
+
+    if (is_window_title_attribute(attribute)) {
+        auto const n = std::min(data.size(), MAX_TITLE_LENGTH - _pendingTitle.size());
+        _pendingTitle.insert(_pendingTitle.end(), data.begin(), data.begin() + n);
+    }
+
+    if (_oscFunction) {
+        _oscFunction(attribute, data, false);
+    }
 }
 
-void VtEmulator::processWindowAttributeRequest()
+void VtEmulator::processOscEnd()
 {
-    // Describes the window or terminal session attribute to change
-    // See "Operating System Controls" section on http://rtfm.etla.org/xterm/ctlseq.html
-    int attribute = 0;
-    int i;
-    for (i = 2; i < tokenBufferPos     &&
-                tokenBuffer[i] >= '0'  &&
-                tokenBuffer[i] <= '9'; i++)
-    {
-        attribute = 10 * attribute + (tokenBuffer[i]-'0');
+    int const attribute = argv[0];
+
+    // without ';'
+    if (argc == 0) {
+        ucs4_char sequence[16] {ESC, ']'};
+        ucs4_char * p = sequence + 2;
+        if (attribute) {
+            char digits[8];
+            int const len = std::snprintf(digits, sizeof(digits), "%d", attribute);
+            p = std::copy(digits, digits + len, p);
+        }
+        reportDecodingError({sequence, p});
+        return;
     }
 
-    if (tokenBuffer[i] != ';')
-    {
-        reportDecodingError();
+    if (attribute < 0) {
         return;
     }
 
-    if (attribute == 0 || attribute == 2) {
-        windowTitleLen = std::copy(tokenBuffer+i+1, tokenBuffer+tokenBufferPos-1, windowTitle) - windowTitle;
-        windowTitle[windowTitleLen] = 0;
+    if (is_window_title_attribute(attribute)) {
+        if (_windowTitle != _pendingTitle) {
+            _damage |= Damage::Title;
+        }
+        // both buffers keep their memory
+        _windowTitle.swap(_pendingTitle);
+        _pendingTitle.clear();
+    }
+
+    if (_oscFunction) {
+        _oscFunction(attribute, {}, true);
     }
 }
 
@@ -545,68 +1027,7 @@ void VtEmulator::processToken(uint32_t token, int32_t p, int q)
     case TY_CSI_PS('s',   0) :      saveCursor           (          ); break;
     case TY_CSI_PS('u',   0) :      restoreCursor        (          ); break;
 
-    case TY_CSI_PS('m',   0) : _currentScreen->setDefaultRendition  (          ); break;
-    case TY_CSI_PS('m',   1) : _currentScreen->setRendition          (Rendition::Bold     ); break; //VT100
-    case TY_CSI_PS('m',   2) : _currentScreen->setRendition          (Rendition::Dim      ); break; //VT100
-    case TY_CSI_PS('m',   3) : _currentScreen->setRendition          (Rendition::Italic   ); break; //VT100
-    case TY_CSI_PS('m',   4) : _currentScreen->setRendition          (Rendition::Underline); break; //VT100
-    case TY_CSI_PS('m',   5) : _currentScreen->setRendition          (Rendition::Blink    ); break; //VT100
-    case TY_CSI_PS('m',   7) : _currentScreen->setRendition          (Rendition::Reverse  ); break;
-    case TY_CSI_PS('m',   8) : /* IGNORED: _currentScreen->setRendition          (Rendition::Hidden   );*/ break;
-    case TY_CSI_PS('m',  10) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  11) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  12) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  21) : _currentScreen->resetRendition     (Rendition::Bold     ); break;
-    case TY_CSI_PS('m',  22) : _currentScreen->resetRendition     (Rendition::Dim      ); break;
-    case TY_CSI_PS('m',  23) : _currentScreen->resetRendition     (Rendition::Italic   ); break; //VT100
-    case TY_CSI_PS('m',  24) : _currentScreen->resetRendition     (Rendition::Underline); break;
-    case TY_CSI_PS('m',  25) : _currentScreen->resetRendition     (Rendition::Blink    ); break;
-    case TY_CSI_PS('m',  27) : _currentScreen->resetRendition     (Rendition::Reverse  ); break;
-    case TY_CSI_PS('m',  28) : /* IGNORED: _currentScreen->resetRendition     (Rendition::Hidden   ); */ break;
-
-    case TY_CSI_PS('m',   30) : _currentScreen->setForeColor         (ColorSpace::System,  0); break;
-    case TY_CSI_PS('m',   31) : _currentScreen->setForeColor         (ColorSpace::System,  1); break;
-    case TY_CSI_PS('m',   32) : _currentScreen->setForeColor         (ColorSpace::System,  2); break;
-    case TY_CSI_PS('m',   33) : _currentScreen->setForeColor         (ColorSpace::System,  3); break;
-    case TY_CSI_PS('m',   34) : _currentScreen->setForeColor         (ColorSpace::System,  4); break;
-    case TY_CSI_PS('m',   35) : _currentScreen->setForeColor         (ColorSpace::System,  5); break;
-    case TY_CSI_PS('m',   36) : _currentScreen->setForeColor         (ColorSpace::System,  6); break;
-    case TY_CSI_PS('m',   37) : _currentScreen->setForeColor         (ColorSpace::System,  7); break;
-
-    case TY_CSI_PS('m',   38) : _currentScreen->setForeColor         (ColorSpace(p),       q); break;
-
-    case TY_CSI_PS('m',   39) : _currentScreen->setForeColor         (ColorSpace::Default,  0); break;
-
-    case TY_CSI_PS('m',   40) : _currentScreen->setBackColor         (ColorSpace::System,  0); break;
-    case TY_CSI_PS('m',   41) : _currentScreen->setBackColor         (ColorSpace::System,  1); break;
-    case TY_CSI_PS('m',   42) : _currentScreen->setBackColor         (ColorSpace::System,  2); break;
-    case TY_CSI_PS('m',   43) : _currentScreen->setBackColor         (ColorSpace::System,  3); break;
-    case TY_CSI_PS('m',   44) : _currentScreen->setBackColor         (ColorSpace::System,  4); break;
-    case TY_CSI_PS('m',   45) : _currentScreen->setBackColor         (ColorSpace::System,  5); break;
-    case TY_CSI_PS('m',   46) : _currentScreen->setBackColor         (ColorSpace::System,  6); break;
-    case TY_CSI_PS('m',   47) : _currentScreen->setBackColor         (ColorSpace::System,  7); break;
-
-    case TY_CSI_PS('m',   48) : _currentScreen->setBackColor         (ColorSpace(p),       q); break;
-
-    case TY_CSI_PS('m',   49) : _currentScreen->setBackColor         (ColorSpace::Default,  1); break;
-
-    case TY_CSI_PS('m',   90) : _currentScreen->setForeColor         (ColorSpace::System,  8); break;
-    case TY_CSI_PS('m',   91) : _currentScreen->setForeColor         (ColorSpace::System,  9); break;
-    case TY_CSI_PS('m',   92) : _currentScreen->setForeColor         (ColorSpace::System, 10); break;
-    case TY_CSI_PS('m',   93) : _currentScreen->setForeColor         (ColorSpace::System, 11); break;
-    case TY_CSI_PS('m',   94) : _currentScreen->setForeColor         (ColorSpace::System, 12); break;
-    case TY_CSI_PS('m',   95) : _currentScreen->setForeColor         (ColorSpace::System, 13); break;
-    case TY_CSI_PS('m',   96) : _currentScreen->setForeColor         (ColorSpace::System, 14); break;
-    case TY_CSI_PS('m',   97) : _currentScreen->setForeColor         (ColorSpace::System, 15); break;
-
-    case TY_CSI_PS('m',  100) : _currentScreen->setBackColor         (ColorSpace::System,  8); break;
-    case TY_CSI_PS('m',  101) : _currentScreen->setBackColor         (ColorSpace::System,  9); break;
-    case TY_CSI_PS('m',  102) : _currentScreen->setBackColor         (ColorSpace::System, 10); break;
-    case TY_CSI_PS('m',  103) : _currentScreen->setBackColor         (ColorSpace::System, 11); break;
-    case TY_CSI_PS('m',  104) : _currentScreen->setBackColor         (ColorSpace::System, 12); break;
-    case TY_CSI_PS('m',  105) : _currentScreen->setBackColor         (ColorSpace::System, 13); break;
-    case TY_CSI_PS('m',  106) : _currentScreen->setBackColor         (ColorSpace::System, 14); break;
-    case TY_CSI_PS('m',  107) : _currentScreen->setBackColor         (ColorSpace::System, 15); break;
+    // TY_CSI_PS('m', ...) : see processSelectGraphicRendition()
 
     case TY_CSI_PS('q',   0) : /* IGNORED: LEDs off                 */ break; //VT100
     case TY_CSI_PS('q',   1) : /* IGNORED: LED1 on                  */ break; //VT100
@@ -759,7 +1180,7 @@ void VtEmulator::processToken(uint32_t token, int32_t p, int q)
 
     //FIXME: every once new sequences like this pop up in xterm.
     //       Here's a guess of what they could mean.
-    case TY_CSI_PR('h', 1049) : saveCursor(); _screen1.clearEntireScreen(); setMode(Mode::AppScreen); break; //XTERM
+    case TY_CSI_PR('h', 1049) : saveCursor(); alternateScreen().clearEntireScreen(); setMode(Mode::AppScreen); break; //XTERM
     case TY_CSI_PR('l', 1049) : resetMode(Mode::AppScreen); restoreCursor(); break; //XTERM
 
     case TY_CSI_PR('h', 2004) : /*         setMode      (Mode::BracketedPaste); */ break; //XTERM
@@ -794,11 +1215,91 @@ void VtEmulator::processToken(uint32_t token, int32_t p, int q)
     case TY_CSI_PG('p'    ) : /* IGNORED: Set resource value pointerMode.               */break; //XTerm
 
     default:
-        reportDecodingError();
+        reportDecodingError(token);
         break;
   }
 }
 
+/*
+   The parameters of SGR (ESC [ ... m) are applied to a copy of the
+   current graphic rendition of the screen which is then set once,
+   so that the effective rendition is computed once per sequence.
+*/
+void VtEmulator::processSelectGraphicRendition()
+{
+    auto gr = _currentScreen->getGraphicRendition();
+
+    auto color = [this](int & i) {
+        if (argc - i >= 4 && argv[i+1] == 2)
+        {
+            // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
+            i += 4;
+            return CharacterColor(ColorSpace::RGB, (argv[i-2] << 16) | (argv[i-1] << 8) | argv[i]);
+        }
+        if (argc - i >= 2 && argv[i+1] == 5)
+        {
+            // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
+            i += 2;
+            return CharacterColor(ColorSpace::Index256, argv[i]);
+        }
+        return CharacterColor();
+    };
+
+    for (int i = 0; i <= argc; i++)
+    {
+        int const n = argv[i];
+        switch (n)
+        {
+        case   0 : gr = {Rendition::Default,
+                         CharacterColor(ColorSpace::Default, DEFAULT_FORE_COLOR),
+                         CharacterColor(ColorSpace::Default, DEFAULT_BACK_COLOR)}; break;
+        case   1 : gr.rendition |= Rendition::Bold     ; break; //VT100
+        case   2 : gr.rendition |= Rendition::Dim      ; break; //VT100
+        case   3 : gr.rendition |= Rendition::Italic   ; break; //VT100
+        case   4 : gr.rendition |= Rendition::Underline; break; //VT100
+        case   5 : gr.rendition |= Rendition::Blink    ; break; //VT100
+        case   7 : gr.rendition |= Rendition::Reverse  ; break;
+        case   8 : /* IGNORED: gr.rendition |= Rendition::Hidden; */ break;
+        case  10 : /* IGNORED: mapping related          */ break; //LINUX
+        case  11 : /* IGNORED: mapping related          */ break; //LINUX
+        case  12 : /* IGNORED: mapping related          */ break; //LINUX
+        case  21 : gr.rendition &= ~Rendition::Bold     ; break;
+        case  22 : gr.rendition &= ~Rendition::Dim      ; break;
+        case  23 : gr.rendition &= ~Rendition::Italic   ; break; //VT100
+        case  24 : gr.rendition &= ~Rendition::Underline; break;
+        case  25 : gr.rendition &= ~Rendition::Blink    ; break;
+        case  27 : gr.rendition &= ~Rendition::Reverse  ; break;
+        case  28 : /* IGNORED: gr.rendition &= ~Rendition::Hidden; */ break;
+
+        case  30 : case  31 : case  32 : case  33 :
+        case  34 : case  35 : case  36 : case  37 :
+            gr.foreground = CharacterColor(ColorSpace::System, n - 30); break;
+        case  38 : gr.foreground = color(i); break;
+        case  39 : gr.foreground = CharacterColor(ColorSpace::Default, 0); break;
+
+        case  40 : case  41 : case  42 : case  43 :
+        case  44 : case  45 : case  46 : case  47 :
+            gr.background = CharacterColor(ColorSpace::System, n - 40); break;
+        case  48 : gr.background = color(i); break;
+        case  49 : gr.background = CharacterColor(ColorSpace::Default, 1); break;
+
+        case  90 : case  91 : case  92 : case  93 :
+        case  94 : case  95 : case  96 : case  97 :
+            gr.foreground = CharacterColor(ColorSpace::System, n - 90 + 8); break;
+
+        case 100 : case 101 : case 102 : case 103 :
+        case 104 : case 105 : case 106 : case 107 :
+            gr.background = CharacterColor(ColorSpace::System, n - 100 + 8); break;
+
+        default:
+            reportDecodingError(TY_CSI_PS('m', n));
+            break;
+        }
+    }
+
+    _currentScreen->setGraphicRendition(gr);
+}
+
 void VtEmulator::clearScreenAndSetColumns(int columnCount)
 {
     setScreenSize(_currentScreen->getLines(), columnCount);
@@ -807,11 +1308,13 @@ void VtEmulator::clearScreenAndSetColumns(int columnCount)
     _currentScreen->setCursorYX(0,0);
 }
 
-void VtEmulator::setWindowTitle(ucs4_carray_view title) noexcept
+void VtEmulator::setWindowTitle(ucs4_carray_view title)
 {
-    this->windowTitleLen = std::min(title.size(), utils::size(this->windowTitle)-1);
-    std::copy(title.begin(), title.begin() + this->windowTitleLen, this->windowTitle);
-    this->windowTitle[this->windowTitleLen] = 0;
+    auto const title_end = title.begin() + std::min(title.size(), MAX_TITLE_LENGTH);
+    if (!std::equal(title.begin(), title_end, this->_windowTitle.begin(), this->_windowTitle.end())) {
+        this->_windowTitle.assign(title.begin(), title_end);
+        this->_damage |= Damage::Title;
+    }
 }
 
 /* ------------------------------------------------------------------------- */
@@ -840,7 +1343,7 @@ void VtEmulator::setWindowTitle(ucs4_carray_view title) noexcept
 
 // Apply current character map.
 
-#define CHARSET _charsets[_currentScreen == &_screen1]
+#define CHARSET _charsets[_currentScreen != &_screen0]
 
 ucs4_char VtEmulator::applyCharset(ucs4_char c) const
 {
@@ -895,7 +1398,39 @@ void VtEmulator::setDefaultMargins()
 
 void VtEmulator::setScreen(int n)
 {
-    _currentScreen = (n & 1) ? &_screen1 : &_screen0;
+    Screen * const previousScreen = _currentScreen;
+    if (n & 1) {
+        _currentScreen = &alternateScreen();
+    }
+    else {
+        if (_currentScreen != &_screen0) {
+            _altScreenLeavingTime = std::chrono::steady_clock::now();
+        }
+        _currentScreen = &_screen0;
+    }
+    if (previousScreen != _currentScreen) {
+        previousScreen->saveDeferredLines();
+        _damage |= Damage::CurrentScreen;
+    }
+}
+
+Screen & VtEmulator::alternateScreen()
+{
+    if (!_screen1) {
+        _screen1 = std::make_unique<Screen>(_screen0.getLines(), _screen0.getColumns());
+        _screen1->setModes(_altScreenModes, _altScreenSavedModes);
+        _screen1->setLineSaver(_lineSaver);
+    }
+    return *_screen1;
+}
+
+void VtEmulator::releaseAlternateScreen()
+{
+    assert(_currentScreen == &_screen0);
+    _altScreenModes = _screen1->getModes();
+    _altScreenSavedModes = _screen1->getSavedModes();
+    _screen1->saveDeferredLines();
+    _screen1.reset();
 }
 
 void VtEmulator::setScreenSize(int lines, int columns)
@@ -905,7 +1440,9 @@ void VtEmulator::setScreenSize(int lines, int columns)
     }
 
     _screen0.resizeImage(lines, columns);
-    _screen1.resizeImage(lines, columns);
+    if (_screen1) {
+        _screen1->resizeImage(lines, columns);
+    }
 }
 
 void VtEmulator::setMargins(int t, int b)
@@ -1017,25 +1554,39 @@ bool VtEmulator::getMode(Mode m)
 void VtEmulator::setMode(ScreenMode m)
 {
     _screen0.setMode(m);
-    _screen1.setMode(m);
+    if (_screen1) {
+        _screen1->setMode(m);
+    }
+    else {
+        _altScreenModes.set(m);
+    }
 }
 
 void VtEmulator::resetMode(ScreenMode m)
 {
     _screen0.resetMode(m);
-    _screen1.resetMode(m);
+    if (_screen1) {
+        _screen1->resetMode(m);
+    }
+    else {
+        _altScreenModes.reset(m);
+    }
 }
 
 void VtEmulator::saveMode(ScreenMode m)
 {
     _screen0.saveMode(m);
-    _screen1.saveMode(m);
+    if (_screen1) {
+        _screen1->saveMode(m);
+    }
+    else {
+        _altScreenSavedModes.copy_of(m, _altScreenModes);
+    }
 }
 
 void VtEmulator::restoreMode(ScreenMode m)
 {
-    _screen0.resetMode(m);
-    _screen1.resetMode(m);
+    resetMode(m);
 }
 
 bool VtEmulator::getMode(ScreenMode m)
@@ -1043,10 +1594,10 @@ bool VtEmulator::getMode(ScreenMode m)
     return _currentScreen->getMode(m);
 }
 
-// return contents of the scan buffer
-static std::vector<char> hexdump2(ucs4_char const * s, int len)
+// write contents of the scan buffer (the memory of returnDump is reused)
+static void hexdump2(std::vector<char> & returnDump, ucs4_char const * s, int len)
 {
-    std::vector<char> returnDump;
+    returnDump.clear();
     returnDump.reserve(std::size_t(len) * 2 + 1);
 
     auto append = [&](chars_view s){
@@ -1083,19 +1634,77 @@ static std::vector<char> hexdump2(ucs4_char const * s, int len)
             append(make_const_array_view(hex));
         }
     }
+}
+
+void VtEmulator::reportDecodingError(uint32_t token)
+{
+    if (!_logFunction) {
+        return;
+    }
+
+    // rebuild the sequence from the token and the tokenizer state
+    ucs4_char sequence[MAXARGS * 5 + 8] {ESC};
+    ucs4_char * p = sequence + 1;
+
+    auto const type = token & 0xffu;
+    auto const a = (token >> 8) & 0xffu;
+    auto const n = token >> 16;
+
+    switch (type) {
+        case TY_CHR():
+        case TY_CTL(0):
+            return;
+        case TY_ESC(0):
+        case TY_VT52(0):
+            *p++ = a;
+            break;
+        case TY_ESC_CS(0, 0):
+            *p++ = a;
+            *p++ = n;
+            break;
+        case TY_ESC_DE(0):
+            *p++ = '#';
+            *p++ = a;
+            break;
+        case TY_CSI_PE(0):
+            *p++ = '[';
+            *p++ = '!';
+            *p++ = a;
+            break;
+        default:
+            *p++ = '[';
+            if (_csiPrefix) {
+                *p++ = _csiPrefix;
+            }
+            if (argc || argv[0]) {
+                for (int i = 0; i <= argc; ++i) {
+                    if (i) {
+                        *p++ = ';';
+                    }
+                    char digits[8];
+                    int const len = std::snprintf(digits, sizeof(digits), "%d", argv[i]);
+                    p = std::copy(digits, digits + len, p);
+                }
+            }
+            if (_intermediate) {
+                *p++ = _intermediate;
+            }
+            *p++ = a;
+            break;
+    }
 
-    return returnDump;
+    reportDecodingError({sequence, p});
 }
 
-void VtEmulator::reportDecodingError()
+void VtEmulator::reportDecodingError(ucs4_carray_view sequence)
 {
-    if (!_logFunction || tokenBufferPos == 0 || (tokenBufferPos == 1 && (tokenBuffer[0] & 0xff) >= 32)) {
+    if (!_logFunction) {
         return;
     }
 
-    auto string_buffer = hexdump2(tokenBuffer, tokenBufferPos);
-    string_buffer.push_back('\0');
-    _logFunction(string_buffer.data(), string_buffer.size() - 1u);
+    hexdump2(_logBuffer, sequence.data(), int(sequence.size()));
+    _logBuffer.push_back('\0');
+    _logFunction(_logBuffer.data(), _logBuffer.size() - 1u);
 }
 
 }
@@ -21,7 +21,10 @@
 */
 
 #include <array>
+#include <chrono>
 #include <functional> // std::function
+#include <memory>
+#include <vector>
 
 #include "rvt/charsets.hpp"
 #include "rvt/screen.hpp"
@@ -40,6 +43,9 @@ struct CharCodes
     CharsetId sa_charset_id = CharsetId::Undefined; // saved charset.
 };
 
+/// State of the VtEmulator tokenizer (defined in vt_emulator.cpp)
+enum class VtParserState : uint8_t;
+
 
 /**
  * Provides an xterm compatible terminal emulation based on the DEC VT102 terminal.
@@ -65,9 +71,82 @@ public:
     void reset();
 
     Screen const & getCurrentScreen() const noexcept { return *_currentScreen; }
-    array_view<ucs4_char const> getWindowTitle() const noexcept { return {windowTitle, windowTitleLen}; }
+    array_view<ucs4_char const> getWindowTitle() const noexcept { return {_windowTitle.data(), _windowTitle.size()}; }
+
+    /// The title is truncated to MAX_TITLE_LENGTH characters.
+    void setWindowTitle(ucs4_carray_view title);
+
+    static constexpr std::size_t MAX_TITLE_LENGTH = 255;
+
+    /**
+     * The alternate screen is allocated when an application switches to it.
+     * Once the primary screen has been used again for \c delay, it is released
+     * by receiveChars() along with its content. A negative delay keeps it forever.
+     */
+    void setAlternateScreenReleaseDelay(std::chrono::milliseconds delay) noexcept
+    {
+        this->_altScreenReleaseDelay = delay;
+    }
+
+    bool hasAlternateScreen() const noexcept { return bool(_screen1); }
+
+    /**
+     * Reflows the wrapped lines of the primary screen on setScreenSize() (see Screen::setReflowLines()).
+     * The alternate screen is never reflowed: its application redraws it.
+     */
+    void setReflowLines(bool enable) noexcept { _screen0.setReflowLines(enable); }
+
+    /**
+     * Keeps the lines scrolled out of the primary screen in its history (see Screen::setScrollbackSize()).
+     * The alternate screen has no history.
+     */
+    void setScrollbackSize(std::size_t maxLines) { _screen0.setScrollbackSize(maxLines); }
+    void setScrollbackFile(char const * filename, int mode) { _screen0.setScrollbackFile(filename, mode); }
+    Scrollback const * scrollback() const noexcept { return _screen0.scrollback(); }
+
+    /// Bytes allocated by the emulator.
+    struct MemoryUsage
+    {
+        std::size_t emulator = 0; // the emulator itself, the titles and the log buffer
+        Screen::MemoryUsage primaryScreen;
+        Screen::MemoryUsage alternateScreen; // empty when the alternate screen is not allocated
+
+        std::size_t total() const noexcept
+        { return emulator + primaryScreen.total() + alternateScreen.total(); }
+    };
 
-    void setWindowTitle(ucs4_carray_view title) noexcept;
+    MemoryUsage memoryUsage() const noexcept;
+
+    /**
+     * When the memory usage exceeds \c bytes after receiveChars(), the emulator
+     * releases what is not needed by the displayed content (see Screen::reduceMemoryUsage())
+     * and the alternate screen when it is not displayed. The content is never lost,
+     * hence the budget can still be exceeded. 0 disables the budget (default).
+     */
+    void setMemoryBudget(std::size_t bytes) noexcept
+    {
+        this->_memoryBudget = bytes;
+        this->_memoryUsageAfterReduction = 0;
+    }
+
+    /// Applies the reductions of setMemoryBudget() regardless of the budget.
+    void reduceMemoryUsage();
+
+    /**
+     * Releases all the memory which is not needed by the displayed content
+     * (see Screen::trim()), including the alternate screen when the primary
+     * screen is displayed, regardless of setAlternateScreenReleaseDelay().
+     * Intended for idle sessions.
+     */
+    void trim();
+
+    /**
+     * Changes of the displayed screen and of the title since the last resetDamage().
+     * All the lines are dirty when the current screen has been switched.
+     */
+    Damage getDamage() const noexcept;
+    bool isLineDirty(int y) const noexcept;
+    void resetDamage() noexcept;
 
     template<class F>
     void setLogFunction(F&& f)
@@ -75,10 +154,29 @@ public:
         this->_logFunction = static_cast<F&&>(f);
     }
 
+    /**
+     * Receives the payload of OSC sequences (ESC ] {Pn} ; ... BEL).
+     * The payload is sent by chunks with \c is_end = false,
+     * then the end of sequence is notified with an empty chunk and \c is_end = true.
+     */
+    template<class F>
+    void setOscFunction(F&& f)
+    {
+        this->_oscFunction = static_cast<F&&>(f);
+    }
+
     void receiveChar(ucs4_char cc);
+    /// Same as calling receiveChar() for each character, printable runs are sent to the screen in one go.
+    /// The lines of the scrolls are given to the LineSaver in batches before returning.
+    void receiveChars(ucs4_carray_view chars);
+    /// Commits the lines deferred by the scrolls of the screens (see Screen::saveDeferredLines()).
+    void saveDeferredLines();
     void setScreenSize(int lines, int columns);
 
 private:
+    // receiveChar() without saveDeferredLines()
+    void processChar(ucs4_char cc);
+
     // reimplemented from Emulation
     void setMode(Mode mode);
     void resetMode(Mode mode);
@@ -97,6 +195,9 @@ private:
     void resetCharset();
 
     void setScreen(int n);
+    // allocates the alternate screen when needed
+    Screen & alternateScreen();
+    void releaseAlternateScreen();
 
     void setMargins(int top, int bottom);
     //set margins for all screens back to their defaults
@@ -119,13 +220,18 @@ private:
     void resetModes();
 
     void resetTokenizer();
-    void addToCurrentToken(ucs4_char cc);
-    void processWindowAttributeRequest();
-    static constexpr int MAX_TOKEN_LENGTH = 256; // Max length of tokens (e.g. window title)
-    ucs4_char tokenBuffer[MAX_TOKEN_LENGTH];
-    int tokenBufferPos;
-    ucs4_char windowTitle[MAX_TOKEN_LENGTH];
-    unsigned windowTitleLen = 0;
+    void displayString(ucs4_carray_view str);
+    void processOscData(ucs4_carray_view data);
+    void processOscEnd();
+    VtParserState _parserState {};
+    ucs4_char _csiPrefix;    // private marker of CSI sequence ('?' or '>')
+    ucs4_char _intermediate; // intermediate character of escape sequence
+    // title being received, swapped with _windowTitle at the end of the OSC sequence
+    std::vector<ucs4_char> _pendingTitle;
+    std::vector<ucs4_char> _windowTitle;
+
+    // Title and CurrentScreen, the other damages are in the screens
+    Damage _damage = Damage::None;
 
     static constexpr int MAXARGS = 15;
     void addDigit(int dig);
@@ -133,9 +239,11 @@ private:
     int argv[MAXARGS];
     int argc;
 
-    void reportDecodingError();
+    void reportDecodingError(uint32_t token);
+    void reportDecodingError(ucs4_carray_view sequence);
 
     void processToken(uint32_t code, int32_t p, int q);
+    void processSelectGraphicRendition();
 
     // clears the screen and resizes it to the specified
     // number of columns
@@ -149,10 +257,28 @@ private:
     ModeFlags _savedModes;
 
     Screen _screen0;
-    Screen _screen1;
-    Screen * _currentScreen = &_screen1;
+    // alternate screen, allocated on first use
+    std::unique_ptr<Screen> _screen1;
+    Screen * _currentScreen = &_screen0;
+
+    // modes of the alternate screen when it is not allocated
+    Screen::ModeFlags _altScreenModes;
+    Screen::ModeFlags _altScreenSavedModes;
+
+    std::chrono::milliseconds _altScreenReleaseDelay {std::chrono::seconds(30)};
+    std::chrono::steady_clock::time_point _altScreenLeavingTime;
+
+    Screen::LineSaver _lineSaver;
+
+    void applyMemoryBudget();
+    void shrinkBuffers();
+    std::size_t _memoryBudget = 0;
+    std::size_t _memoryUsageAfterReduction = 0;
 
     std::function<void(char const *, std::size_t)> _logFunction;
+    // message of reportDecodingError(), kept to reuse its memory
+    std::vector<char> _logBuffer;
+    std::function<void(int command, ucs4_carray_view data, bool is_end)> _oscFunction;
 };
 
 }
@@ -23,9 +23,11 @@
 
 #include "rvt/character_color.hpp"
 #include "rvt/vt_emulator.hpp"
+#include "rvt/scrollback.hpp"
 #include "rvt/utf8_decoder.hpp"
 #include "rvt/text_rendering.hpp"
 
+#include <algorithm>
 #include <memory>
 
 #include <cerrno>
@@ -51,6 +53,17 @@ struct TerminalEmulator
     {}
 };
 
+struct TerminalEmulatorSnapshot
+{
+    TerminalEmulatorSnapshot(rvt::VtEmulator const & emulator)
+    : title(emulator.getWindowTitle().begin(), emulator.getWindowTitle().end())
+    , screen(emulator.getCurrentScreen().snapshot())
+    {}
+
+    std::vector<rvt::ucs4_char> title;
+    rvt::ScreenSnapshot screen;
+};
+
 struct TerminalEmulatorBuffer
 {
     void * ctx;
@@ -60,6 +73,8 @@ struct TerminalEmulatorBuffer
     TerminalEmulatorBufferClearFn * clear_fn;
     TerminalEmulatorBufferDeleteCtxFn * delete_ctx_fn;
     void(*delete_self)(TerminalEmulatorBuffer* self) noexcept;
+    rvt::JsonPatchState patch_state {};
+    rvt::AnsiDiffState ansi_diff_state {};
 
     rvt::RenderingBuffer as_rendering_buffer()
     {
@@ -205,8 +220,9 @@ static int errno_or_single_error() noexcept
     return errnum ? errnum : -1;
 }
 
+template<class ScreenT>
 static int build_format_string(
-    TerminalEmulatorBuffer & buffer, TerminalEmulator & emu,
+    TerminalEmulatorBuffer & buffer, rvt::ucs4_carray_view title, ScreenT const & screen,
     TerminalEmulatorOutputFormat format, std::string_view extra_data
 ) noexcept
 {
@@ -215,8 +231,8 @@ static int build_format_string(
         #define call_rendering(Format)                 \
             case TerminalEmulatorOutputFormat::Format: \
                 rvt::Format##_rendering(               \
-                    emu.emulator.getWindowTitle(),     \
-                    emu.emulator.getCurrentScreen(),   \
+                    title,                             \
+                    screen,                            \
                     rvt::xterm_color_table,            \
                     rendering_buffer,                  \
                     extra_data                         \
@@ -224,6 +240,23 @@ static int build_format_string(
         switch (format) {
             call_rendering(json);
             call_rendering(ansi);
+            case TerminalEmulatorOutputFormat::json_patch:
+                rvt::json_patch_rendering(
+                    title,
+                    screen,
+                    rvt::xterm_color_table,
+                    rendering_buffer,
+                    buffer.patch_state,
+                    extra_data
+                ); return 0;
+            case TerminalEmulatorOutputFormat::ansi_diff:
+                rvt::ansi_diff_rendering(
+                    title,
+                    screen,
+                    rendering_buffer,
+                    buffer.ansi_diff_state,
+                    extra_data
+                ); return 0;
         }
         #undef call_rendering
         return -2;
@@ -233,6 +266,19 @@ static int build_format_string(
     }
 }
 
+// calls f(y, yend) for each line of [y, yend) with its wrapped continuation
+template<class F>
+static void for_each_logical_line(rvt::Screen const& screen, size_t y, size_t yend, F&& f)
+{
+    auto const&& lineProperties = screen.getLineProperties();
+    while (y < yend) {
+        size_t const first = y;
+        while (++y < yend && bool(lineProperties[y-1] & rvt::LineProperty::Wrapped)) {
+        }
+        f(first, y);
+    }
+}
+
 extern "C"
 {
 
@@ -265,6 +311,20 @@ int terminal_emulator_delete(TerminalEmulator * emu) noexcept
     return 0;
 }
 
+REDEMPTION_LIB_EXPORT
+TerminalEmulatorSnapshot * terminal_emulator_snapshot_new(TerminalEmulator const * emu) noexcept
+{
+    return_nullptr_if(!emu);
+    Panic(return new(std::nothrow) TerminalEmulatorSnapshot(emu->emulator), nullptr);
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_snapshot_delete(TerminalEmulatorSnapshot * snapshot) noexcept
+{
+    delete snapshot;
+    return 0;
+}
+
 REDEMPTION_LIB_EXPORT
 int terminal_emulator_finish(TerminalEmulator * emu) noexcept
 {
@@ -296,7 +356,7 @@ int terminal_emulator_set_title(TerminalEmulator * emu, char const * title) noex
     }
     emu->decoder.end_decode(send_fn);
 
-    emu->emulator.setWindowTitle({ucs_title, std::size_t(p-ucs_title)});
+    Panic_errno(emu->emulator.setWindowTitle({ucs_title, std::size_t(p-ucs_title)}));
     return 0;
 }
 
@@ -329,8 +389,8 @@ int terminal_emulator_feed(TerminalEmulator * emu, uint8_t const * s, std::size_
 {
     return_if(!emu);
 
-    auto send_fn = [emu](rvt::ucs4_char ucs) { emu->emulator.receiveChar(ucs); };
-    Panic_errno(emu->decoder.decode(const_bytes_array(s, len), send_fn));
+    auto send_fn = [emu](rvt::ucs4_carray_view ucs) { emu->emulator.receiveChars(ucs); };
+    Panic_errno(emu->decoder.decode_block(const_bytes_array(s, len), send_fn));
     return 0;
 }
 
@@ -348,6 +408,122 @@ int terminal_emulator_resize(TerminalEmulator * emu, int lines, int columns) noe
     return 0;
 }
 
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_resize_reflow(TerminalEmulator * emu, bool enable) noexcept
+{
+    return_if(!emu);
+
+    emu->emulator.setReflowLines(enable);
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_scrollback_size(TerminalEmulator * emu, std::size_t max_lines) noexcept
+{
+    return_if(!emu);
+
+    Panic_errno(emu->emulator.setScrollbackSize(max_lines));
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_scrollback_file(
+    TerminalEmulator * emu, char const * filename, int mode) noexcept
+{
+    return_if(!emu || !filename || !emu->emulator.scrollback());
+
+    Panic_errno(emu->emulator.setScrollbackFile(filename, mode));
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_get_scrollback_lines(
+    TerminalEmulator const * emu, std::size_t * lines) noexcept
+{
+    return_if(!emu || !lines);
+
+    auto const * scrollback = emu->emulator.scrollback();
+    *lines = scrollback ? scrollback->size() : 0;
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_alternate_screen_release_delay(
+    TerminalEmulator * emu, int milliseconds) noexcept
+{
+    return_if(!emu);
+
+    emu->emulator.setAlternateScreenReleaseDelay(std::chrono::milliseconds(milliseconds));
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_memory_usage(
+    TerminalEmulator const * emu, TerminalEmulatorMemoryUsage * usage) noexcept
+{
+    return_if(!emu || !usage);
+
+    auto const u = emu->emulator.memoryUsage();
+    auto const & s0 = u.primaryScreen;
+    auto const & s1 = u.alternateScreen;
+    usage->total = u.total() + sizeof(TerminalEmulator) - sizeof(rvt::VtEmulator);
+    usage->emulator = u.emulator + sizeof(TerminalEmulator) - sizeof(rvt::VtEmulator);
+    usage->cells = s0.cells + s1.cells;
+    usage->line_properties = s0.lineProperties + s1.lineProperties;
+    usage->tab_stops = s0.tabStops + s1.tabStops;
+    usage->styles = s0.styles + s1.styles;
+    usage->extended_chars = s0.extendedChars + s1.extendedChars;
+    usage->alternate_screen = s1.total();
+    usage->scrollback = s0.scrollback;
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_memory_budget(TerminalEmulator * emu, std::size_t bytes) noexcept
+{
+    return_if(!emu);
+
+    emu->emulator.setMemoryBudget(bytes);
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_trim(TerminalEmulator * emu) noexcept
+{
+    return_if(!emu);
+
+    Panic_errno(emu->emulator.trim());
+    return 0;
+}
+
+
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_get_damage(
+    TerminalEmulator const * emu, int * damage,
+    uint8_t * dirty_lines, std::size_t dirty_lines_len) noexcept
+{
+    return_if(!emu || !damage);
+
+    rvt::VtEmulator const & emulator = emu->emulator;
+    *damage = int(emulator.getDamage());
+    if (dirty_lines) {
+        auto const lines = std::min(dirty_lines_len, std::size_t(emulator.getCurrentScreen().getLines()));
+        for (std::size_t y = 0; y < lines; ++y) {
+            dirty_lines[y] = emulator.isLineDirty(int(y)) ? 1 : 0;
+        }
+    }
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_reset_damage(TerminalEmulator * emu) noexcept
+{
+    return_if(!emu);
+
+    emu->emulator.resetDamage();
+    return 0;
+}
 
 
 REDEMPTION_LIB_EXPORT
@@ -408,7 +584,8 @@ int terminal_emulator_buffer_prepare(
 {
     return_if(!buffer || !emu);
 
-    return build_format_string(*buffer, *emu, format, {});
+    return build_format_string(
+        *buffer, emu->emulator.getWindowTitle(), emu->emulator.getCurrentScreen(), format, {});
 }
 
 REDEMPTION_LIB_EXPORT
@@ -421,7 +598,74 @@ int terminal_emulator_buffer_prepare2(
     return_if(!buffer || !emu);
 
     std::string_view extra = {const_bytes_t(extra_data).to_charp(), extra_data_len};
-    return build_format_string(*buffer, *emu, format, extra);
+    return build_format_string(
+        *buffer, emu->emulator.getWindowTitle(), emu->emulator.getCurrentScreen(), format, extra);
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_prepare_snapshot(
+    TerminalEmulatorBuffer * buffer, TerminalEmulatorSnapshot const * snapshot,
+    TerminalEmulatorOutputFormat format,
+    uint8_t const * extra_data, std::size_t extra_data_len
+) noexcept
+{
+    return_if(!buffer || !snapshot);
+
+    std::string_view extra = {const_bytes_t(extra_data).to_charp(), extra_data_len};
+    rvt::ucs4_carray_view title{snapshot->title.data(), snapshot->title.size()};
+    return build_format_string(*buffer, title, snapshot->screen, format, extra);
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_prepare_history(
+    TerminalEmulatorBuffer * buffer, TerminalEmulator * emu,
+    std::size_t first, std::size_t count,
+    uint8_t const * extra_data, std::size_t extra_data_len
+) noexcept
+{
+    return_if(!buffer || !emu);
+
+    std::string_view extra = {const_bytes_t(extra_data).to_charp(), extra_data_len};
+    rvt::RenderingBuffer rendering_buffer = buffer->as_rendering_buffer();
+    try {
+        rvt::ScrollbackLines history;
+        if (auto const * scrollback = emu->emulator.scrollback()) {
+            scrollback->readLines(first, count, history);
+        }
+        rvt::json_rendering(
+            emu->emulator.getWindowTitle(),
+            emu->emulator.getCurrentScreen(),
+            history,
+            rvt::xterm_color_table,
+            rendering_buffer,
+            extra
+        );
+        return 0;
+    }
+    catch (std::bad_alloc const&) {
+        return -3;
+    }
+    catch (...) {
+        return errno_or_single_error();
+    }
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_set_keyframe_interval(
+    TerminalEmulatorBuffer * buffer, unsigned interval) noexcept
+{
+    return_if(!buffer);
+    buffer->patch_state.keyframeInterval = interval;
+    return 0;
+}
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_request_keyframe(TerminalEmulatorBuffer * buffer) noexcept
+{
+    return_if(!buffer);
+    buffer->patch_state.reset();
+    buffer->ansi_diff_state.reset();
+    return 0;
 }
 
 REDEMPTION_LIB_EXPORT
@@ -668,8 +912,10 @@ int terminal_emulator_buffer_prepare_transcript_from_ttyrec(
         render.write_line(screen, y, yend);
     };
     auto line_saver_with_datetime = [&render](rvt::Screen const& screen, size_t y, size_t yend){
-        render.write_time();
-        render.write_line(screen, y, yend);
+        for_each_logical_line(screen, y, yend, [&](size_t first, size_t last){
+            render.write_time();
+            render.write_line(screen, first, last);
+        });
     };
 
     auto read4B = [](uint8_t const* p) -> uint32_t {
@@ -679,10 +925,11 @@ int terminal_emulator_buffer_prepare_transcript_from_ttyrec(
     auto run = [&]{
         rvt::VtEmulator emu(20, 80,
             (prefix_type == TerminalEmulatorTranscriptPrefix::datetime)
-            ? rvt::Screen::LineSaver(line_saver_with_datetime)
-            : rvt::Screen::LineSaver(line_saver));
+            ? rvt::Screen::LineSaver::from(line_saver_with_datetime)
+            : rvt::Screen::LineSaver::from(line_saver));
         rvt::Utf8Decoder decoder;
         auto ucs_receiver = [&emu](rvt::ucs4_char ucs) { emu.receiveChar(ucs); };
+        auto block_receiver = [&emu](rvt::ucs4_carray_view ucs) { emu.receiveChars(ucs); };
 
         while (!in.err && in.read(12)) {
             auto arr = in.advance(12);
@@ -695,20 +942,21 @@ int terminal_emulator_buffer_prepare_transcript_from_ttyrec(
                 bool r;
                 do {
                     frame_len -= in.remaining();
-                    decoder.decode(in.advance(in.remaining()), ucs_receiver);
+                    decoder.decode_block(in.advance(in.remaining()), block_receiver);
                 } while ((r = in.reset_and_read()) && frame_len > in.remaining());
 
                 if (!r) {
                     return in.err;
                 }
             }
-            decoder.decode(in.advance(frame_len), ucs_receiver);
+            decoder.decode_block(in.advance(frame_len), block_receiver);
         }
 
         if (in.err) {
             return in.err;
         }
         decoder.end_decode(ucs_receiver);
+        emu.saveDeferredLines();
         render.finalize();
 
         return 0;
@@ -748,7 +996,7 @@ int terminal_emulator_transcript_from_ttyrec(
         }
     }
 
-    using Line = array_view<const rvt::Character>;
+    using Line = rvt::Screen::ImageLine;
 
     class Out
     {
@@ -795,17 +1043,19 @@ int terminal_emulator_transcript_from_ttyrec(
 
         void write_line(rvt::Screen const& screen, size_t y, size_t yend)
         {
-            auto write_line_impl = [&](Line line){
-                for (auto const& ch : line) {
-                    if (REDEMPTION_UNLIKELY(ch.is_extended())) {
-                        for (auto ucs : screen.extendedCharTable()[ch.character]) {
+            auto write_line_impl = [&](Line const & line){
+                auto const code_points = line.codePoints();
+                auto const flags = line.flags();
+                for (std::size_t i = 0; i < line.size(); ++i) {
+                    if (REDEMPTION_UNLIKELY(bool(flags[i] & rvt::CellFlags::Extended))) {
+                        for (auto ucs : screen.extendedCharTable()[code_points[i]]) {
                             prepare();
                             pbuf += rvt::unsafe_ucs4_to_utf8(ucs, pbuf);
                         }
                     }
                     else {
                         prepare();
-                        pbuf += rvt::unsafe_ucs4_to_utf8(ch.character, pbuf);
+                        pbuf += rvt::unsafe_ucs4_to_utf8(code_points[i], pbuf);
                     }
                 }
             };
@@ -840,17 +1090,20 @@ int terminal_emulator_transcript_from_ttyrec(
         out.write_line(screen, y, yend);
     };
     auto line_saver_with_datetime = [&out](rvt::Screen const& screen, size_t y, size_t yend){
-        out.write_time();
-        out.write_line(screen, y, yend);
+        for_each_logical_line(screen, y, yend, [&](size_t first, size_t last){
+            out.write_time();
+            out.write_line(screen, first, last);
+        });
     };
 
     try {
         rvt::VtEmulator emu(20, 80,
             (prefix_type == TerminalEmulatorTranscriptPrefix::datetime)
-            ? rvt::Screen::LineSaver(line_saver_with_datetime)
-            : rvt::Screen::LineSaver(line_saver));
+            ? rvt::Screen::LineSaver::from(line_saver_with_datetime)
+            : rvt::Screen::LineSaver::from(line_saver));
         rvt::Utf8Decoder decoder;
         auto ucs_receiver = [&emu](rvt::ucs4_char ucs) { emu.receiveChar(ucs); };
+        auto block_receiver = [&emu](rvt::ucs4_carray_view ucs) { emu.receiveChars(ucs); };
         while (!in.err && in.read(12)) {
             auto arr = in.advance(12);
             uint32_t const sec  = arr[0] | (arr[1] << 8) | (arr[ 2] << 16) | (arr[ 3] << 24);
@@ -862,13 +1115,13 @@ int terminal_emulator_transcript_from_ttyrec(
                 bool r;
                 do {
                     frame_len -= in.remaining();
-                    decoder.decode(in.advance(in.remaining()), ucs_receiver);
+                    decoder.decode_block(in.advance(in.remaining()), block_receiver);
                 } while ((r = in.reset_and_read()) && frame_len > in.remaining());
                 if (!r) {
                     return in.err;
                 }
             }
-            decoder.decode(in.advance(frame_len), ucs_receiver);
+            decoder.decode_block(in.advance(frame_len), block_receiver);
 
             if (out.err) {
                 return out.err;
@@ -878,6 +1131,7 @@ int terminal_emulator_transcript_from_ttyrec(
             return in.err;
         }
         decoder.end_decode(ucs_receiver);
+        emu.saveDeferredLines();
     }
     catch (...) {
         return errno_or_single_error();
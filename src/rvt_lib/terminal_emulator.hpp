@@ -30,10 +30,17 @@ extern "C"
 
 class TerminalEmulator;
 class TerminalEmulatorBuffer;
+class TerminalEmulatorSnapshot;
 
 enum class TerminalEmulatorOutputFormat : int {
     json,
-    ansi
+    ansi,
+    /// json with only the changes since the previous prepare of the same buffer
+    /// and periodic keyframes (see terminal_emulator_buffer_set_keyframe_interval())
+    json_patch,
+    /// escape sequences which update the terminal which displays the previous
+    /// prepare of the same buffer (the first one redraws the whole screen)
+    ansi_diff,
 };
 
 enum class TerminalEmulatorTranscriptPrefix : int {
@@ -46,6 +53,32 @@ enum class TerminalEmulatorCreateFileMode : int {
     force_create,
 };
 
+/// Combination of flags.
+enum class TerminalEmulatorDamage : int {
+    none = 0,
+    lines = 1 << 0,
+    cursor = 1 << 1,
+    modes = 1 << 2,
+    size = 1 << 3,
+    title = 1 << 4,
+    current_screen = 1 << 5,
+};
+
+/// Bytes allocated by an emulator.
+/// The screen categories are the sum of the primary and the alternate screen.
+struct TerminalEmulatorMemoryUsage
+{
+    std::size_t total;
+    std::size_t emulator;
+    std::size_t cells;
+    std::size_t line_properties;
+    std::size_t tab_stops;
+    std::size_t styles;
+    std::size_t extended_chars;
+    std::size_t alternate_screen; // part of total used by the alternate screen
+    std::size_t scrollback;
+};
+
 
 /// \return  0 if success ; -3 for bad_alloc ; -2 if bad argument (emu is null, bad format, bad size, etc) ; -1 if internal error with `errno` code to 0 (bad alloc, etc) ; > 0 is an `errno` code,
 //@{
@@ -60,6 +93,17 @@ REDEMPTION_LIB_EXPORT
 int terminal_emulator_delete(TerminalEmulator * emu) noexcept;
 //END ctor/dtor
 
+//BEGIN snapshot
+/// Captures the screen and the title of \c emu in O(lines), the rows are copied on write.
+/// A snapshot can be rendered and deleted on another thread than the one which feeds \c emu,
+/// it remains valid after the deletion of \c emu.
+REDEMPTION_LIB_EXPORT
+TerminalEmulatorSnapshot * terminal_emulator_snapshot_new(TerminalEmulator const * emu) noexcept;
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_snapshot_delete(TerminalEmulatorSnapshot * snapshot) noexcept;
+//END snapshot
+
 //BEGIN log
 // str is zero-terminated
 using TerminalEmulatorLogFunction = void(char const * str, std::size_t len);
@@ -86,8 +130,70 @@ int terminal_emulator_finish(TerminalEmulator *) noexcept;
 
 REDEMPTION_LIB_EXPORT
 int terminal_emulator_resize(TerminalEmulator * emu, int lines, int columns) noexcept;
+
+/// When \c enable is true, terminal_emulator_resize() wraps again the wrapped lines
+/// of the primary screen at the new width instead of truncating them.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_resize_reflow(TerminalEmulator * emu, bool enable) noexcept;
+
+/// Keeps up to \c max_lines lines scrolled out of the primary screen in a compressed
+/// history (see terminal_emulator_buffer_prepare_history()). 0 (default) disables
+/// it and releases the history.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_scrollback_size(TerminalEmulator * emu, std::size_t max_lines) noexcept;
+
+/// Appends the compressed history to \c filename (created or truncated with \c mode)
+/// instead of keeping it in memory, the history is read back through a memory mapping.
+/// For very long sessions: the file keeps growing even when the oldest lines leave
+/// the history. The history must be enabled with terminal_emulator_set_scrollback_size().
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_scrollback_file(
+    TerminalEmulator * emu, char const * filename, int mode) noexcept;
+
+/// \c *lines receives the number of lines in the history.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_get_scrollback_lines(
+    TerminalEmulator const * emu, std::size_t * lines) noexcept;
+
+/// The alternate screen is released after \c milliseconds on the primary screen
+/// (30 seconds by default). A negative value keeps it allocated.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_alternate_screen_release_delay(
+    TerminalEmulator * emu, int milliseconds) noexcept;
 //END emulator
 
+//BEGIN memory
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_memory_usage(
+    TerminalEmulator const * emu, TerminalEmulatorMemoryUsage * usage) noexcept;
+
+/// Soft limit checked after each feed: over \c bytes, the memory which is
+/// not needed by the displayed content is released (unused alternate screen,
+/// unreferenced combining sequences, preallocated space). 0 disables the budget.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_set_memory_budget(TerminalEmulator * emu, std::size_t bytes) noexcept;
+
+/// Shrinks \c emu to its displayed content: for idle sessions.
+/// The alternate screen is released when it is not displayed.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_trim(TerminalEmulator * emu) noexcept;
+//END memory
+
+//BEGIN damage
+/// Changes since the last terminal_emulator_reset_damage() (or the creation of \c emu).
+/// \param damage       receives a combination of TerminalEmulatorDamage
+/// \param dirty_lines  when not null, dirty_lines[y] is set to 1 when the line y
+///                     of the displayed screen changed, 0 otherwise
+/// \param dirty_lines_len  number of lines written in \c dirty_lines (up to the number of lines)
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_get_damage(
+    TerminalEmulator const * emu, int * damage,
+    uint8_t * dirty_lines, std::size_t dirty_lines_len) noexcept;
+
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_reset_damage(TerminalEmulator * emu) noexcept;
+//END damage
+
 //BEGIN buffer
 using TerminalEmulatorBufferGetBufferFn
   = uint8_t*(void * ctx, std::size_t * output_len) noexcept;
@@ -132,6 +238,34 @@ int terminal_emulator_buffer_prepare2(
     TerminalEmulatorOutputFormat format, uint8_t const * extra_data,
     std::size_t extra_data_len) noexcept;
 
+/// Same as terminal_emulator_buffer_prepare2() with a snapshot.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_prepare_snapshot(
+    TerminalEmulatorBuffer * buffer, TerminalEmulatorSnapshot const * snapshot,
+    TerminalEmulatorOutputFormat format, uint8_t const * extra_data,
+    std::size_t extra_data_len) noexcept;
+
+/// Same as terminal_emulator_buffer_prepare2() with TerminalEmulatorOutputFormat::json,
+/// the lines [\c first, \c first + \c count) of the history (0 is the oldest line)
+/// are in a "history" array before "data".
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_prepare_history(
+    TerminalEmulatorBuffer * buffer, TerminalEmulator * emu,
+    std::size_t first, std::size_t count,
+    uint8_t const * extra_data, std::size_t extra_data_len) noexcept;
+
+/// With TerminalEmulatorOutputFormat::json_patch, a full json is emitted
+/// every \c interval prepares (64 by default), 0 for only when the size changes.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_set_keyframe_interval(
+    TerminalEmulatorBuffer * buffer, unsigned interval) noexcept;
+
+/// The next prepare with TerminalEmulatorOutputFormat::json_patch emits a full json,
+/// with TerminalEmulatorOutputFormat::ansi_diff redraws the whole screen.
+/// For a new client or when \c buffer is used with another emulator.
+REDEMPTION_LIB_EXPORT
+int terminal_emulator_buffer_request_keyframe(TerminalEmulatorBuffer * buffer) noexcept;
+
 REDEMPTION_LIB_EXPORT
 uint8_t const * terminal_emulator_buffer_get_data(
     TerminalEmulatorBuffer const * buffer, std::size_t * output_len) noexcept;
@@ -0,0 +1,110 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#define BOOST_TEST_MODULE AsciiScan
+#include "system/redemption_unit_tests.hpp"
+
+#include "rvt/ascii_scan.hpp"
+
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(TestFindNonPrintableAscii)
+{
+    std::vector<uint8_t> s(100, 'a');
+    auto const first = s.data();
+    auto const last = s.data() + s.size();
+
+    BOOST_CHECK_EQUAL(rvt::find_non_printable_ascii(first, last) - first, 100);
+    BOOST_CHECK_EQUAL(rvt::find_non_printable_ascii(first, first) - first, 0);
+
+    for (int c : {0, 7, 0x1b, 0x1f, 0x7f, 0x80, 0xc3, 0xff}) {
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            s[i] = uint8_t(c);
+            BOOST_CHECK_EQUAL(rvt::find_non_printable_ascii(first, last) - first, i);
+            BOOST_CHECK_EQUAL(rvt::find_non_printable_ascii(first + i + 1, last) - first, 100);
+            s[i] = 'a';
+        }
+    }
+
+    for (int c : {0x20, int('0'), int('z'), int('~')}) {
+        s[50] = uint8_t(c);
+        BOOST_CHECK_EQUAL(rvt::find_non_printable_ascii(first, last) - first, 100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFindNotEqual)
+{
+    std::vector<uint8_t> s(100, 1);
+    auto const first = s.data();
+    auto const last = s.data() + s.size();
+
+    BOOST_CHECK_EQUAL(rvt::find_not_equal(first, last, 1) - first, 100);
+    BOOST_CHECK_EQUAL(rvt::find_not_equal(first, last, 0) - first, 0);
+
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        s[i] = 3;
+        BOOST_CHECK_EQUAL(rvt::find_not_equal(first, last, 1) - first, i);
+        BOOST_CHECK_EQUAL(rvt::find_not_equal(first + i + 1, last, 1) - first, 100);
+        s[i] = 1;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFindJsonNonPlainAscii)
+{
+    std::vector<uint32_t> s(100, 'a');
+    auto const first = s.data();
+    auto const last = s.data() + s.size();
+
+    BOOST_CHECK_EQUAL(rvt::find_json_non_plain_ascii(first, last) - first, 100);
+    BOOST_CHECK_EQUAL(rvt::find_json_non_plain_ascii(first, first) - first, 0);
+
+    for (uint32_t c : {0u, 0x1fu, uint32_t('"'), uint32_t('\\'), 0x7fu, 0x80u, 0xe9u,
+                       0x2502u, 0x10ffffu, 0x7fffffffu, 0x80000000u, 0xffffffffu}) {
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            s[i] = c;
+            BOOST_CHECK_EQUAL(rvt::find_json_non_plain_ascii(first, last) - first, i);
+            BOOST_CHECK_EQUAL(rvt::find_json_non_plain_ascii(first + i + 1, last) - first, 100);
+            s[i] = 'a';
+        }
+    }
+
+    for (uint32_t c : {0x20u, uint32_t('0'), uint32_t('['), uint32_t('~')}) {
+        s[50] = c;
+        BOOST_CHECK_EQUAL(rvt::find_json_non_plain_ascii(first, last) - first, 100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestNarrowAscii)
+{
+    std::vector<uint32_t> s;
+    for (uint32_t c = 0; c < 0x80; ++c) {
+        s.push_back(c);
+    }
+
+    for (std::size_t n : {0u, 3u, 16u, 37u, 128u}) {
+        char out[130];
+        out[n] = 'x';
+        BOOST_CHECK_EQUAL(rvt::narrow_ascii(s.data(), s.data() + n, out) - out, n);
+        BOOST_CHECK_EQUAL(out[n], 'x');
+        for (std::size_t i = 0; i < n; ++i) {
+            BOOST_CHECK_EQUAL(int(out[i]), int(s[i]));
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#define BOOST_TEST_MODULE CellArray
+#include "system/redemption_unit_tests.hpp"
+
+#include "rvt/cell_array.hpp"
+
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(TestCellArray)
+{
+    rvt::CellArray cells(6);
+    BOOST_CHECK_EQUAL(cells.size(), 6);
+    BOOST_CHECK(cells.get(0) == rvt::Cell());
+
+    cells.set(1, rvt::Cell{'a', 2, true, false});
+    cells.set(2, rvt::Cell{3, 4, false, true});
+    BOOST_CHECK(cells.get(1) == (rvt::Cell{'a', 2, true, false}));
+    BOOST_CHECK(cells.get(2) == (rvt::Cell{3, 4, false, true}));
+    BOOST_CHECK_EQUAL(cells.codePoints()[1], 'a');
+    BOOST_CHECK_EQUAL(cells.styles()[2], 4);
+    BOOST_CHECK(cells.flags()[1] == rvt::CellFlags::Real);
+    BOOST_CHECK(cells.flags()[2] == rvt::CellFlags::Extended);
+
+    cells.move(1, 3, 2);
+    BOOST_CHECK(cells.get(2) == (rvt::Cell{'a', 2, true, false}));
+    BOOST_CHECK(cells.get(3) == (rvt::Cell{3, 4, false, true}));
+
+    cells.fill(0, 2, rvt::Cell{'b', 1, false, false});
+    BOOST_CHECK(cells.get(0) == (rvt::Cell{'b', 1, false, false}));
+    BOOST_CHECK(cells.get(1) == (rvt::Cell{'b', 1, false, false}));
+    BOOST_CHECK(cells.get(2) == (rvt::Cell{'a', 2, true, false}));
+
+    rvt::CellArray other(3);
+    other.copy(cells, 2, 2, 1);
+    BOOST_CHECK(other.get(0) == rvt::Cell());
+    BOOST_CHECK(other.get(1) == (rvt::Cell{'a', 2, true, false}));
+    BOOST_CHECK(other.get(2) == (rvt::Cell{3, 4, false, true}));
+}
+
+BOOST_AUTO_TEST_CASE(TestFindStyleRunEnd)
+{
+    std::vector<rvt::StyleId> styles(100, 3);
+    auto const first = styles.data();
+    auto const last = styles.data() + styles.size();
+
+    BOOST_CHECK_EQUAL(rvt::find_style_run_end(first, last) - first, 100);
+    BOOST_CHECK_EQUAL(rvt::find_style_run_end(first, first) - first, 0);
+
+    for (rvt::StyleId style : {0, 2, 4, 0x103, 0xffff}) {
+        for (std::size_t i = 1; i < styles.size(); ++i) {
+            styles[i] = style;
+            BOOST_CHECK_EQUAL(rvt::find_style_run_end(first, last) - first, i);
+            BOOST_CHECK_EQUAL(rvt::find_style_run_end(first + i, last) - first, i + 1);
+            styles[i] = 3;
+        }
+    }
+}
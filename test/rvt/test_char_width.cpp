@@ -0,0 +1,73 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#define BOOST_TEST_MODULE CharWidth
+#include "system/redemption_unit_tests.hpp"
+
+#include "rvt/char_width.hpp"
+
+
+static_assert(rvt::char_width(U'a') == 1);
+static_assert(rvt::char_width(U'中') == 2);
+
+BOOST_AUTO_TEST_CASE(TestCharWidth)
+{
+    // controls
+    BOOST_CHECK_EQUAL(rvt::char_width(0), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1b), -1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x7f), -1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x9b), -1);
+
+    for (rvt::ucs4_char c = 0x20; c < 0x7f; ++c) {
+        BOOST_CHECK_EQUAL(rvt::char_width(c), 1);
+    }
+    BOOST_CHECK_EQUAL(rvt::char_width(U'é'), 1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xAD), 1); // soft hyphen
+
+    // zero width
+    BOOST_CHECK_EQUAL(rvt::char_width(0x0301), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x200B), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x200D), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1160), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xFE0F), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xE0100), 0);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1E08F), 0); // Unicode 15
+
+    // wide
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1100), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x3000), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x303F), 1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xAC00), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xFF01), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x20000), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x3FFFD), 2);
+
+    // emoji
+    BOOST_CHECK_EQUAL(rvt::char_width(0x231A), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x2764), 1); // text presentation by default
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1F600), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1F3FB), 2);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1FA77), 2); // Unicode 15
+    BOOST_CHECK_EQUAL(rvt::char_width(0x1FAE8), 2); // Unicode 15
+
+    BOOST_CHECK_EQUAL(rvt::char_width(0x10FFFF), 1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0x110000), 1);
+    BOOST_CHECK_EQUAL(rvt::char_width(0xFFFFFFFF), 1);
+}
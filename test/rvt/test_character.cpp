@@ -23,6 +23,8 @@
 
 #include "rvt/character.hpp"
 
+#include <vector>
+
 BOOST_AUTO_TEST_CASE(TestCharacter)
 {
     rvt::Character ch('e');
@@ -47,3 +49,77 @@ BOOST_AUTO_TEST_CASE(TestCharacter)
         BOOST_CHECK_EQUAL_RANGES(ucs, ext_ch_table[ch.character]);
     }
 }
+
+BOOST_AUTO_TEST_CASE(TestStyleTable)
+{
+    rvt::StyleTable styles;
+    BOOST_CHECK_EQUAL(styles.size(), 1);
+    BOOST_CHECK(styles[rvt::StyleTable::DefaultStyle] == rvt::CharacterStyle());
+
+    rvt::CharacterColor fg(rvt::ColorSpace::System, 1);
+    rvt::CharacterColor bg(rvt::ColorSpace::RGB, 0x010203);
+
+    rvt::StyleId id = 42;
+    BOOST_CHECK(styles.intern(rvt::CharacterStyle(), id));
+    BOOST_CHECK_EQUAL(id, rvt::StyleTable::DefaultStyle);
+
+    rvt::StyleId bold_id;
+    BOOST_CHECK(styles.intern({rvt::Rendition::Bold, fg, bg}, bold_id));
+    BOOST_CHECK_EQUAL(bold_id, 1);
+    rvt::StyleId italic_id;
+    BOOST_CHECK(styles.intern({rvt::Rendition::Italic, fg, bg}, italic_id));
+    BOOST_CHECK_EQUAL(italic_id, 2);
+    BOOST_CHECK(styles.intern({rvt::Rendition::Bold, fg, bg}, id));
+    BOOST_CHECK_EQUAL(id, bold_id);
+    BOOST_CHECK_EQUAL(styles.size(), 3);
+
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK(styles.intern({rvt::Rendition::Default, rvt::CharacterColor(rvt::ColorSpace::RGB, i), bg}, id));
+        BOOST_CHECK_EQUAL(id, i + 3);
+    }
+    BOOST_CHECK(styles.intern({rvt::Rendition::Italic, fg, bg}, id));
+    BOOST_CHECK_EQUAL(id, italic_id);
+
+    rvt::Cell cell{'a', italic_id, true, false};
+    BOOST_CHECK(styles.toCharacter(cell) == rvt::Character('a', fg, bg, rvt::Rendition::Italic));
+    BOOST_CHECK(cell.equalsFormat(rvt::Cell{'b', italic_id, true, false}));
+    BOOST_CHECK(!cell.equalsFormat(rvt::Cell{'a', bold_id, true, false}));
+
+    bool used[103] {};
+    used[italic_id] = true;
+    used[50] = true;
+    rvt::StyleId remap[103];
+    styles.compact(used, remap);
+    BOOST_CHECK_EQUAL(styles.size(), 3);
+    BOOST_CHECK_EQUAL(remap[italic_id], 1);
+    BOOST_CHECK_EQUAL(remap[50], 2);
+    BOOST_CHECK(styles.intern({rvt::Rendition::Italic, fg, bg}, id));
+    BOOST_CHECK_EQUAL(id, 1);
+    BOOST_CHECK(styles.intern({rvt::Rendition::Bold, fg, bg}, id));
+    BOOST_CHECK_EQUAL(id, 3);
+}
+
+BOOST_AUTO_TEST_CASE(TestExtendedCharTableGrowth)
+{
+    rvt::ExtendedCharTable ext_ch_table;
+    rvt::Cell cell1{'a'};
+    rvt::Cell cell2{'b'};
+
+    std::vector<rvt::ucs4_char> ucs1{'a'};
+    std::vector<rvt::ucs4_char> ucs2{'b'};
+    for (rvt::ucs4_char uc = 0x300; uc < 0x320; ++uc) {
+        ext_ch_table.growChar(cell1, uc);
+        ucs1.push_back(uc);
+        ext_ch_table.growChar(cell2, uc + 0x10);
+        ucs2.push_back(uc + 0x10);
+        BOOST_CHECK_EQUAL_RANGES(ucs1, ext_ch_table[cell1.character]);
+        BOOST_CHECK_EQUAL_RANGES(ucs2, ext_ch_table[cell2.character]);
+    }
+    BOOST_CHECK_EQUAL(ext_ch_table.size(), 2);
+
+    rvt::ExtendedCharTable compacted;
+    BOOST_CHECK_EQUAL(ext_ch_table.compactInto(compacted, cell2.character), 0);
+    BOOST_CHECK_EQUAL(compacted.size(), 1);
+    BOOST_CHECK_EQUAL(compacted.arenaSize(), ucs2.size());
+    BOOST_CHECK_EQUAL_RANGES(ucs2, compacted[0]);
+}
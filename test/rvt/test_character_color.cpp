@@ -174,3 +174,46 @@ BOOST_AUTO_TEST_CASE(TestCharacterColor)
     color.setDim();
     BOOST_CHECK_EQUAL(color.color(color_table), to_dim(rvt::Color(0x12, 0x34, 0x56)));
 }
+
+BOOST_AUTO_TEST_CASE(TestCharacterColorValue)
+{
+    using rvt::CharacterColor;
+    using rvt::ColorSpace;
+
+    CharacterColor color(ColorSpace::System, 3);
+    BOOST_CHECK(ColorSpace::System == color.colorSpace());
+    BOOST_CHECK_EQUAL(3, color.value());
+    color.setIntensive();
+    BOOST_CHECK_EQUAL(11, color.value());
+    color.setDim();
+    BOOST_CHECK(ColorSpace::System == color.colorSpace());
+    BOOST_CHECK_EQUAL(11, color.value());
+
+    color = CharacterColor(ColorSpace::Default, 1);
+    color.setIntensive();
+    BOOST_CHECK(ColorSpace::Default == color.colorSpace());
+    BOOST_CHECK_EQUAL(1, color.value());
+
+    BOOST_CHECK_EQUAL(200, CharacterColor(ColorSpace::Index256, 200).value());
+    BOOST_CHECK_EQUAL(0x12AB34, CharacterColor(ColorSpace::RGB, 0x12AB34).value());
+}
+
+BOOST_AUTO_TEST_CASE(TestCharacterColorFromPacked)
+{
+    using rvt::CharacterColor;
+    using rvt::ColorSpace;
+
+    CharacterColor dim(ColorSpace::System, 5);
+    dim.setIntensive();
+    dim.setDim();
+
+    for (CharacterColor const & color : {
+        CharacterColor(),
+        CharacterColor(ColorSpace::Default, 1),
+        dim,
+        CharacterColor(ColorSpace::Index256, 200),
+        CharacterColor(ColorSpace::RGB, 0x12AB34),
+    }) {
+        BOOST_CHECK(color == CharacterColor::fromPacked(color.packed()));
+    }
+}
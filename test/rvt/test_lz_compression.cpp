@@ -0,0 +1,100 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#define BOOST_TEST_MODULE LzCompression
+#include "system/redemption_unit_tests.hpp"
+
+#include "rvt/lz_compression.hpp"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::vector<uint8_t> roundtrip(std::vector<uint8_t> const & data, std::size_t * compressed_size = nullptr)
+    {
+        std::vector<uint8_t> compressed;
+        rvt::lz::compress(data.data(), data.size(), compressed);
+        BOOST_CHECK_LE(compressed.size(), rvt::lz::compress_bound(data.size()));
+        if (compressed_size) {
+            *compressed_size = compressed.size();
+        }
+
+        std::vector<uint8_t> out {42};
+        BOOST_CHECK(rvt::lz::decompress(compressed.data(), compressed.size(), data.size(), out));
+        BOOST_REQUIRE_EQUAL(out.size(), data.size() + 1);
+        BOOST_CHECK_EQUAL(out[0], 42);
+        return std::vector<uint8_t>(out.begin() + 1, out.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestLzRoundtrip)
+{
+    for (std::size_t len : {0, 1, 4, 12, 13, 17, 100, 1000}) {
+        std::vector<uint8_t> data(len);
+        uint32_t x = 1;
+        for (auto & c : data) {
+            x = x * 1103515245u + 12345u;
+            c = uint8_t(x >> 16);
+        }
+        BOOST_CHECK(roundtrip(data) == data);
+    }
+
+    std::string const s =
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+        "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.";
+    std::vector<uint8_t> const text(s.begin(), s.end());
+    std::size_t compressed_size = 0;
+    BOOST_CHECK(roundtrip(text, &compressed_size) == text);
+    BOOST_CHECK_LT(compressed_size, text.size() - 40);
+
+    // long runs: overlapping matches and length extensions
+    std::vector<uint8_t> runs(100000, 'a');
+    for (std::size_t i = 0; i < runs.size(); i += 1000) {
+        runs[i] = uint8_t(i / 1000);
+    }
+    BOOST_CHECK(roundtrip(runs, &compressed_size) == runs);
+    BOOST_CHECK_LT(compressed_size, 2000);
+}
+
+BOOST_AUTO_TEST_CASE(TestLzMalformed)
+{
+    std::string const s = "abcdefabcdefabcdefabcdefabcdefabcdef";
+    std::vector<uint8_t> compressed;
+    rvt::lz::compress(reinterpret_cast<uint8_t const *>(s.data()), s.size(), compressed);
+
+    std::vector<uint8_t> out;
+    // bad size
+    BOOST_CHECK(!rvt::lz::decompress(compressed.data(), compressed.size(), s.size() + 1, out));
+    BOOST_CHECK(!rvt::lz::decompress(compressed.data(), compressed.size(), s.size() - 1, out));
+    // truncated
+    for (std::size_t i = 0; i < compressed.size(); ++i) {
+        BOOST_CHECK(!rvt::lz::decompress(compressed.data(), i, s.size(), out));
+    }
+    BOOST_CHECK(out.empty());
+
+    // offset beyond the beginning
+    uint8_t const bad_offset[] {0x10, 'a', 0x05, 0x00, 0x10, 'b'};
+    BOOST_CHECK(!rvt::lz::decompress(bad_offset, sizeof(bad_offset), 7, out));
+    uint8_t const good_offset[] {0x10, 'a', 0x01, 0x00, 0x10, 'b'};
+    BOOST_CHECK(rvt::lz::decompress(good_offset, sizeof(good_offset), 6, out));
+    BOOST_CHECK_EQUAL(std::string(out.begin(), out.end()), "aaaaab");
+}
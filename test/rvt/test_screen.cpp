@@ -23,6 +23,10 @@
 
 #include "rvt/screen.hpp"
 
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
 
 BOOST_AUTO_TEST_CASE(TestScreenCtor)
 {
@@ -111,7 +115,7 @@ BOOST_AUTO_TEST_CASE(TestScreenInsert)
         auto p = s.begin();
         auto screen_lines = screen.getScreenLines();
         for (int i{}; i < nlines; ++i) {
-            auto & lines = screen_lines[i];
+            auto lines = screen_lines[i];
             *p++ = '[';
             int effective_ncolumns(lines.size());
             int j = 0;
@@ -184,4 +188,510 @@ BOOST_AUTO_TEST_CASE(TestScreenInsert)
     screen.newLine();
     screen.displayCharacter('t');
     BOOST_CHECK_EQUAL(to_string(screen), "[r       ]\n[        ]\n[ s      ]\n[  t     ]\n");
+
+    // clear from the pending wrap column of the last line
+    rvt::Screen screen2(4, 6);
+    for (int i = 0; i < 6; ++i) {
+        screen2.displayCharacter('A');
+    }
+    screen2.setCursorYX(4, 6);
+    screen2.displayCharacter('x');
+    screen2.clearToBeginOfLine();
+    BOOST_CHECK_EQUAL(to_string(screen2), "[AAAAAA]\n[      ]\n[      ]\n[      ]\n");
+    screen2.setCursorYX(4, 6);
+    screen2.displayCharacter('y');
+    screen2.clearToBeginOfScreen();
+    BOOST_CHECK_EQUAL(to_string(screen2), "[      ]\n[      ]\n[      ]\n[      ]\n");
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenDisplayString)
+{
+    auto check_same = [](rvt::Screen const & screen1, rvt::Screen const & screen2) {
+        BOOST_CHECK_EQUAL(screen1.getCursorX(), screen2.getCursorX());
+        BOOST_CHECK_EQUAL(screen1.getCursorY(), screen2.getCursorY());
+        auto lines1 = screen1.getScreenLines();
+        auto lines2 = screen2.getScreenLines();
+        for (int i{}; i < screen1.getLines(); ++i) {
+            BOOST_CHECK_EQUAL(lines1[i].size(), lines2[i].size());
+            BOOST_CHECK(std::equal(lines1[i].begin(), lines1[i].end(), lines2[i].begin(), lines2[i].end()));
+            BOOST_CHECK(screen1.getLineProperties()[i] == screen2.getLineProperties()[i]);
+        }
+    };
+
+    using Mode = rvt::Screen::Mode;
+
+    auto test = [&](Mode mode, bool enable, std::u32string_view str) {
+        rvt::Screen screen1(4, 8);
+        rvt::Screen screen2(4, 8);
+        if (enable) {
+            screen1.setMode(mode);
+            screen2.setMode(mode);
+        }
+        else {
+            screen1.resetMode(mode);
+            screen2.resetMode(mode);
+        }
+        screen1.setCursorX(3);
+        screen2.setCursorX(3);
+        for (auto uc : str) {
+            screen1.displayCharacter(uc);
+        }
+        std::vector<rvt::ucs4_char> ucs(str.begin(), str.end());
+        screen2.displayString({ucs.data(), ucs.size()});
+        check_same(screen1, screen2);
+    };
+
+    for (auto mode : {Mode::Wrap, Mode::Insert}) {
+        for (bool enable : {true, false}) {
+            test(mode, enable, U"abc");
+            test(mode, enable, U"abcdefghijklmnopqrstuvwxyz");
+            test(mode, enable, U"abé́cdＡefＢg\U0001F600hijklmnopqrstuvwxyz");
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenScroll)
+{
+    auto to_string = [](rvt::Screen const & screen) {
+        std::string s;
+        auto lines = screen.getScreenLines();
+        auto properties = screen.getLineProperties();
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            s += bool(properties[i] & rvt::LineProperty::Wrapped) ? '+' : '[';
+            for (auto const & ch : lines[i]) {
+                s += char(ch.character);
+            }
+            s += "]";
+        }
+        return s;
+    };
+
+    rvt::Screen screen(4, 3);
+    for (char c : std::string_view("abcdefghijkl")) {
+        screen.displayCharacter(rvt::ucs4_char(c));
+    }
+    BOOST_CHECK_EQUAL(to_string(screen), "+abc]+def]+ghi][jkl]");
+
+    // whole screen
+    screen.scrollUp(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "+def]+ghi][jkl][]");
+    screen.setCursorYX(4, 1);
+    screen.displayCharacter('m');
+    BOOST_CHECK_EQUAL(to_string(screen), "+def]+ghi][jkl][m]");
+    screen.scrollDown(2);
+    BOOST_CHECK_EQUAL(to_string(screen), "[][]+def]+ghi]");
+    screen.scrollUp(3);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][][][]");
+
+    // region
+    screen.setCursorYX(2, 1);
+    screen.displayCharacter('n');
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('o');
+    screen.setCursorYX(4, 1);
+    screen.displayCharacter('p');
+    screen.setMargins(2, 3);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][n][o][p]");
+    screen.scrollUp(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][o][][p]");
+    screen.scrollDown(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][][o][p]");
+
+    screen.setDefaultMargins();
+    screen.setCursorYX(2, 1);
+    screen.insertLines(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][][][o]");
+    screen.deleteLines(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "+ghi][][o][]");
+    screen.scrollUp(1);
+    BOOST_CHECK_EQUAL(to_string(screen), "[][o][][]");
+
+    screen.setCursorYX(2, 1);
+    screen.resizeImage(1, 2);
+    BOOST_CHECK_EQUAL(to_string(screen), "[o]");
+
+    // insertion of lines from the bottom margin clears it
+    rvt::Screen screen2(4, 3);
+    screen2.helpAlign();
+    screen2.setCursorYX(4, 1);
+    screen2.insertLines(1);
+    BOOST_CHECK_EQUAL(to_string(screen2), "[EEE][EEE][EEE][]");
+    screen2.setCursorYX(3, 1);
+    screen2.insertLines(5);
+    BOOST_CHECK_EQUAL(to_string(screen2), "[EEE][EEE][][]");
+    screen2.setMargins(1, 2);
+    screen2.setCursorYX(2, 1);
+    screen2.insertLines(1);
+    BOOST_CHECK_EQUAL(to_string(screen2), "[EEE][][][]");
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenExtendedCharCompaction)
+{
+    rvt::Screen screen(2, 4);
+
+    // overwrite the same cells with combining sequences
+    for (int i = 0; i < 100; ++i) {
+        screen.home();
+        for (rvt::ucs4_char c : {U'a', U'́', U'̂', U'b', U'c', U'̃'}) {
+            screen.displayCharacter(c);
+        }
+    }
+
+    BOOST_CHECK_LE(screen.extendedCharTable().size(), 2 * 4 + 2);
+
+    auto line = screen.getScreenLines()[0];
+    BOOST_REQUIRE_EQUAL(line.size(), 3);
+    BOOST_REQUIRE(line[0].is_extended());
+    BOOST_REQUIRE(line[2].is_extended());
+    BOOST_CHECK(!line[1].is_extended());
+    auto const seq1 = screen.extendedCharTable()[line[0].character];
+    auto const seq2 = screen.extendedCharTable()[line[2].character];
+    BOOST_CHECK((std::u32string(seq1.begin(), seq1.end()) == U"á̂"));
+    BOOST_CHECK((std::u32string(seq2.begin(), seq2.end()) == U"c̃"));
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenSnapshot)
+{
+    auto line_to_string = [](auto const& line) {
+        std::string s;
+        for (std::size_t i = 0; i < line.size(); ++i) {
+            s += char(line[i].character);
+        }
+        return s;
+    };
+
+    rvt::Screen screen(3, 4);
+    for (rvt::ucs4_char c : {U'a', U'b', U'c', U'd'}) {
+        screen.displayCharacter(c);
+    }
+    screen.setCursorYX(2, 1);
+    screen.displayCharacter(U'e');
+    screen.displayCharacter(U'\u0301');
+
+    rvt::ScreenSnapshot snapshot = screen.snapshot();
+    BOOST_CHECK_EQUAL(snapshot.getLines(), 3);
+    BOOST_CHECK_EQUAL(snapshot.getColumns(), 4);
+    BOOST_CHECK_EQUAL(snapshot.getCursorY(), 1);
+    BOOST_CHECK_EQUAL(snapshot.getCursorX(), 1);
+
+    // writes after the snapshot only touch the screen
+    screen.setCursorYX(1, 2);
+    screen.displayCharacter(U'x');
+    screen.setCursorYX(2, 1);
+    screen.displayCharacter(U'y');
+    screen.displayCharacter(U'\u0302');
+    screen.setRendition(rvt::Rendition::Bold);
+    screen.displayCharacter(U'z');
+    screen.scrollUp(1);
+
+    BOOST_CHECK_EQUAL(line_to_string(snapshot.getScreenLine(0)), "abcd");
+    BOOST_CHECK_EQUAL(line_to_string(snapshot.getScreenLine(2)), "");
+    auto line = snapshot.getScreenLine(1);
+    BOOST_REQUIRE_EQUAL(line.size(), 1);
+    BOOST_REQUIRE(line[0].is_extended());
+    auto const seq = snapshot.extendedCharTable()[line[0].character];
+    BOOST_CHECK((std::u32string(seq.begin(), seq.end()) == U"e\u0301"));
+    BOOST_CHECK(!bool(line[0].rendition & rvt::Rendition::Bold));
+
+    BOOST_CHECK_EQUAL(line_to_string(screen.getScreenLine(2)), "");
+    auto screen_line = screen.getScreenLine(0);
+    BOOST_REQUIRE_EQUAL(screen_line.size(), 2);
+    BOOST_CHECK(screen_line[0].is_extended());
+    BOOST_CHECK_EQUAL(screen_line[1].character, U'z');
+    BOOST_CHECK(bool(screen_line[1].rendition & rvt::Rendition::Bold));
+
+    // rows retired by the previous writes are reused once released
+    snapshot = screen.snapshot();
+    screen.resizeImage(2, 2);
+    BOOST_CHECK_EQUAL(snapshot.getLines(), 3);
+    BOOST_CHECK_EQUAL(line_to_string(snapshot.getScreenLine(1)), "");
+    BOOST_CHECK_EQUAL(screen.getLines(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenReduceMemoryUsage)
+{
+    rvt::Screen screen(2, 4);
+    auto const initial_usage = screen.memoryUsage();
+    BOOST_CHECK_EQUAL(initial_usage.extendedChars, 0);
+
+    for (int i = 0; i < 100; ++i) {
+        screen.home();
+        for (rvt::ucs4_char c : {U'a', U'́', U'̂', U'b'}) {
+            screen.displayCharacter(c);
+        }
+    }
+    {
+        // the rows written while a snapshot is alive are copied
+        rvt::ScreenSnapshot snapshot = screen.snapshot();
+        screen.home();
+        screen.displayCharacter(U'c');
+        BOOST_CHECK_GT(screen.memoryUsage().cells, initial_usage.cells);
+    }
+    BOOST_CHECK_GT(screen.memoryUsage().extendedChars, 0);
+
+    screen.reduceMemoryUsage();
+    auto const usage = screen.memoryUsage();
+    BOOST_CHECK_EQUAL(usage.cells, initial_usage.cells);
+    // only the sequence of the 2 displayed combining characters remains
+    BOOST_CHECK_LE(usage.extendedChars, 64);
+
+    auto line = screen.getScreenLines()[0];
+    BOOST_REQUIRE_EQUAL(line.size(), 2);
+    BOOST_CHECK_EQUAL(line[0].character, U'c');
+    BOOST_CHECK_EQUAL(line[1].character, U'b');
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenReflow)
+{
+    auto to_string = [](rvt::Screen const & screen) {
+        std::string s;
+        for (int y = 0; y < screen.getLines(); ++y) {
+            s += '[';
+            for (auto const & ch : screen.getScreenLine(y)) {
+                s += !ch.character ? '_' : ch.character < 128 ? char(ch.character) : '*';
+            }
+            s += bool(screen.getLineProperty(y) & rvt::LineProperty::Wrapped) ? "+" : "]";
+        }
+        return s;
+    };
+    auto display = [](rvt::Screen & screen, std::u32string_view s) {
+        for (char32_t c : s) {
+            screen.displayCharacter(c);
+        }
+    };
+
+    rvt::Screen screen(3, 4);
+    screen.setReflowLines(true);
+
+    display(screen, U"abcdefg");
+    BOOST_CHECK_EQUAL(to_string(screen), "[abcd+[efg][]");
+
+    screen.resizeImage(3, 8);
+    BOOST_CHECK_EQUAL(to_string(screen), "[abcdefg][][]");
+    BOOST_CHECK_EQUAL(screen.getCursorX(), 7);
+    BOOST_CHECK_EQUAL(screen.getCursorY(), 0);
+
+    screen.resizeImage(3, 3);
+    BOOST_CHECK_EQUAL(to_string(screen), "[abc+[def+[g]");
+    BOOST_CHECK_EQUAL(screen.getCursorX(), 1);
+    BOOST_CHECK_EQUAL(screen.getCursorY(), 2);
+
+    screen.resizeImage(3, 4);
+    BOOST_CHECK_EQUAL(to_string(screen), "[abcd+[efg][]");
+    BOOST_CHECK_EQUAL(screen.getCursorX(), 3);
+    BOOST_CHECK_EQUAL(screen.getCursorY(), 1);
+
+    // the top rows are dropped, the cursor stays on the text
+    screen.resizeImage(2, 2);
+    BOOST_CHECK_EQUAL(to_string(screen), "[ef+[g]");
+    BOOST_CHECK_EQUAL(screen.getCursorX(), 1);
+    BOOST_CHECK_EQUAL(screen.getCursorY(), 1);
+
+    // blank lines below the cursor are dropped first
+    rvt::Screen screen2(4, 4);
+    screen2.setReflowLines(true);
+    display(screen2, U"ab");
+    screen2.resizeImage(1, 4);
+    BOOST_CHECK_EQUAL(to_string(screen2), "[ab]");
+    BOOST_CHECK_EQUAL(screen2.getCursorX(), 2);
+
+    // a wide character is not split
+    rvt::Screen screen3(2, 4);
+    screen3.setReflowLines(true);
+    display(screen3, U"ab中c");
+    BOOST_CHECK_EQUAL(to_string(screen3), "[ab*_+[c]");
+    screen3.resizeImage(2, 3);
+    BOOST_CHECK_EQUAL(to_string(screen3), "[ab+[*_c]");
+    BOOST_CHECK_EQUAL(screen3.getCursorX(), 2);
+    BOOST_CHECK_EQUAL(screen3.getCursorY(), 1);
+
+    // the cells erased with a background color are not a wide character
+    rvt::Screen screen5(4, 20);
+    screen5.setReflowLines(true);
+    display(screen5, U"abcdef");
+    screen5.setBackColor(rvt::ColorSpace::System, 4);
+    screen5.clearToEndOfLine();
+    screen5.setDefaultRendition();
+    screen5.resizeImage(4, 8);
+    BOOST_CHECK_EQUAL(to_string(screen5), "[abcdef  +[        +[    ][]");
+    BOOST_CHECK_EQUAL(screen5.getCursorX(), 6);
+    BOOST_CHECK_EQUAL(screen5.getCursorY(), 0);
+
+    // without reflow, the lines are truncated
+    rvt::Screen screen4(2, 4);
+    display(screen4, U"abcdef");
+    screen4.resizeImage(2, 3);
+    BOOST_CHECK_EQUAL(to_string(screen4), "[abc+[ef]");
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenDamage)
+{
+    using rvt::Damage;
+
+    rvt::Screen screen(4, 4);
+    auto dirty_lines = [&screen]() {
+        std::string s;
+        for (int y = 0; y < screen.getLines(); ++y) {
+            s += screen.isLineDirty(y) ? '1' : '0';
+        }
+        return s;
+    };
+
+    // a new screen is entirely damaged
+    BOOST_CHECK(bool(screen.getDamage() & Damage::Size));
+    BOOST_CHECK_EQUAL(dirty_lines(), "1111");
+    screen.resetDamage();
+    BOOST_CHECK(screen.getDamage() == Damage::None);
+    BOOST_CHECK_EQUAL(dirty_lines(), "0000");
+
+    screen.setCursorYX(2, 1);
+    BOOST_CHECK(screen.getDamage() == Damage::Cursor);
+    screen.displayCharacter(U'a');
+    BOOST_CHECK(screen.getDamage() == (Damage::Cursor | Damage::Lines));
+    BOOST_CHECK_EQUAL(dirty_lines(), "0100");
+
+    // back to the previous position
+    screen.resetDamage();
+    screen.setCursorX(3);
+    screen.setCursorX(2);
+    BOOST_CHECK(screen.getDamage() == Damage::None);
+
+    screen.resetMode(rvt::Screen::Mode::Cursor);
+    BOOST_CHECK(screen.getDamage() == Damage::Modes);
+    screen.resetDamage();
+
+    // scrolling damages the region
+    screen.setMargins(2, 3);
+    screen.resetDamage();
+    screen.scrollUp(1);
+    BOOST_CHECK_EQUAL(dirty_lines(), "0110");
+    screen.resetDamage();
+
+    screen.setCursorYX(2, 1);
+    screen.clearToEndOfLine();
+    BOOST_CHECK_EQUAL(dirty_lines(), "0100");
+    screen.resetDamage();
+
+    screen.resizeImage(3, 4);
+    BOOST_CHECK(bool(screen.getDamage() & Damage::Size));
+    BOOST_CHECK_EQUAL(dirty_lines(), "111");
+    screen.resetDamage();
+
+    // compactions do not change what is displayed
+    screen.home();
+    screen.displayCharacter(U'e');
+    screen.displayCharacter(U'́');
+    screen.resetDamage();
+    screen.reduceMemoryUsage();
+    screen.trim();
+    BOOST_CHECK(screen.getDamage() == Damage::None);
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenLineSaver)
+{
+    rvt::Screen screen(4, 4);
+    std::string commits;
+    auto line_saver = [&commits](rvt::Screen const& /*screen*/, size_t y, size_t yend) {
+        commits += std::to_string(y);
+        commits += '-';
+        commits += std::to_string(yend);
+        commits += ' ';
+    };
+    screen.setLineSaver(rvt::Screen::LineSaver::from(line_saver));
+
+    // each line of a new screen is committed once
+    for (int y = 1; y <= 4; ++y) {
+        screen.setCursorYX(y, 1);
+    }
+    screen.home();
+    BOOST_CHECK_EQUAL(commits, "0-1 1-2 2-3 3-4 ");
+
+    // lines which are not modified
+    commits.clear();
+    screen.cursorDown(3);
+    screen.cursorUp(3);
+    screen.setMargins(1, 4);
+    BOOST_CHECK_EQUAL(commits, "");
+
+    screen.displayCharacter(U'a');
+    screen.cursorDown(1);
+    screen.cursorUp(1);
+    screen.cursorDown(1);
+    BOOST_CHECK_EQUAL(commits, "0-1 ");
+
+    // contiguous lines are coalesced
+    commits.clear();
+    screen.clearEntireScreen();
+    screen.scrollDown(3);
+    BOOST_CHECK_EQUAL(commits, "0-3 ");
+
+    // the lines [0, 2] are cleared by the scrolling, the state of
+    // the other lines follows the scrolled lines
+    commits.clear();
+    screen.setCursorYX(4, 1);
+    BOOST_CHECK_EQUAL(commits, "1-2 ");
+    commits.clear();
+    screen.index();
+    screen.index();
+    BOOST_CHECK_EQUAL(commits, "");
+    // the new line of the first index() is deferred, then the line of the cursor
+    screen.home();
+    BOOST_CHECK_EQUAL(commits, "2-3 3-4 ");
+    screen.cursorDown(4);
+    screen.cursorUp(4);
+    BOOST_CHECK_EQUAL(commits, "2-3 3-4 0-1 ");
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenDeferredLineSaver)
+{
+    rvt::Screen screen(4, 4);
+    std::string commits;
+    auto line_saver = [&commits](rvt::Screen const& screen, size_t y, size_t yend) {
+        for (; y < yend; ++y) {
+            for (auto ucs : screen.getScreenLine(int(y)).codePoints()) {
+                commits += char(ucs);
+            }
+            commits += ' ';
+        }
+        commits += "| ";
+    };
+    screen.setLineSaver(rvt::Screen::LineSaver::from(line_saver));
+
+    screen.setCursorYX(4, 1);
+    commits.clear();
+
+    // the scrolled lines are committed together before leaving the screen
+    for (char c : std::string_view("abcdefg")) {
+        screen.displayCharacter(rvt::ucs4_char(c));
+        screen.toStartOfLine();
+        screen.index();
+    }
+    BOOST_CHECK_EQUAL(commits, "a b c | d e f | ");
+    screen.saveDeferredLines();
+    BOOST_CHECK_EQUAL(commits, "a b c | d e f | g | ");
+    screen.saveDeferredLines();
+    BOOST_CHECK_EQUAL(commits, "a b c | d e f | g | ");
+
+    // any other commit first commits the deferred lines
+    commits.clear();
+    for (char c : std::string_view("hi")) {
+        screen.displayCharacter(rvt::ucs4_char(c));
+        screen.toStartOfLine();
+        screen.index();
+    }
+    screen.displayCharacter(U'j');
+    screen.cursorUp(1);
+    BOOST_CHECK_EQUAL(commits, "h i | j | ");
+
+    // the deferred lines do not leave a scrolling region
+    commits.clear();
+    screen.setMargins(2, 3);
+    screen.setCursorYX(3, 1);
+    for (char c : std::string_view("klm")) {
+        screen.displayCharacter(rvt::ucs4_char(c));
+        screen.toStartOfLine();
+        screen.index();
+    }
+    screen.saveDeferredLines();
+    BOOST_CHECK_EQUAL(commits, "k | l | m | ");
 }
@@ -0,0 +1,238 @@
+/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+#define BOOST_TEST_MODULE Scrollback
+#include "system/redemption_unit_tests.hpp"
+
+#include "rvt/scrollback.hpp"
+
+#include <string>
+
+#include <cstdio>
+
+
+namespace
+{
+    std::string to_string(rvt::ScrollbackLines const & lines, std::size_t i)
+    {
+        std::string s;
+        for (auto const & ch : lines[i]) {
+            // erased cells are not real spaces
+            if (!ch.isRealCharacter) {
+                s += ch.character ? "" : "_";
+            }
+            else {
+                s += ch.is_extended() || ch.character >= 128 ? '*' : char(ch.character);
+            }
+        }
+        if (bool(lines.lineProperty(i) & rvt::LineProperty::Wrapped)) {
+            s += '+';
+        }
+        return s;
+    }
+
+    void display(rvt::Screen & screen, std::u32string_view s)
+    {
+        for (char32_t c : s) {
+            screen.displayCharacter(c);
+        }
+    }
+
+    void display_lines(rvt::Screen & screen, int first, int last)
+    {
+        for (int i = first; i < last; ++i) {
+            screen.setForeColor(rvt::ColorSpace::Index256, i % 256);
+            auto const line = std::to_string(i);
+            display(screen, std::u32string(line.begin(), line.end()));
+            screen.nextLine();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestScrollback)
+{
+    rvt::Screen screen(3, 10);
+    BOOST_CHECK(!screen.scrollback());
+    screen.setScrollbackSize(1000);
+    BOOST_REQUIRE(screen.scrollback());
+    BOOST_CHECK_EQUAL(screen.getScrollbackSize(), 1000);
+
+    display_lines(screen, 0, 200);
+
+    auto const & scrollback = *screen.scrollback();
+    BOOST_REQUIRE_EQUAL(scrollback.size(), 198);
+
+    rvt::ScrollbackLines lines;
+    scrollback.readLines(0, scrollback.size(), lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 198);
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        BOOST_CHECK_EQUAL(to_string(lines, i), std::to_string(i));
+        BOOST_CHECK(lines[i][0].foregroundColor == rvt::CharacterColor(rvt::ColorSpace::Index256, int(i)));
+    }
+
+    // across the compressed and the uncompressed lines
+    scrollback.readLines(190, 100, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 8);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "190");
+    BOOST_CHECK_EQUAL(to_string(lines, 7), "197");
+    scrollback.readLines(62, 4, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 4);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "62");
+    BOOST_CHECK_EQUAL(to_string(lines, 3), "65");
+    scrollback.readLines(198, 1, lines);
+    BOOST_CHECK(lines.empty());
+
+    // the oldest lines are dropped
+    screen.setScrollbackSize(100);
+    BOOST_REQUIRE_EQUAL(scrollback.size(), 100);
+    scrollback.readLines(0, 1, lines);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "98");
+
+    display_lines(screen, 200, 250);
+    BOOST_REQUIRE_EQUAL(scrollback.size(), 100);
+    scrollback.readLines(0, 100, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 100);
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        BOOST_CHECK_EQUAL(to_string(lines, i), std::to_string(i + 148));
+    }
+
+    // lines which are not yet in a block are compressed
+    auto const usage = screen.memoryUsage().scrollback;
+    screen.reduceMemoryUsage();
+    BOOST_CHECK_LT(screen.memoryUsage().scrollback, usage);
+    scrollback.readLines(99, 1, lines);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "247");
+
+    screen.setScrollbackSize(0);
+    BOOST_CHECK(!screen.scrollback());
+    BOOST_CHECK_EQUAL(screen.memoryUsage().scrollback, 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestScrollbackSmall)
+{
+    // fewer lines than a block
+    rvt::Screen screen(2, 10);
+    screen.setScrollbackSize(3);
+    display_lines(screen, 0, 10);
+
+    auto const & scrollback = *screen.scrollback();
+    rvt::ScrollbackLines lines;
+    scrollback.readLines(0, 10, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 3);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "6");
+    BOOST_CHECK_EQUAL(to_string(lines, 2), "8");
+
+    // with a top margin, the lines do not leave the screen
+    rvt::Screen screen2(4, 10);
+    screen2.setScrollbackSize(3);
+    screen2.setMargins(2, 4);
+    screen2.scrollUp(2);
+    BOOST_CHECK(screen2.scrollback()->empty());
+    screen2.setDefaultMargins();
+    screen2.scrollUp(2);
+    BOOST_CHECK_EQUAL(screen2.scrollback()->size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(TestScrollbackCells)
+{
+    rvt::Screen screen(2, 4);
+    screen.setScrollbackSize(10);
+
+    // wrapped line, wide and combining characters
+    display(screen, U"ab中c");
+    screen.setRendition(rvt::Rendition::Bold);
+    display(screen, U"éf");
+    screen.nextLine();
+    screen.nextLine();
+
+    auto const & scrollback = *screen.scrollback();
+    rvt::ScrollbackLines lines;
+    scrollback.readLines(0, 10, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 2);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "ab*_+");
+    BOOST_CHECK_EQUAL(to_string(lines, 1), "c*f");
+
+    BOOST_CHECK_EQUAL(int(lines[0][2].character), 0x4E2D);
+    auto const seq = lines.extendedCharTable()[lines[1][1].character];
+    BOOST_CHECK((std::u32string(seq.begin(), seq.end()) == U"é"));
+    BOOST_CHECK(!bool(lines[1][0].rendition & rvt::Rendition::Bold));
+    BOOST_CHECK(bool(lines[1][1].rendition & rvt::Rendition::Bold));
+    BOOST_CHECK(bool(lines[1][2].rendition & rvt::Rendition::Bold));
+}
+
+BOOST_AUTO_TEST_CASE(TestScrollbackReflow)
+{
+    rvt::Screen screen(3, 4);
+    screen.setReflowLines(true);
+    screen.setScrollbackSize(10);
+
+    display(screen, U"abcdefghij");
+    screen.resizeImage(2, 2);
+
+    // the rows dropped at the top go to the history
+    rvt::ScrollbackLines lines;
+    screen.scrollback()->readLines(0, 10, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 3);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "ab+");
+    BOOST_CHECK_EQUAL(to_string(lines, 1), "cd+");
+    BOOST_CHECK_EQUAL(to_string(lines, 2), "ef+");
+}
+
+BOOST_AUTO_TEST_CASE(TestScrollbackFile)
+{
+    char const * filename = "/tmp/rvt-scrollback-test.bin";
+
+    rvt::Screen screen(2, 10);
+    screen.setScrollbackSize(3000);
+    display_lines(screen, 0, 300);
+
+    // the blocks in memory are moved to the file
+    screen.setScrollbackFile(filename, 0600);
+    BOOST_CHECK(screen.scrollback()->hasFile());
+    display_lines(screen, 300, 3000);
+
+    auto const & scrollback = *screen.scrollback();
+    BOOST_REQUIRE_EQUAL(scrollback.size(), 2999);
+
+    // the index and the last block
+    BOOST_CHECK_LT(screen.memoryUsage().scrollback, 16 * 1024);
+
+    rvt::ScrollbackLines lines;
+    scrollback.readLines(0, 3000, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 2999);
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        BOOST_CHECK_EQUAL(to_string(lines, i), std::to_string(i));
+        BOOST_CHECK(lines[i][0].foregroundColor == rvt::CharacterColor(rvt::ColorSpace::Index256, int(i % 256)));
+    }
+
+    // the mapping follows the file
+    display_lines(screen, 3000, 3200);
+    BOOST_REQUIRE_EQUAL(scrollback.size(), 3000);
+    scrollback.readLines(2990, 10, lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 10);
+    BOOST_CHECK_EQUAL(to_string(lines, 0), "3189");
+    BOOST_CHECK_EQUAL(to_string(lines, 9), "3198");
+
+    screen.setScrollbackSize(0);
+    BOOST_CHECK_EQUAL(0, std::remove(filename));
+
+    screen.setScrollbackSize(10);
+    BOOST_CHECK_THROW(screen.setScrollbackFile("/tmp/rvt-scrollback-no-dir/file", 0600), std::system_error);
+}
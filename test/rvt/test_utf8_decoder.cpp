@@ -146,3 +146,44 @@ BOOST_AUTO_TEST_CASE(TestUtf8Decoder)
         utils::make_array<rvt::ucs4_char>()
     );
 }
+
+BOOST_AUTO_TEST_CASE(TestUtf8DecoderBlock)
+{
+    struct Accu {
+        std::vector<rvt::ucs4_char> v;
+        void operator()(rvt::ucs4_char ucs) { v.push_back(ucs); }
+    };
+    struct BlockAccu {
+        std::vector<rvt::ucs4_char> v;
+        void operator()(rvt::ucs4_carray_view ucs) { v.insert(v.end(), ucs.begin(), ucs.end()); }
+    };
+
+    std::string long_str(1500, 'x');
+    long_str += "\xea\xb0\x80";
+    long_str += std::string(600, '\x1b');
+
+    for (chars_view s : {
+        cstr_array_view("abcd"),
+        cstr_array_view("\xb7p\xc3\xc7"),
+        cstr_array_view("abc\xea\xb0\x80" "defghijklmnopqrstuvwxyz0123456789\033[0m\xf0\x90\x8d\x88"),
+        cstr_array_view("\xea\xb0""a\xea""a\x80"),
+        cstr_array_view("\xfa\xb0\x80""ab\x7f\x01"),
+        chars_view{long_str.data(), long_str.size()},
+    }) {
+        for (std::size_t i = 0; i <= s.size(); ++i) {
+            rvt::Utf8Decoder decoder;
+            Accu accu;
+            accu = decoder.decode(s.first(i), std::move(accu));
+            accu = decoder.decode(chars_view{s.begin() + i, s.end()}, std::move(accu));
+            accu = decoder.end_decode(std::move(accu));
+
+            BlockAccu block_accu;
+            block_accu = decoder.decode_block(s.first(i), std::move(block_accu));
+            block_accu = decoder.decode_block(chars_view{s.begin() + i, s.end()}, std::move(block_accu));
+            auto end_accu = decoder.end_decode(Accu());
+            block_accu.v.insert(block_accu.v.end(), end_accu.v.begin(), end_accu.v.end());
+
+            BOOST_CHECK_EQUAL_RANGES(accu.v, block_accu.v);
+        }
+    }
+}
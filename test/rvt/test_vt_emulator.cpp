@@ -140,6 +140,147 @@ BOOST_AUTO_TEST_CASE(TestEmulator)
     BOOST_CHECK_EQUAL(lines[5].size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(TestEmulatorParser)
+{
+    rvt::VtEmulator emulator(3, 10);
+    std::string log;
+    emulator.setLogFunction([&log](char const * s, std::size_t n) { log.assign(s, n); });
+
+    auto send_zstring = [&emulator](chars_view av) {
+        for (char c : av.first(av.size()-1)) {
+            emulator.receiveChar(static_cast<unsigned char>(c));
+        }
+    };
+
+    auto const & lines = emulator.getCurrentScreen().getScreenLines();
+    auto line_to_string = [&lines](int y) {
+        std::string s;
+        for (auto const & ch : lines[y]) {
+            s += char(ch.character);
+        }
+        return s;
+    };
+
+    // OSC terminated by ST
+    send_zstring("\033]2;title\033\\a");
+    BOOST_CHECK_EQUAL_RANGES(emulator.getWindowTitle(), cstr_array_view("title"));
+    // DCS, PM and APC are ignored
+    send_zstring("\033Pq#0;2\033\\b\033^x\\x\a\033\\c\033_yy\033\\d");
+    // control characters within a sequence
+    send_zstring("\033[\b2C");
+    // intermediate characters
+    send_zstring("\033[2 qe");
+    BOOST_CHECK_EQUAL(log, "Undecodable sequence: \\x1b[2\\x20q");
+    // 8-bit CSI
+    send_zstring("\x9b" "2;2Hf");
+    BOOST_CHECK_EQUAL(line_to_string(0), "abcd e");
+    BOOST_CHECK_EQUAL(line_to_string(1), " f");
+
+    send_zstring("\033[?2l\033Y#&g\033<h");
+    BOOST_CHECK_EQUAL(line_to_string(2), "      gh");
+
+    send_zstring("\033[H\033[1;38;5;100;48;2;1;2;3;7;4;24;38mi\033[0;94;22mj\033[m");
+    {
+        // reversed colors, a lone 38 resets the foreground color
+        rvt::CharacterColor fg(rvt::ColorSpace::Default, 0);
+        rvt::CharacterColor bg(rvt::ColorSpace::RGB, 0x010203);
+        BOOST_CHECK_EQUAL(lines[0][0], rvt::Character('i', bg, fg, rvt::Rendition::Bold | rvt::Rendition::Reverse));
+        BOOST_CHECK_EQUAL(lines[0][1], rvt::Character('j', rvt::CharacterColor(rvt::ColorSpace::System, 12)));
+    }
+
+    send_zstring("\033[324a");
+    BOOST_CHECK_EQUAL(log, "Undecodable sequence: \\x1b[324a");
+    send_zstring("\033[?1;3000h");
+    BOOST_CHECK_EQUAL(log, "Undecodable sequence: \\x1b[?1;3000h");
+    send_zstring("\033]x\a");
+    BOOST_CHECK_EQUAL(log, "Undecodable sequence: \\x1b]x");
+
+    std::string osc;
+    emulator.setOscFunction([&osc](int command, rvt::ucs4_carray_view data, bool is_end) {
+        osc += std::to_string(command);
+        osc += '[';
+        for (auto c : data) {
+            osc += char(c);
+        }
+        osc += is_end ? "]$" : "]";
+    });
+    send_zstring("\033]52;c;YWJj\nZGVm\033\\");
+    BOOST_CHECK_EQUAL(osc, "52[c]52[;]52[Y]52[W]52[J]52[j]52[Z]52[G]52[V]52[m]52[]$");
+    osc.clear();
+    std::vector<rvt::ucs4_char> ucs{'\033', ']', '2', ';', 'a', 'b', 0x7f, 'c', '\a'};
+    emulator.receiveChars({ucs.data(), ucs.size()});
+    BOOST_CHECK_EQUAL(osc, "2[ab]2[c]2[]$");
+    BOOST_CHECK_EQUAL_RANGES(emulator.getWindowTitle(), cstr_array_view("abc"));
+
+    // CAN and SUB abort a string and display a checker board (truncated to 0x92)
+    ucs.assign({'\033', 'P', 'q', '#', 0x18, 't', 'x', '\033', '_', 'y', 0x1a, 'z'});
+    send_zstring("\033[2J\033[H");
+    emulator.receiveChars({ucs.data(), ucs.size()});
+    BOOST_CHECK_EQUAL(line_to_string(0), "\x92tx\x92z");
+    send_zstring("\033]2;abort\x18" "e\033^x\x1a" "f");
+    BOOST_CHECK_EQUAL(line_to_string(0), "\x92tx\x92z\x92" "e\x92" "f");
+    BOOST_CHECK_EQUAL_RANGES(emulator.getWindowTitle(), cstr_array_view("abc"));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorAlternateScreen)
+{
+    rvt::VtEmulator emulator(3, 10);
+
+    auto send_zstring = [&emulator](chars_view av) {
+        std::vector<rvt::ucs4_char> ucs(av.begin(), av.end() - 1);
+        emulator.receiveChars({ucs.data(), ucs.size()});
+    };
+
+    auto screen = [&emulator]() -> rvt::Screen const & { return emulator.getCurrentScreen(); };
+    auto line_to_string = [&screen](int y) {
+        std::string s;
+        for (auto const & ch : screen().getScreenLine(y)) {
+            s += char(ch.character);
+        }
+        return s;
+    };
+
+    BOOST_CHECK_LE(sizeof(rvt::VtEmulator), 1024u);
+
+    // only allocated on first use
+    send_zstring("abc\033[?25l");
+    BOOST_CHECK(!emulator.hasAlternateScreen());
+    send_zstring("\033[?1049hdef");
+    BOOST_CHECK(emulator.hasAlternateScreen());
+    BOOST_CHECK_EQUAL(line_to_string(0), "def");
+    // modes set before the allocation are kept
+    BOOST_CHECK(!screen().getMode(rvt::Screen::Mode::Cursor));
+    send_zstring("\033[?1049l");
+    BOOST_CHECK_EQUAL(line_to_string(0), "abc");
+
+    // kept for the release delay
+    send_zstring("g");
+    BOOST_CHECK(emulator.hasAlternateScreen());
+    send_zstring("\033[?47h");
+    BOOST_CHECK_EQUAL(line_to_string(0), "def");
+    send_zstring("\033[?47l\033[?25h");
+
+    emulator.setAlternateScreenReleaseDelay(std::chrono::milliseconds(0));
+    send_zstring("h");
+    BOOST_CHECK(!emulator.hasAlternateScreen());
+    send_zstring("\033[?47h");
+    BOOST_CHECK(emulator.hasAlternateScreen());
+    BOOST_CHECK_EQUAL(line_to_string(0), "");
+    BOOST_CHECK(screen().getMode(rvt::Screen::Mode::Cursor));
+    send_zstring("\033[?47l");
+
+    emulator.setAlternateScreenReleaseDelay(std::chrono::milliseconds(-1));
+    send_zstring("i");
+    BOOST_CHECK(emulator.hasAlternateScreen());
+
+    // the title is truncated
+    std::string title = "\033]2;";
+    title.append(300, 'x');
+    title += "\a";
+    send_zstring({title.c_str(), title.size() + 1});
+    BOOST_CHECK_EQUAL(emulator.getWindowTitle().size(), rvt::VtEmulator::MAX_TITLE_LENGTH);
+}
+
 BOOST_AUTO_TEST_CASE(TestEmulatorReplay1)
 {
     std::string out;
@@ -160,7 +301,7 @@ BOOST_AUTO_TEST_CASE(TestEmulatorReplay1)
             out += '\n';
         }
     };
-    rvt::VtEmulator emulator(57, 104, line_saver);
+    rvt::VtEmulator emulator(57, 104, rvt::Screen::LineSaver::from(line_saver));
     rvt::Utf8Decoder text_decoder;
     std::filebuf in;
     in.open("test/data/typescript1", std::ios::in);
@@ -182,6 +323,32 @@ BOOST_AUTO_TEST_CASE(TestEmulatorReplay1)
         std::string_view()
     );
 
+    {
+        std::string out1;
+        out1.swap(out);
+        rvt::VtEmulator emulator2(57, 104, rvt::Screen::LineSaver::from(line_saver));
+        in.pubseekpos(0);
+        while ((len = in.sgetn(buf, sizeof(buf)))) {
+            text_decoder.decode_block({buf, buf+len}, [&emulator2](rvt::ucs4_carray_view ucs) {
+                emulator2.receiveChars(ucs);
+            });
+        }
+
+        std::vector<char> s2;
+        ansi_rendering(
+            {},
+            emulator2.getCurrentScreen(),
+            rvt::color_table,
+            rvt::RenderingBuffer::from_vector(s2),
+            std::string_view()
+        );
+        BOOST_CHECK_EQUAL(std::string_view(s.data(), s.size()), std::string_view(s2.data(), s2.size()));
+
+        // same lines with the scrolls of a block committed in batches
+        BOOST_CHECK_EQUAL(out, out1);
+        out.swap(out1);
+    }
+
     BOOST_CHECK_EQUAL(s.size(), 4327u);
     BOOST_CHECK_EQUAL(std::string_view(s.data(), s.size()), ""
         "\033]\a│       ├── \033[0;4;38;2;95;135;215mcxx\n"
@@ -28,11 +28,45 @@
 #include <iostream>
 #include <fstream>
 
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
+#include <new>
+#include <thread>
 
 #include <unistd.h>
 
+namespace
+{
+    // replaced global operator new counts the allocations (and their size)
+    // done while count_allocations is true
+    bool count_allocations = false;
+    std::size_t allocation_count = 0;
+    std::size_t allocated_bytes = 0;
+}
+
+void * operator new(std::size_t size)
+{
+    if (count_allocations) {
+        ++allocation_count;
+        allocated_bytes += size;
+    }
+    if (void * p = std::malloc(size ? size : 1u)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t /*size*/) noexcept
+{
+    std::free(p);
+}
+
 inline std::string get_file_contents(const char * name)
 {
     std::string s;
@@ -77,6 +111,13 @@ struct std::default_delete<TerminalEmulatorBuffer>
     { BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_delete(p)); }
 };
 
+template<>
+struct std::default_delete<TerminalEmulatorSnapshot>
+{
+    void operator()(TerminalEmulatorSnapshot * p) noexcept
+    { BOOST_CHECK_EQUAL(0, terminal_emulator_snapshot_delete(p)); }
+};
+
 static uint8_t const* to_u8p(char const* p) noexcept
 {
     return const_bytes_t(p).to_u8p();
@@ -172,6 +213,7 @@ BOOST_AUTO_TEST_CASE(TestTermEmu)
     BOOST_CHECK_EQUAL(nullptr, terminal_emulator_buffer_get_data(nullptr, &len));
     BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_clear_data(nullptr));
     BOOST_CHECK_EQUAL(-2, terminal_emulator_resize(emu, -3, 3));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_set_resize_reflow(nullptr, true));
     const unsigned very_big_size = (~0u>>1) - 1u; // -1u for inhibit integer overflow (uint -> int)
     BOOST_CHECK_EQUAL(ENOMEM, terminal_emulator_resize(emu, very_big_size, very_big_size)); // bad alloc
 
@@ -180,6 +222,507 @@ BOOST_AUTO_TEST_CASE(TestTermEmu)
     BOOST_CHECK_LT(0, terminal_emulator_buffer_write(emubuf, "/a/a", 0664, force_create));
 }
 
+BOOST_AUTO_TEST_CASE(TestEmulatorSnapshot)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(3, 10)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_title(emu, "Lib test"));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("ABC\r\n\033[1mx"), 11));
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::json));
+    std::string const contents{get_data(emubuf)};
+
+    std::unique_ptr<TerminalEmulatorSnapshot> usnapshot{terminal_emulator_snapshot_new(emu)};
+    auto snapshot = usnapshot.get();
+    BOOST_REQUIRE(snapshot);
+
+    // the snapshot is rendered while the emulator keeps changing
+    std::string rendered;
+    std::thread renderer([&]{
+        std::unique_ptr<TerminalEmulatorBuffer> buf{terminal_emulator_buffer_new()};
+        for (int i = 0; i < 100; ++i) {
+            terminal_emulator_buffer_prepare_snapshot(buf.get(), snapshot, OutputFormat::json, nullptr, 0);
+        }
+        rendered = get_data(buf.get());
+    });
+    for (int i = 0; i < 100; ++i) {
+        terminal_emulator_feed(emu, to_u8p("\033[Hdef\033[31mghi\r\n\xc3\xa9\xcc\x81"), 25);
+    }
+    terminal_emulator_set_title(emu, "Other");
+    renderer.join();
+
+    BOOST_CHECK_EQUAL(contents, rendered);
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::json));
+    BOOST_CHECK_NE(contents, get_data(emubuf));
+
+    // outlives the emulator
+    uemu.reset();
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare_snapshot(emubuf, snapshot, OutputFormat::json, nullptr, 0));
+    BOOST_CHECK_EQUAL(contents, get_data(emubuf));
+
+    BOOST_CHECK_EQUAL(nullptr, terminal_emulator_snapshot_new(nullptr));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_snapshot_delete(nullptr));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_prepare_snapshot(nullptr, snapshot, OutputFormat::json, nullptr, 0));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_prepare_snapshot(emubuf, nullptr, OutputFormat::json, nullptr, 0));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorJsonEscape)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(1, 40)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+
+    // ASCII runs around escaped, non-ASCII, extended and wide characters
+    std::string_view text = "a \"quoted\" C:\\dir\\ \xc3\xa9t\xc3\xa9 e\xcc\x81 \xe4\xb8\xad!\033[1mbold\\\"";
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p(text.data()), int(text.size())));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::json));
+    BOOST_CHECK_EQUAL(get_data(emubuf), R"xxx({"x":34,"y":0,"lines":1,"columns":40,"title":"","style":{"r":0,"f":16777215,"b":0},"data":[[[{"s":"a \"quoted\" C:\\dir\\ été )xxx" "e\xcc\x81" R"xxx( 中 !"},{"r":1,"f":16777215,"s":"bold\\\""}]]]})xxx");
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorJsonStyleChanges)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(1, 400)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+
+    // more style changes than the rendering keeps, each one comes back
+    std::string text;
+    std::string expected = R"({"x":400,"y":0,"lines":1,"columns":400,"title":"","style":{"r":0,"f":16777215,"b":0},"data":[[[)";
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < 100; ++i) {
+            text += "\033[38;2;0;0;" + std::to_string(i) + "mx\033[my";
+            expected += R"({"f":)" + std::to_string(i) + R"(,"s":"x"},{"f":16777215,"s":"y"},)";
+        }
+    }
+    expected.pop_back();
+    expected += "]]]}";
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p(text.data()), int(text.size())));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::json));
+    BOOST_CHECK_EQUAL(get_data(emubuf), expected);
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorJsonPatch)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(3, 10)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    std::unique_ptr<TerminalEmulatorBuffer> ujsonbuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+    auto jsonbuf = ujsonbuf.get();
+
+    auto prepare = [&]{
+        BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::json_patch));
+        return std::string(get_data(emubuf));
+    };
+    auto keyframe = [&]{
+        BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(jsonbuf, emu, OutputFormat::json));
+        return std::string(get_data(jsonbuf));
+    };
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("ABC\r\nDEF\r\nGHI"), 13));
+
+    // first prepare is a keyframe
+    BOOST_CHECK_EQUAL(keyframe(), prepare());
+    BOOST_CHECK_EQUAL(R"({"patch":[]})", prepare());
+
+    // scrolling
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\r\nJKL"), 5));
+    BOOST_CHECK_EQUAL(R"({"patch":[[2,[[{"s":"JKL"}]]]],"scroll":1})", prepare());
+
+    // cursor and styles of the line
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[H\033[31mx"), 9));
+    BOOST_CHECK_EQUAL(
+        R"({"patch":[[0,[[{"f":13434880,"s":"x"},{"f":16777215,"s":"EF"}]]]],"x":1,"y":0})",
+        prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[2;1H\033[L"), 10));
+    BOOST_CHECK_EQUAL(
+        R"({"patch":[[1,[[{"f":13434880,"s":"          "}]]],[2,[[{"s":"GHI"}]]]],"x":0,"y":1})",
+        prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_title(emu, "Lib test"));
+    BOOST_CHECK_EQUAL(R"({"patch":[],"title":"Lib test"})", prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare2(emubuf, emu, OutputFormat::json_patch, to_u8p("\"plop\""), 6));
+    BOOST_CHECK_EQUAL(R"({"patch":[],"extra":"plop"})", get_data(emubuf));
+
+    // keyframes
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_request_keyframe(emubuf));
+    BOOST_CHECK_EQUAL(keyframe(), prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_resize(emu, 4, 10));
+    BOOST_CHECK_EQUAL(keyframe(), prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_set_keyframe_interval(emubuf, 2));
+    BOOST_CHECK_EQUAL(R"({"patch":[]})", prepare());
+    BOOST_CHECK_EQUAL(keyframe(), prepare());
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_set_keyframe_interval(nullptr, 2));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_request_keyframe(nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorAnsiDiff)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(4, 10)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+
+    auto prepare = [&]{
+        BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(emubuf, emu, OutputFormat::ansi_diff));
+        return std::string(get_data(emubuf));
+    };
+
+    // the first prepare redraws the screen
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("ABC\r\nDEF"), 8));
+    BOOST_CHECK_EQUAL("\033[0m\033[H\033[2J\033]2;\aABC\r\nDEF\033[?25h", prepare());
+    BOOST_CHECK_EQUAL("", prepare());
+
+    // only the changed attributes
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[1;31mG\033[0mH\033[7m\033[38;5;200mI"), 31));
+    BOOST_CHECK_EQUAL("\033[1;91mG\033[0mH\033[7;38;5;200mI", prepare());
+
+    // scrolling
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[0m\r\nJ\r\nK\r\nL"), 14));
+    BOOST_CHECK_EQUAL("\033[0m\033[1S\rJ\r\nK\r\nL", prepare());
+
+    // erase line
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[H\033[K"), 6));
+    BOOST_CHECK_EQUAL("\033[H\033[K", prepare());
+
+    // scrolling region with a line kept above
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[1mstatus\033[0m"), 14));
+    BOOST_CHECK_EQUAL("\033[1mstatus", prepare());
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[2;4r\033[4H\nM"), 13));
+    BOOST_CHECK_EQUAL("\033[0m\033[2;4r\033[1S\033[r\033[4HM", prepare());
+
+    // wide character, title and cursor
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("\033[r\033[H\xe4\xb8\xad\033]2;T\a\033[?25l"), 21));
+    BOOST_CHECK_EQUAL("\033]2;T\a\033[H\xe4\xb8\xad\033[?25l", prepare());
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_request_keyframe(emubuf));
+    BOOST_CHECK_EQUAL(
+        "\033[0m\033[H\033[2J\033]2;T\a\xe4\xb8\xad\033[1matus\r\n\033[0mK\r\nL\r\nM\033[?25l",
+        prepare());
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorAnsiDiffMirror)
+{
+    std::string corpus = get_file_contents("test/data/typescript1");
+    BOOST_REQUIRE(!corpus.empty());
+    for (int i = 0; i < 60; ++i) {
+        corpus += "\033[" + std::to_string(i % 8) + ";3" + std::to_string(i % 8)
+                + ";48;2;" + std::to_string(i) + ";1;2me\xcc\x81\xe4\xb8\xad\xe2\x82\xac\n";
+        if (i % 7 == 0) {
+            corpus += "\033[0;7;1;38;5;" + std::to_string(i + 16) + "mrev\033[0m\033[K";
+        }
+    }
+    corpus += "\033[5;20r\033[10H\033[3L\033[2M\033[4S\033[2T\033[r";
+    corpus += "\033[?1049h\033[2Jalt screen\xcc\x81\033[?1049l";
+    corpus += "\033]0;title\a\033[?25l\033[0m";
+
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(24, 80)};
+    std::unique_ptr<TerminalEmulator> umirror{terminal_emulator_new(24, 80)};
+    std::unique_ptr<TerminalEmulatorBuffer> udiffbuf{terminal_emulator_buffer_new()};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    std::unique_ptr<TerminalEmulatorBuffer> umirrorbuf{terminal_emulator_buffer_new()};
+
+    // a full redraw of the screen
+    auto redraw = [](TerminalEmulatorBuffer* buf, TerminalEmulator* emu){
+        terminal_emulator_buffer_request_keyframe(buf);
+        terminal_emulator_buffer_prepare(buf, emu, OutputFormat::ansi_diff);
+        return std::string(get_data(buf));
+    };
+
+    std::size_t diff_len = 0;
+    std::size_t redraw_len = 0;
+    std::size_t const chunk_size = 97;
+    for (std::size_t i = 0; i < corpus.size(); i += chunk_size) {
+        std::size_t const n = std::min(chunk_size, corpus.size() - i);
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_feed(uemu.get(), to_u8p(corpus.data() + i), n));
+
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_buffer_prepare(udiffbuf.get(), uemu.get(), OutputFormat::ansi_diff));
+        std::string const diff{get_data(udiffbuf.get())};
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_feed(umirror.get(), to_u8p(diff.data()), diff.size()));
+
+        std::string const expected = redraw(uemubuf.get(), uemu.get());
+        BOOST_REQUIRE_EQUAL(expected, redraw(umirrorbuf.get(), umirror.get()));
+
+        diff_len += diff.size();
+        redraw_len += expected.size();
+    }
+
+    BOOST_CHECK_LT(diff_len * 2, redraw_len);
+
+    auto mirror = [&](char const * s, std::size_t n){
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_feed(uemu.get(), to_u8p(s), n));
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_buffer_prepare(udiffbuf.get(), uemu.get(), OutputFormat::ansi_diff));
+        std::string const diff{get_data(udiffbuf.get())};
+        BOOST_REQUIRE_EQUAL(0, terminal_emulator_feed(umirror.get(), to_u8p(diff.data()), diff.size()));
+        BOOST_CHECK_EQUAL(redraw(uemubuf.get(), uemu.get()), redraw(umirrorbuf.get(), umirror.get()));
+        return diff;
+    };
+
+    // a wide character with its right half overwritten
+    mirror("\033[H\xe4\xb8\xadxyz\033[2Ga", 14);
+
+    // the wide character is blanked, the unchanged right cell is not overwritten
+    uemu.reset(terminal_emulator_new(3, 6));
+    umirror.reset(terminal_emulator_new(3, 6));
+    mirror("ao", 2);
+    BOOST_CHECK_EQUAL("\r \033[1C", mirror("\033[1;1H\xe4\xb8\xad\033[1;2Ho", 16));
+
+    // a wide character cut by a resize does not wrap in the last column
+    mirror("\033[2;1Habcd\xe4\xb8\xad", 13);
+    BOOST_REQUIRE_EQUAL(0, terminal_emulator_resize(uemu.get(), 3, 5));
+    BOOST_REQUIRE_EQUAL(0, terminal_emulator_resize(umirror.get(), 3, 5));
+    mirror("", 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorScrollback)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(2, 10)};
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    auto emu = uemu.get();
+    auto emubuf = uemubuf.get();
+
+    std::size_t lines = 1;
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_scrollback_lines(emu, &lines));
+    BOOST_CHECK_EQUAL(0, lines);
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_set_scrollback_file(emu, "/tmp/termemu-scrollback.bin", 0600));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_scrollback_size(emu, 2));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_scrollback_file(emu, "/tmp/termemu-scrollback.bin", 0600));
+    BOOST_CHECK_EQUAL(ENOENT, terminal_emulator_set_scrollback_file(emu, "/tmp/termemu-no-dir/file", 0600));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p("L1\r\n\033[31mL2\033[m\r\nL3\r\nL4\r\nL5"), 26));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_scrollback_lines(emu, &lines));
+    BOOST_CHECK_EQUAL(2, lines);
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare_history(emubuf, emu, 0, 10, nullptr, 0));
+    BOOST_CHECK_EQUAL(get_data(emubuf),
+        R"({"x":2,"y":1,"lines":2,"columns":10,"title":"","style":{"r":0,"f":16777215,"b":0},"history":[[[{"f":13434880,"s":"L2"}]],[[{"f":16777215,"s":"L3"}]]],"data":[[[{"s":"L4"}]],[[{"s":"L5"}]]]})");
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare_history(emubuf, emu, 1, 1, to_u8p("{}"), 2));
+    BOOST_CHECK_EQUAL(get_data(emubuf),
+        R"({"x":2,"y":1,"lines":2,"columns":10,"title":"","style":{"r":0,"f":16777215,"b":0},"history":[[[{"s":"L3"}]]],"data":[[[{"s":"L4"}]],[[{"s":"L5"}]]],"extra":{}})");
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_scrollback_size(emu, 0));
+    BOOST_CHECK_EQUAL(0, unlink("/tmp/termemu-scrollback.bin"));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_scrollback_lines(emu, &lines));
+    BOOST_CHECK_EQUAL(0, lines);
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare_history(emubuf, emu, 0, 10, nullptr, 0));
+    BOOST_CHECK_EQUAL(get_data(emubuf),
+        R"({"x":2,"y":1,"lines":2,"columns":10,"title":"","style":{"r":0,"f":16777215,"b":0},"history":[],"data":[[[{"s":"L4"}]],[[{"s":"L5"}]]]})");
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_set_scrollback_size(nullptr, 0));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_get_scrollback_lines(emu, nullptr));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_buffer_prepare_history(nullptr, emu, 0, 0, nullptr, 0));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorFeedWithoutAllocation)
+{
+    std::string corpus = get_file_contents("test/data/typescript1");
+    BOOST_REQUIRE(!corpus.empty());
+    // styles, combining characters, scroll regions, insert/delete lines
+    // and alternate screen
+    for (int i = 0; i < 300; ++i) {
+        corpus += "\033[" + std::to_string(i % 8) + ";3" + std::to_string(i % 8)
+                + ";48;2;" + std::to_string(i) + ";1;2me\xcc\x81\xcc\x82\xcc\x83\xcc\x84\xe2\x82\xac\n";
+    }
+    corpus += "\033[5;20r\033[10H\033[3L\033[2M\033[4S\033[2T\033[r";
+    corpus += "\033[?1049h\033[2Jalt screen\xcc\x81\033[?1049l";
+    corpus += "\033]0;title\a\033[0m";
+
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(24, 80)};
+    auto emu = uemu.get();
+    auto feed = [&]{
+        return terminal_emulator_feed(emu, to_u8p(corpus.data()), corpus.size());
+    };
+
+    // warm-up: the tables reach their working size
+    // (each feed compacts the extended characters at least once)
+    for (int i = 0; i < 3; ++i) {
+        BOOST_REQUIRE_EQUAL(0, feed());
+    }
+
+    allocation_count = 0;
+    count_allocations = true;
+    int const r1 = feed();
+    int const r2 = feed();
+    count_allocations = false;
+
+    BOOST_CHECK_EQUAL(0, r1);
+    BOOST_CHECK_EQUAL(0, r2);
+    BOOST_CHECK_EQUAL(0u, allocation_count);
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorIdleFootprint)
+{
+    allocated_bytes = 0;
+    count_allocations = true;
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(24, 80)};
+    count_allocations = false;
+
+    // cells of the primary screen (code point, style and flags)
+    // and a few bookkeeping vectors, the alternate screen is not allocated
+    std::size_t const cells_bytes = 24 * 80 * (4 + 2 + 1);
+    BOOST_CHECK_LE(allocated_bytes, cells_bytes + 2048);
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorMemoryUsage)
+{
+    allocated_bytes = 0;
+    count_allocations = true;
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(24, 80)};
+    count_allocations = false;
+    auto emu = uemu.get();
+
+    TerminalEmulatorMemoryUsage usage {};
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &usage));
+    BOOST_CHECK_GE(usage.cells, 24 * 80 * (4 + 2 + 1));
+    BOOST_CHECK_EQUAL(usage.alternate_screen, 0);
+    BOOST_CHECK_EQUAL(usage.extended_chars, 0);
+    BOOST_CHECK_EQUAL(usage.total, usage.emulator + usage.cells + usage.line_properties
+                                 + usage.tab_stops + usage.styles + usage.extended_chars
+                                 + usage.scrollback);
+    // the heap (control blocks of shared_ptr excepted) and the emulator itself
+    BOOST_CHECK_LE(usage.total, allocated_bytes + sizeof(void*) * 8 + 1024);
+    BOOST_CHECK_GE(usage.total + 256, allocated_bytes);
+    auto const initial_usage = usage;
+
+    auto feed = [emu](std::string_view s) {
+        BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p(s.data()), s.size()));
+    };
+
+    std::string combining;
+    for (int i = 0; i < 1000; ++i) {
+        combining += "e\xcc\x81\xcc\x82";
+    }
+    feed(combining);
+    feed("\033[?1049h");
+    feed(combining);
+    feed("\033[?1049l\033[2J");
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &usage));
+    BOOST_CHECK_GT(usage.alternate_screen, 0);
+    BOOST_CHECK_GT(usage.extended_chars, 0);
+    BOOST_CHECK_GT(usage.total, initial_usage.total + usage.alternate_screen / 2);
+
+    // the alternate screen and the combining sequences which are no longer displayed
+    // are released by the next feed
+    BOOST_CHECK_EQUAL(0, terminal_emulator_set_memory_budget(emu, initial_usage.total));
+    feed("a");
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &usage));
+    BOOST_CHECK_EQUAL(usage.alternate_screen, 0);
+    BOOST_CHECK_EQUAL(usage.extended_chars, 0);
+    BOOST_CHECK_LE(usage.total, initial_usage.total + 256);
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_memory_usage(nullptr, &usage));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_memory_usage(emu, nullptr));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_set_memory_budget(nullptr, 0));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorTrim)
+{
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(24, 80)};
+    auto emu = uemu.get();
+
+    TerminalEmulatorMemoryUsage initial_usage {};
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &initial_usage));
+
+    auto feed = [emu](std::string_view s) {
+        BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p(s.data()), s.size()));
+    };
+
+    // a burst of colors and combining characters on both screens
+    std::string burst;
+    for (int i = 0; i < 256; ++i) {
+        burst += "\033[38;5;" + std::to_string(i) + "me\xcc\x81\xcc\x82";
+    }
+    feed("\033[?1049h");
+    feed(burst);
+    feed("\033[?1049l");
+    feed(burst);
+    feed("\033[m\033[2Jabc");
+
+    TerminalEmulatorMemoryUsage usage {};
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &usage));
+    BOOST_CHECK_GT(usage.styles, initial_usage.styles);
+    BOOST_CHECK_GT(usage.alternate_screen, 0);
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_trim(emu));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_memory_usage(emu, &usage));
+    BOOST_CHECK_EQUAL(usage.alternate_screen, 0);
+    BOOST_CHECK_EQUAL(usage.extended_chars, 0);
+    BOOST_CHECK_LE(usage.styles, initial_usage.styles);
+    BOOST_CHECK_LE(usage.total, initial_usage.total);
+
+    // the displayed content is kept
+    std::unique_ptr<TerminalEmulatorBuffer> uemubuf{terminal_emulator_buffer_new()};
+    BOOST_CHECK_EQUAL(0, terminal_emulator_buffer_prepare(uemubuf.get(), emu, OutputFormat::ansi));
+    BOOST_CHECK_NE(get_data(uemubuf.get()).find("abc"), std::string_view::npos);
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_trim(nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(TestEmulatorDamage)
+{
+    using Damage = TerminalEmulatorDamage;
+
+    std::unique_ptr<TerminalEmulator> uemu{terminal_emulator_new(3, 10)};
+    auto emu = uemu.get();
+
+    auto feed = [emu](std::string_view s) {
+        BOOST_CHECK_EQUAL(0, terminal_emulator_feed(emu, to_u8p(s.data()), s.size()));
+    };
+
+    int damage = 0;
+    uint8_t lines[4] {9, 9, 9, 9};
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_reset_damage(emu));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_damage(emu, &damage, lines, 4));
+    BOOST_CHECK_EQUAL(damage, int(Damage::none));
+    BOOST_CHECK_EQUAL(lines[0] + lines[1] + lines[2], 0);
+    BOOST_CHECK_EQUAL(lines[3], 9);
+
+    feed("\r\nab\033]0;title\a");
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_damage(emu, &damage, lines, 4));
+    BOOST_CHECK_EQUAL(damage, int(Damage::lines) | int(Damage::cursor) | int(Damage::title));
+    BOOST_CHECK_EQUAL(lines[0], 0);
+    BOOST_CHECK_EQUAL(lines[1], 1);
+    BOOST_CHECK_EQUAL(lines[2], 0);
+
+    // same title
+    BOOST_CHECK_EQUAL(0, terminal_emulator_reset_damage(emu));
+    feed("\033]0;title\a");
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_damage(emu, &damage, nullptr, 0));
+    BOOST_CHECK_EQUAL(damage, int(Damage::none));
+
+    // the alternate screen is entirely damaged
+    feed("\033[?1049h");
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_damage(emu, &damage, lines, 3));
+    BOOST_CHECK(damage & int(Damage::current_screen));
+    BOOST_CHECK(damage & int(Damage::lines));
+    BOOST_CHECK_EQUAL(lines[0] + lines[1] + lines[2], 3);
+
+    BOOST_CHECK_EQUAL(0, terminal_emulator_reset_damage(emu));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_resize(emu, 4, 10));
+    BOOST_CHECK_EQUAL(0, terminal_emulator_get_damage(emu, &damage, lines, 4));
+    BOOST_CHECK(damage & int(Damage::size));
+    BOOST_CHECK_EQUAL(lines[0] + lines[1] + lines[2] + lines[3], 4);
+
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_get_damage(nullptr, &damage, nullptr, 0));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_get_damage(emu, nullptr, nullptr, 0));
+    BOOST_CHECK_EQUAL(-2, terminal_emulator_reset_damage(nullptr));
+}
+
 BOOST_AUTO_TEST_CASE(TestEmulatorBufferTranscript)
 {
     setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);          // for localtime_r
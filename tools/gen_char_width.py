@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+# Generates src/rvt/char_width.hpp: column width of each code point
+# as a two-level table (see rvt::char_width()).
+#
+# usage: tools/gen_char_width.py > src/rvt/char_width.hpp
+
+import sys
+import unicodedata
+
+MAX_CODE_POINT = 0x110000
+BLOCK_BITS = 8
+BLOCK_SIZE = 1 << BLOCK_BITS
+
+# width -> 2 bits value
+ENCODING = {0: 0, 1: 1, 2: 2, -1: 3}
+
+# Code points of Unicode 15.0 which are not in the database of older Python versions
+UNICODE_15_ZERO_WIDTH = [
+    (0x0ECE, 0x0ECE), (0x10EFD, 0x10EFF), (0x11241, 0x11241),
+    (0x11F00, 0x11F01), (0x11F36, 0x11F3A), (0x11F40, 0x11F40),
+    (0x11F42, 0x11F42), (0x13439, 0x13440), (0x13447, 0x13455),
+    (0x1E08F, 0x1E08F), (0x1E4EC, 0x1E4EF),
+]
+UNICODE_15_WIDE = [
+    (0x1B132, 0x1B132), (0x1B155, 0x1B155), (0x1F6DC, 0x1F6DC),
+    (0x1FA75, 0x1FA77), (0x1FA87, 0x1FA88), (0x1FAAD, 0x1FAAF),
+    (0x1FABB, 0x1FABD), (0x1FABF, 0x1FABF), (0x1FACE, 0x1FACF),
+    (0x1FADA, 0x1FADB), (0x1FAE8, 0x1FAE8), (0x1FAF7, 0x1FAF8),
+]
+
+# unassigned code points of these ranges are wide (UAX #11)
+DEFAULT_WIDE = [
+    (0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF),
+    (0x20000, 0x2FFFD), (0x30000, 0x3FFFD),
+]
+
+
+def in_ranges(cp, ranges):
+    return any(first <= cp <= last for first, last in ranges)
+
+
+def width(cp):
+    if cp == 0:
+        return 0
+    if cp < 32 or 0x7f <= cp < 0xa0:
+        return -1
+    if in_ranges(cp, UNICODE_15_ZERO_WIDTH):
+        return 0
+    if in_ranges(cp, UNICODE_15_WIDE):
+        return 2
+
+    c = chr(cp)
+    category = unicodedata.category(c)
+    if (category in ('Mn', 'Me') or (category == 'Cf' and cp != 0xAD)
+        or 0x1160 <= cp <= 0x11FF or cp == 0x200B):
+        return 0
+    if category == 'Cn':
+        # the database of Python does not give the default width of unassigned code points
+        return 2 if in_ranges(cp, DEFAULT_WIDE) else 1
+    if unicodedata.east_asian_width(c) in ('W', 'F'):
+        return 2
+    return 1
+
+
+def main():
+    blocks = []
+    block_ids = {}
+    index = []
+    for first in range(0, MAX_CODE_POINT, BLOCK_SIZE):
+        packed = bytearray(BLOCK_SIZE // 4)
+        for i in range(BLOCK_SIZE):
+            packed[i // 4] |= ENCODING[width(first + i)] << (i % 4 * 2)
+        packed = bytes(packed)
+        if packed not in block_ids:
+            block_ids[packed] = len(blocks)
+            blocks.append(packed)
+        index.append(block_ids[packed])
+
+    assert len(blocks) <= 256
+
+    out = sys.stdout.write
+    out(f'''/*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program; if not, write to the Free Software
+*   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+*   Product name: redemption, a FLOSS RDP proxy
+*   Copyright (C) Wallix 2010-2016
+*   Author(s): Jonathan Poelen
+*/
+
+// generated by tools/gen_char_width.py (Unicode {unicodedata.unidata_version} + 15.0 additions), do not edit
+
+#pragma once
+
+#include "rvt/ucs.hpp"
+
+#include <cstdint>
+
+namespace rvt
+{{
+
+namespace detail
+{{
+    // block of {BLOCK_SIZE} code points -> index in char_width_blocks
+    inline constexpr uint8_t char_width_index[{len(index)}] = {{
+''')
+    for i in range(0, len(index), 16):
+        out('        ' + ' '.join(f'{v},' for v in index[i:i + 16]) + '\n')
+    out(f'''    }};
+
+    // 2 bits by code point: 0, 1, 2 or 3 for -1
+    inline constexpr uint8_t char_width_blocks[{len(blocks)}][{BLOCK_SIZE // 4}] = {{
+''')
+    for block in blocks:
+        out('        {\n')
+        for i in range(0, len(block), 16):
+            out('            ' + ' '.join(f'0x{v:02x},' for v in block[i:i + 16]) + '\n')
+        out('        },\n')
+    out(f'''    }};
+}}
+
+/**
+ * Column width of \\c uc in a terminal:
+ *
+ *  - 0 for U+0000, the non-spacing marks (Mn, Me), the format characters (Cf,
+ *    except SOFT HYPHEN), the Hangul Jamo medial vowels and final consonants
+ *    (U+1160-U+11FF) and ZERO WIDTH SPACE ;
+ *  - -1 for the other C0/C1 control characters and DEL ;
+ *  - 2 for the East Asian Wide (W) and Fullwidth (F) characters (UAX #11),
+ *    emoji with a default emoji presentation included ;
+ *  - 1 otherwise.
+ */
+constexpr int char_width(ucs4_char uc) noexcept
+{{
+    if (uc < 0x7f) {{
+        return uc >= 0x20 ? 1 : uc ? -1 : 0;
+    }}
+    if (uc >= 0x{MAX_CODE_POINT:x}) {{
+        return 1;
+    }}
+    uint8_t const * const block = detail::char_width_blocks[detail::char_width_index[uc >> {BLOCK_BITS}]];
+    int const w = (block[(uc & 0x{BLOCK_SIZE - 1:x}) >> 2] >> ((uc & 3) * 2)) & 3;
+    return w == 3 ? -1 : w;
+}}
+
+}}
+''')
+
+
+if __name__ == '__main__':
+    main()